@@ -6,7 +6,9 @@
 #include <types.h>
 #include <sys/file/file.h>
 #include <sys/process/process.h>
+#include <sys/process/wait.h>
 #include <sys/signal/signal.h>
+#include <uapi/errno.h>
 
 #define PROMPT "[42]$ "
 
@@ -18,11 +20,15 @@ typedef struct {
 
 static ScanBuffer SCAN_BUFFER = { .buffer = { 0 }, .head = 0, .tail = 0 };
 
+/* Readers waiting for a key */
+static wait_queue_head_t tty_wait = WAIT_QUEUE_HEAD_INIT;
+
 void tty_write(u8 scancode)
 {
     if ((SCAN_BUFFER.tail + 1) % 256 != SCAN_BUFFER.head) {
         SCAN_BUFFER.buffer[SCAN_BUFFER.tail] = scancode;
         SCAN_BUFFER.tail = (SCAN_BUFFER.tail + 1) % 256;
+        wake_up(&tty_wait);
     }
 }
 
@@ -70,9 +76,8 @@ console_dev_read(vfs_inode_t* inode, file_t* file, void* buf_ptr, int count)
     size_t read_count = 0;
 
     while (read_count < (size_t)count) {
-        while (tty_is_empty()) {
-            sti();
-            halt();
+        if (wait_event_interruptible(tty_wait, !tty_is_empty()) < 0) {
+            return read_count ? (int)read_count : -EINTR;
         }
 
         u8 ch = tty_read();
@@ -44,6 +44,7 @@
  */
 
 #define UNNAMED_MAJOR 0
+#define RAMDISK_MAJOR 1 // zram
 #define IDE0_MAJOR 3
 #define IDE1_MAJOR 22
 
@@ -0,0 +1,56 @@
+#ifndef _UAPI_MEMINFO_H
+#define _UAPI_MEMINFO_H
+
+#define MEMINFO_NR_ORDERS 23 // Buddy orders 0 to 22, 16 GB in one block
+#define MEMINFO_NR_PROCS 32
+
+struct meminfo_proc {
+    int pid;
+    unsigned long rss; // Pages mapped in its address space
+    unsigned long min_flt;
+    unsigned long maj_flt;
+    char name[16];
+};
+
+/*
+ * Filled in by the meminfo system call. All sizes are in pages of
+ * `page_size` bytes unless the name says otherwise.
+ */
+struct meminfo {
+    unsigned long page_size;
+
+    unsigned long total;
+    unsigned long free;
+    unsigned long highmem_total;
+    unsigned long highmem_free;
+
+    /* Free buddy blocks of each order, both zones together */
+    unsigned long free_blocks[MEMINFO_NR_ORDERS];
+
+    /*
+     * Unusable free space index of each order, in thousandths: the part of
+     * the free memory that lies in blocks too small for an allocation of
+     * that order. 0 is no fragmentation, 1000 means none of it will do.
+     */
+    unsigned long frag_index[MEMINFO_NR_ORDERS];
+
+    unsigned long slab_pages;
+    unsigned long slab_objects;  // Handed out
+    unsigned long slab_capacity; // Objects all slab pages can hold
+    unsigned long slab_bytes;    // Held by the objects handed out
+
+    unsigned long vmalloc_total; // Bytes of address space
+    unsigned long vmalloc_used;  // Including guard pages
+    unsigned long vmalloc_largest_free;
+
+    unsigned long page_tables; // Page tables and page directories
+
+    unsigned long page_cache;
+    unsigned long swap_total;
+    unsigned long swap_free;
+
+    unsigned long nr_procs;
+    struct meminfo_proc procs[MEMINFO_NR_PROCS];
+};
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef _UAPI_RESOURCE_H
+#define _UAPI_RESOURCE_H
+
+/* What getpriority() and setpriority() apply to */
+#define PRIO_PROCESS 0
+#define PRIO_PGRP 1 // Not supported, there are no process groups
+#define PRIO_USER 2
+
+/* Nice levels go from PRIO_MIN to PRIO_MAX - 1 */
+#define PRIO_MIN (-20)
+#define PRIO_MAX 20
+
+#endif
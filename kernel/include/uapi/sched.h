@@ -0,0 +1,17 @@
+#ifndef _UAPI_SCHED_H
+#define _UAPI_SCHED_H
+
+/* Scheduling policies */
+#define SCHED_OTHER 0 // Fair share by nice level
+#define SCHED_FIFO 1  // Real-time, runs until it blocks or yields
+#define SCHED_RR 2    // Real-time, takes turns with others of its priority
+
+/* Real-time priorities, the highest runs first */
+#define SCHED_RT_PRIO_MIN 1
+#define SCHED_RT_PRIO_MAX 99
+
+struct sched_param {
+    int sched_priority;
+};
+
+#endif
@@ -32,4 +32,12 @@ atomic_clear_bit(int nr, SMPVOL void* addr)
     return oldbit;
 }
 
+/* Index of the lowest set bit, `word` must not be 0 */
+__attribute__((always_inline)) static inline unsigned long
+__ffs(unsigned long word)
+{
+    __asm__("bsfl %1,%0" : "=r"(word) : "rm"(word));
+    return word;
+}
+
 #endif
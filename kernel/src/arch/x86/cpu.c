@@ -0,0 +1,108 @@
+#include "arch/x86/cpu.h"
+#include "drivers/printk.h"
+
+#include <ferrite/string.h>
+#include <types.h>
+
+#define EFLAGS_AC (1 << 18)
+#define EFLAGS_ID (1 << 21)
+
+cpuinfo_t boot_cpu = { 0 };
+
+/* Private */
+
+/*
+ * Returns true if `mask` can be toggled in EFLAGS. The AC bit only exists
+ * from the i486 on, the ID bit only on CPUs that implement CPUID.
+ */
+static bool eflags_toggles(u32 mask)
+{
+    u32 before, after;
+
+    __asm__ __volatile__("pushfl\n\t"
+                         "pushfl\n\t"
+                         "popl %0\n\t"
+                         "movl %0, %1\n\t"
+                         "xorl %2, %0\n\t"
+                         "pushl %0\n\t"
+                         "popfl\n\t"
+                         "pushfl\n\t"
+                         "popl %0\n\t"
+                         "popfl"
+                         : "=&r"(after), "=&r"(before)
+                         : "ir"(mask));
+
+    return ((before ^ after) & mask) != 0;
+}
+
+static inline void
+cpuid(u32 leaf, u32* eax, u32* ebx, u32* ecx, u32* edx)
+{
+    __asm__ __volatile__("cpuid"
+                         : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+                         : "a"(leaf), "c"(0));
+}
+
+/* Public */
+
+void cpu_init(void)
+{
+    u32 eax, ebx, ecx, edx;
+
+    memset(&boot_cpu, 0, sizeof(cpuinfo_t));
+    boot_cpu.family = 3;
+    strlcpy(boot_cpu.vendor, "unknown", sizeof(boot_cpu.vendor));
+
+    if (!eflags_toggles(EFLAGS_AC)) {
+        printk("CPU: i386 class, no CPUID\n");
+        return;
+    }
+
+    boot_cpu.family = 4;
+    boot_cpu.features |= X86_FEATURE_INVLPG | X86_FEATURE_WP;
+
+    if (!eflags_toggles(EFLAGS_ID)) {
+        printk("CPU: i486 class, no CPUID\n");
+        return;
+    }
+
+    boot_cpu.features |= X86_FEATURE_CPUID;
+
+    cpuid(0, &eax, &ebx, &ecx, &edx);
+    u32 max_leaf = eax;
+    memcpy(&boot_cpu.vendor[0], &ebx, 4);
+    memcpy(&boot_cpu.vendor[4], &edx, 4);
+    memcpy(&boot_cpu.vendor[8], &ecx, 4);
+    boot_cpu.vendor[12] = '\0';
+
+    if (max_leaf >= 1) {
+        cpuid(1, &eax, &ebx, &ecx, &edx);
+        boot_cpu.family = (eax >> 8) & 0xF;
+
+        if (edx & CPUID_FEAT_EDX_TSC) {
+            boot_cpu.features |= X86_FEATURE_TSC;
+        }
+        if (edx & CPUID_FEAT_EDX_PSE) {
+            boot_cpu.features |= X86_FEATURE_PSE;
+        }
+        if (edx & CPUID_FEAT_EDX_PAE) {
+            boot_cpu.features |= X86_FEATURE_PAE;
+        }
+        if (edx & CPUID_FEAT_EDX_PGE) {
+            boot_cpu.features |= X86_FEATURE_PGE;
+        }
+    }
+
+    cpuid(0x80000000, &eax, &ebx, &ecx, &edx);
+    if ((eax & 0xFFFF0000) == 0x80000000 && eax >= 0x80000001) {
+        cpuid(0x80000001, &eax, &ebx, &ecx, &edx);
+        if (edx & CPUID_EXT_EDX_NX) {
+            boot_cpu.features |= X86_FEATURE_NX;
+        }
+    }
+
+    printk(
+        "CPU: %s family %u, features 0x%x\n", boot_cpu.vendor, boot_cpu.family,
+        boot_cpu.features
+    );
+}
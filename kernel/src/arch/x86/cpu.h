@@ -3,10 +3,83 @@
 
 #include "arch/x86/io.h"
 
+#include <stdbool.h>
 #include <types.h>
 
+/* CPUID leaf 1, EDX */
+#define CPUID_FEAT_EDX_PSE (1 << 3)
+#define CPUID_FEAT_EDX_TSC (1 << 4)
+#define CPUID_FEAT_EDX_PAE (1 << 6)
+#define CPUID_FEAT_EDX_PGE (1 << 13)
+
+/* CPUID leaf 0x80000001, EDX */
+#define CPUID_EXT_EDX_NX (1 << 20)
+
+#define X86_FEATURE_CPUID (1 << 0)
+#define X86_FEATURE_TSC (1 << 1)
+#define X86_FEATURE_PSE (1 << 2)
+#define X86_FEATURE_PAE (1 << 3)
+#define X86_FEATURE_PGE (1 << 4)
+#define X86_FEATURE_NX (1 << 5)
+#define X86_FEATURE_INVLPG (1 << 6) /* i486 and later */
+#define X86_FEATURE_WP (1 << 7)     /* i486 and later */
+
+#define CR0_WP (1 << 16) // Supervisor writes honour read-only pages
+
+#define CR4_PSE (1 << 4) // 4 MB pages
+#define CR4_PAE (1 << 5) // Three-level paging with 64-bit entries
+#define CR4_PGE (1 << 7) // Global pages survive CR3 reloads
+
+#define MSR_EFER 0xC0000080
+#define EFER_NXE (1 << 11) // Honour the NX bit of PAE entries
+
+typedef struct {
+    u8 family; // 3 for an i386, 4 for an i486, from CPUID otherwise
+    u32 features;
+    char vendor[13];
+} cpuinfo_t;
+
+extern cpuinfo_t boot_cpu;
+
+void cpu_init(void);
+
+static inline bool cpu_has(u32 feature)
+{
+    return (boot_cpu.features & feature) != 0;
+}
+
 static inline void halt(void) { __asm__ __volatile__("hlt"); }
 
+/* i486 and later, check X86_FEATURE_INVLPG */
+static inline void invlpg(u32 vaddr)
+{
+    __asm__ __volatile__("invlpg (%0)" : : "r"(vaddr) : "memory");
+}
+
+/* Pentium and later, only touch MSRs the CPUID features vouch for */
+static inline u64 rdmsr(u32 msr)
+{
+    u32 lo, hi;
+
+    __asm__ __volatile__("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((u64)hi << 32) | lo;
+}
+
+static inline void wrmsr(u32 msr, u64 val)
+{
+    __asm__ __volatile__(
+        "wrmsr" : : "c"(msr), "a"((u32)val), "d"((u32)(val >> 32))
+    );
+}
+
+static inline unsigned long long rdtsc(void)
+{
+    u32 lo, hi;
+
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((unsigned long long)hi << 32) | lo;
+}
+
 static inline __attribute__((noreturn)) void reboot(void)
 {
     while (inb(0x64) & 0x02)
@@ -1,7 +1,9 @@
 #include "arch/x86/idt/idt.h"
 #include "debug/debug.h"
 #include "debug/panic.h"
+#include "memory/consts.h"
 #include "drivers/printk.h"
+#include "memory/vma.h"
 #include "memory/vmm.h"
 #include "sys/process/process.h"
 
@@ -194,20 +196,41 @@ general_protection_fault(trapframe_t* regs, u32 error_code)
 
 #define USER_SPACE_END 0xC0000000
 
+/*
+ * The user stack pointer at the time of the fault. In kernel mode it is the
+ * one saved on entry to the system call, at the top of the kernel stack.
+ */
+static u32 user_esp(proc_t const* p, trapframe_t const* regs)
+{
+    if ((regs->cs & 3) == USER_MODE) {
+        return regs->esp;
+    }
+
+    trapframe_t const* tf
+        = (trapframe_t const*)(p->kstack + PAGE_SIZE - sizeof(trapframe_t));
+    return tf->esp;
+}
+
 __attribute__((target("general-regs-only"))) void
 page_fault(trapframe_t* regs, u32 error_code)
 {
     u32 fault_addr;
     __asm__ volatile("movl %%cr2, %0" : "=r"(fault_addr));
 
-    if ((regs->cs & 3) == USER_MODE && fault_addr < USER_SPACE_END) {
-
-        if ((error_code & 0x1) == 0) {
-            void* page_base = (void*)(fault_addr & ~0xFFF);
+    /* Syscalls touching a user buffer fault on its pages like the user would */
+    proc_t* p = myproc();
+    if (p && fault_addr < USER_SPACE_END) {
+        u32 sp = user_esp(p, regs);
+        if (handle_mm_fault(&p->mm, fault_addr, error_code, sp) == 0) {
+            return;
+        }
 
-            if (vmm_map_page(NULL, page_base, PTE_P | PTE_W | PTE_U) == 0) {
-                return;
-            }
+        if ((regs->cs & 3) == USER_MODE) {
+            printk(
+                "%s[%d]: segfault at 0x%x ip 0x%x error %x\n", p->name, p->pid,
+                fault_addr, regs->eip, error_code
+            );
+            do_exit(-1);
         }
     }
 
@@ -1,4 +1,5 @@
 #include "arch/x86/idt/idt.h"
+#include "arch/x86/idt/syscalls.h"
 #include "arch/x86/pic.h"
 #include "arch/x86/pit.h"
 #include "arch/x86/time/time.h"
@@ -7,13 +8,13 @@
 #include "module/keyboard.h"
 #include "module/timer.h"
 #include "sys/process/process.h"
+#include "sys/process/sched.h"
+#include "sys/signal/signal.h"
 #include "sys/timer/timer.h"
 
 #include <types.h>
 
-extern s32 ticks_remaining;
 extern context_t* scheduler_context;
-extern int volatile need_resched;
 
 unsigned long long volatile ticks = 0;
 
@@ -24,21 +25,13 @@ timer_handler(trapframe_t* regs)
 
     ticks += 1;
     check_timers();
+    sched_tick();
 
     if (ticks % HZ == 0) {
         time_t new_epoch = getepoch() + 1;
         setepoch(new_epoch);
 
         trigger_timer_callbacks(ticks);
-
-        proc_t* proc = myproc();
-        if (proc && proc->state == RUNNING) {
-            ticks_remaining -= 1;
-            if (ticks_remaining <= 0) {
-                need_resched = 1;
-                printk("Timer: scheduling needed for PID %d\n", proc->pid);
-            }
-        }
     }
     pic_send_eoi(0);
 }
@@ -95,4 +88,7 @@ irq_dispatcher_c(trapframe_t* regs)
     }
 
     check_resched();
+    if (regs->cs == USER_CS) {
+        handle_signal();
+    }
 }
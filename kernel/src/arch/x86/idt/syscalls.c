@@ -3,8 +3,15 @@
 #include "arch/x86/time/time.h"
 #include "fs/exec.h"
 #include "memory/buddy_allocator/buddy.h"
+#include "memory/kmalloc.h"
+#include "memory/kmemtrace.h"
+#include "memory/meminfo.h"
+#include "memory/mmap.h"
+#include "memory/page.h"
+#include "memory/vma.h"
 #include "memory/vmm.h"
 #include "sys/process/process.h"
+#include "sys/process/sched.h"
 #include "sys/signal/signal.h"
 #include "sys/timer/timer.h"
 #include "syscalls.h"
@@ -13,6 +20,7 @@
 #include <memory/consts.h>
 #include <types.h>
 #include <uapi/errno.h>
+#include <uapi/mman.h>
 
 #define SYSCALL_ENTRY_0(num, fname) \
     [num] = { .handler = (void*)(sys_##fname), .nargs = 0, .name = #fname }
@@ -42,6 +50,11 @@ SYSCALL_ATTR static s32 sys_fork(trapframe_t* tf)
     return do_fork(tf, "user process");
 }
 
+SYSCALL_ATTR static s32 sys_vfork(trapframe_t* tf)
+{
+    return do_vfork(tf, "user process");
+}
+
 SYSCALL_ATTR static int sys_brk(unsigned long brk)
 {
     unsigned int old_brk = myproc()->mm.current;
@@ -56,22 +69,56 @@ SYSCALL_ATTR static int sys_brk(unsigned long brk)
         return -EINVAL;
     }
 
+    /* Pages are only mapped once they are touched */
+    vm_area_t* heap = vma_find_type(&myproc()->mm, VMA_HEAP);
+    if (!heap || vma_resize(heap, ALIGN(brk, PAGE_SIZE)) < 0) {
+        return -ENOMEM;
+    }
+
     if (brk < old_brk) {
         unsigned int old_page_end = ALIGN(old_brk, PAGE_SIZE);
         unsigned int new_page_end = ALIGN(brk, PAGE_SIZE);
 
-        for (u32 addr = new_page_end; addr < old_page_end; addr += PAGE_SIZE) {
-            void* phys = vmm_unmap_page((void*)addr);
-            if (phys && buddy_manages((paddr_t)phys)) {
-                buddy_dealloc((paddr_t)phys, 0);
-            }
-        }
+        vmm_unmap_range((void*)new_page_end, old_page_end - new_page_end, true);
     }
 
     myproc()->mm.current = brk;
     return 0;
 }
 
+SYSCALL_ATTR static s32 sys_mmap(struct mmap_arg_struct const* uargs)
+{
+    memory_t* mm = &myproc()->mm;
+    struct mmap_arg_struct args;
+
+    if (!vma_access_ok(mm, (u32)uargs, sizeof(args), false)) {
+        return -EFAULT;
+    }
+    memcpy(&args, uargs, sizeof(args));
+
+    return do_mmap(
+        mm, args.addr, args.len, args.prot, args.flags, (s32)args.fd,
+        args.offset
+    );
+}
+
+SYSCALL_ATTR static s32 sys_munmap(unsigned long addr, unsigned long len)
+{
+    return do_munmap(&myproc()->mm, addr, len);
+}
+
+SYSCALL_ATTR static s32
+sys_mprotect(unsigned long addr, unsigned long len, unsigned long prot)
+{
+    return do_mprotect(&myproc()->mm, addr, len, prot);
+}
+
+SYSCALL_ATTR static s32
+sys_msync(unsigned long addr, unsigned long len, unsigned long flags)
+{
+    return do_msync(&myproc()->mm, addr, len, flags);
+}
+
 SYSCALL_ATTR static pid_t sys_waitpid(pid_t pid, s32* status, s32 options)
 {
     (void)pid;
@@ -123,6 +170,42 @@ SYSCALL_ATTR static s32 sys_kill(pid_t pid, s32 sig)
 
 SYSCALL_ATTR static s32 sys_nanosleep(void) { return knanosleep(1000); }
 
+SYSCALL_ATTR static s32 sys_sched_yield(void)
+{
+    sched_yield();
+    return 0;
+}
+
+/* Dumps the kmalloc() call sites to the console and the serial port */
+SYSCALL_ATTR static s32 sys_kmemtrace(u32 min_age)
+{
+    if (myproc()->euid != ROOT_UID) {
+        return -EPERM;
+    }
+
+    return kmemtrace_dump(min_age);
+}
+
+SYSCALL_ATTR static s32 sys_meminfo(struct meminfo* info)
+{
+    if (!vma_access_ok(
+            &myproc()->mm, (u32)info, sizeof(struct meminfo), true
+        )) {
+        return -EFAULT;
+    }
+
+    /* Filled in with interrupts off at times, which must not fault */
+    struct meminfo* tmp = kmalloc(sizeof(struct meminfo));
+    if (!tmp) {
+        return -ENOMEM;
+    }
+
+    meminfo_get(tmp);
+    memcpy(info, tmp, sizeof(struct meminfo));
+    kfree(tmp);
+    return 0;
+}
+
 struct syscall_entry {
     void* handler;
     u8 nargs;
@@ -154,6 +237,7 @@ static const struct syscall_entry syscall_table[NR_SYSCALLS] = {
     SYSCALL_ENTRY_1(SYS_SETUID, setuid),
     SYSCALL_ENTRY_1(SYS_GETUID, getuid),
     SYSCALL_ENTRY_2(SYS_FSTAT, fstat),
+    SYSCALL_ENTRY_1(SYS_NICE, nice),
     SYSCALL_ENTRY_2(SYS_KILL, kill),
     SYSCALL_ENTRY_2(SYS_MKDIR, mkdir),
     SYSCALL_ENTRY_1(SYS_RMDIR, rmdir),
@@ -169,16 +253,28 @@ static const struct syscall_entry syscall_table[NR_SYSCALLS] = {
     SYSCALL_ENTRY_2(SYS_GETGROUPS, getgroups),
     SYSCALL_ENTRY_4(SYS_REBOOT, reboot),
     SYSCALL_ENTRY_3(SYS_READDIR, readdir),
+    SYSCALL_ENTRY_1(SYS_MMAP, mmap),
+    SYSCALL_ENTRY_2(SYS_MUNMAP, munmap),
     SYSCALL_ENTRY_2(SYS_TRUNCATE, truncate),
     SYSCALL_ENTRY_2(SYS_FTRUNCATE, ftruncate),
+    SYSCALL_ENTRY_2(SYS_GETPRIORITY, getpriority),
+    SYSCALL_ENTRY_3(SYS_SETPRIORITY, setpriority),
     SYSCALL_ENTRY_2(SYS_SOCKETCALL, socketcall),
+    SYSCALL_ENTRY_3(SYS_MPROTECT, mprotect),
     SYSCALL_ENTRY_3(SYS_INIT_MODULE, init_module),
     SYSCALL_ENTRY_2(SYS_DELETE_MODULE, delete_module),
     SYSCALL_ENTRY_1(SYS_FCHDIR, fchdir),
+    SYSCALL_ENTRY_3(SYS_MSYNC, msync),
+    SYSCALL_ENTRY_2(SYS_SCHED_GETPARAM, sched_getparam),
+    SYSCALL_ENTRY_3(SYS_SCHED_SETSCHEDULER, sched_setscheduler),
+    SYSCALL_ENTRY_1(SYS_SCHED_GETSCHEDULER, sched_getscheduler),
+    SYSCALL_ENTRY_0(SYS_SCHED_YIELD, sched_yield),
     SYSCALL_ENTRY_0(SYS_NANOSLEEP, nanosleep),
     SYSCALL_ENTRY_3(SYS_SETRESUID, setresuid),
     SYSCALL_ENTRY_3(SYS_SETRESGID, setresgid),
     SYSCALL_ENTRY_2(SYS_GETCWD, getcwd),
+    SYSCALL_ENTRY_1(SYS_KMEMTRACE, kmemtrace),
+    SYSCALL_ENTRY_1(SYS_MEMINFO, meminfo),
 };
 
 __attribute__((target("general-regs-only"))) void
@@ -190,6 +286,9 @@ syscall_dispatcher_c(trapframe_t* reg)
     if (syscall_num == 0 || syscall_num >= NR_SYSCALLS) {
         reg->eax = -ENOSYS;
         check_resched();
+        if (reg->cs == USER_CS) {
+            handle_signal();
+        }
         return;
     }
 
@@ -213,6 +312,10 @@ syscall_dispatcher_c(trapframe_t* reg)
         ret = sys_fork(reg);
         break;
 
+    case SYS_VFORK:
+        ret = sys_vfork(reg);
+        break;
+
     case SYS_SIGNAL:
     case SYS_GETRESUID:
     case SYS_GETRESGID:
@@ -252,4 +355,7 @@ syscall_dispatcher_c(trapframe_t* reg)
 
     reg->eax = ret;
     check_resched();
+    if (reg->cs == USER_CS) {
+        handle_signal();
+    }
 }
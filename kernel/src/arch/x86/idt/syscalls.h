@@ -4,6 +4,7 @@
 #include "idt/idt.h"
 
 #include <uapi/dirent.h>
+#include <uapi/sched.h>
 #include <uapi/stat.h>
 #include <uapi/types.h>
 
@@ -45,6 +46,8 @@ enum syscalls_e {
 
     SYS_FSTAT = 28,
 
+    SYS_NICE = 34,
+
     SYS_KILL = 37,
     SYS_MKDIR = 39,
     SYS_RMDIR = 40,
@@ -68,14 +71,24 @@ enum syscalls_e {
     SYS_REBOOT = 88,
 
     SYS_READDIR = 89,
+    SYS_MMAP = 90,
+    SYS_MUNMAP = 91,
     SYS_TRUNCATE = 92,
     SYS_FTRUNCATE = 93,
+    SYS_GETPRIORITY = 96,
+    SYS_SETPRIORITY = 97,
     SYS_SOCKETCALL = 102,
+    SYS_MPROTECT = 125,
 
     SYS_INIT_MODULE = 128,
     SYS_DELETE_MODULE = 129,
 
     SYS_FCHDIR = 133,
+    SYS_MSYNC = 144,
+    SYS_SCHED_GETPARAM = 155,
+    SYS_SCHED_SETSCHEDULER = 156,
+    SYS_SCHED_GETSCHEDULER = 157,
+    SYS_SCHED_YIELD = 158,
     SYS_NANOSLEEP = 162,
 
     SYS_SETRESUID = 164,
@@ -84,6 +97,10 @@ enum syscalls_e {
     SYS_GETRESGID = 171,
 
     SYS_GETCWD = 183,
+    SYS_VFORK = 190,
+
+    SYS_KMEMTRACE = 223, // Ferrite only, unused on Linux/i386
+    SYS_MEMINFO = 224,   // Ferrite only, unused on Linux/i386
     NR_SYSCALLS
 };
 
@@ -139,6 +156,22 @@ SYSCALL_ATTR int sys_mount(char*, char*, char*, unsigned long, void*);
 
 SYSCALL_ATTR int sys_umount(char const*, int);
 
+/* Priority */
+
+SYSCALL_ATTR s32 sys_nice(s32);
+
+SYSCALL_ATTR s32 sys_getpriority(s32, s32);
+
+SYSCALL_ATTR s32 sys_setpriority(s32, s32, s32);
+
+/* Scheduling */
+
+SYSCALL_ATTR s32 sys_sched_setscheduler(s32, s32, struct sched_param const*);
+
+SYSCALL_ATTR s32 sys_sched_getscheduler(s32);
+
+SYSCALL_ATTR s32 sys_sched_getparam(s32, struct sched_param*);
+
 /* UID */
 
 SYSCALL_ATTR uid_t sys_getuid(void);
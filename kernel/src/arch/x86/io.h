@@ -1,6 +1,7 @@
 #ifndef IO_H
 #define IO_H
 
+#include <stdbool.h>
 #include <types.h>
 
 static inline u8 inb(u16 addr)
@@ -45,6 +46,52 @@ static inline void cli(void) { __asm__ volatile("cli"); }
 
 static inline void sti(void) { __asm__ volatile("sti"); }
 
+/* Disables interrupts and returns whether they were enabled before */
+static inline bool irq_save(void)
+{
+    u32 eflags;
+    __asm__ volatile("pushfl; popl %0; cli" : "=r"(eflags) : : "memory");
+    return (eflags & (1 << 9)) != 0;
+}
+
+static inline void irq_restore(bool enabled)
+{
+    if (enabled) {
+        sti();
+    }
+}
+
+static inline u32 rcr0(void)
+{
+    u32 val;
+    __asm__ volatile("movl %%cr0, %0" : "=r"(val));
+    return val;
+}
+
+static inline void lcr0(u32 val)
+{
+    __asm__ volatile("movl %0, %%cr0" : : "r"(val));
+}
+
+static inline u32 rcr4(void)
+{
+    u32 val;
+    __asm__ volatile("movl %%cr4, %0" : "=r"(val));
+    return val;
+}
+
+static inline void lcr4(u32 val)
+{
+    __asm__ volatile("movl %0, %%cr4" : : "r"(val));
+}
+
+static inline u32 rcr3(void)
+{
+    u32 val;
+    __asm__ volatile("movl %%cr3, %0" : "=r"(val));
+    return val;
+}
+
 static inline void lcr3(u32 val)
 {
     __asm__ volatile("movl %0, %%cr3" : : "r"(val));
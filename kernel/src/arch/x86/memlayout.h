@@ -1,4 +1,7 @@
 #define KERNBASE 0xC0000000 // First kernel virtual address
 
+/* Size of the direct map at KERNBASE, RAM above it is highmem */
+#define ZONE_NORMAL (896 * 1024 * 1024)
+
 #define V2P_WO(x) ((x) - KERNBASE) // same as V2P, but without casts
 #define P2V_WO(x) ((x) + KERNBASE) // same as P2V, but without casts
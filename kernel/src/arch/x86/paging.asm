@@ -4,6 +4,7 @@
 	global  enable_paging
 	global  load_page_directory
 	global  flush_tlb
+	global  enable_pae
 
 	; The TLB is not transparently informed of changes made to paging structures.
 	; Therefore the TLB has to be flushed upon such a change. On x86 systems
@@ -40,3 +41,35 @@ load_page_directory:
 	mov esp, ebp
 	pop ebp
 	ret
+
+	; Switches the running kernel from two-level paging to PAE with the page
+	; directory pointer table at the physical address given as argument.
+	; CR4.PAE can only change with paging off, so this runs from the identity
+	; map meanwhile. Both address spaces have to map this code and the stack.
+
+enable_pae:
+	mov edx, [esp + 4]
+
+	mov eax, .identity - 0xC0000000
+	jmp eax
+
+.identity:
+	mov eax, cr0
+	and eax, 0x7FFFFFFF; Clear the PG bit
+	mov cr0, eax
+
+	mov eax, cr4
+	or  eax, 0x20; Set the PAE bit
+	mov cr4, eax
+
+	mov cr3, edx
+
+	mov eax, cr0
+	or  eax, 0x80000000
+	mov cr0, eax
+
+	mov eax, .higher_half
+	jmp eax
+
+.higher_half:
+	ret
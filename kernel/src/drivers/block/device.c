@@ -1,5 +1,6 @@
 #include "drivers/block/device.h"
 #include "drivers/block/ide.h"
+#include "drivers/block/zram.h"
 #include "drivers/printk.h"
 #include "memory/kmalloc.h"
 
@@ -9,6 +10,7 @@
 #include <lib/stdlib.h>
 
 extern struct device_operations ide_device_ops;
+extern struct device_operations zram_device_ops;
 
 static int num_block_devices = 0;
 
@@ -81,8 +83,14 @@ void register_block_device(dev_t bdev, block_device_type_e type, void* data)
     switch (type) {
     case BLOCK_DEVICE_IDE:
         d->d_sector_size = read_from_ata_data();
+        d->d_nr_sectors = ((ata_drive_t*)data)->lba28_sectors;
         d->d_op = &ide_device_ops;
         break;
+    case BLOCK_DEVICE_ZRAM:
+        d->d_sector_size = ZRAM_SECTOR_SIZE;
+        d->d_nr_sectors = ((zram_t*)data)->z_pages * ZRAM_SECTORS_PER_PAGE;
+        d->d_op = &zram_device_ops;
+        break;
     default:
         printk("Unsupported device type %d\n", type);
         return;
@@ -12,12 +12,14 @@ typedef enum {
     BLOCK_DEVICE_IDE,
     BLOCK_DEVICE_SATA,
     BLOCK_DEVICE_NVME,
+    BLOCK_DEVICE_ZRAM,
     BLOCK_DEVICE_UNKNOWN,
 } block_device_type_e;
 
 typedef struct block_device {
     dev_t d_dev;
     u32 d_sector_size;
+    u32 d_nr_sectors; // Capacity, in sectors of d_sector_size
 
     void* d_data;
 
@@ -0,0 +1,309 @@
+#include "drivers/block/zram.h"
+#include "arch/x86/cpu.h"
+#include "drivers/block/device.h"
+#include "drivers/printk.h"
+#include "ferrite/major.h"
+#include "lib/lz4.h"
+#include "lib/math.h"
+#include "memory/consts.h"
+#include "memory/kmalloc.h"
+#include "memory/vmalloc.h"
+
+#include <ferrite/string.h>
+#include <types.h>
+
+static zram_t zram0;
+
+/* A page being merged with a partial write, and the compressor output */
+static u8 zram_buf[PAGE_SIZE];
+static u8 zram_cbuf[ZRAM_MAX_COMPRESSED];
+
+static s32
+zram_read(block_device_t* d, u32 lba, u32 count, void* buf, size_t len);
+static s32
+zram_write(block_device_t* d, u32 lba, u32 count, void const* buf, size_t len);
+static void zram_shutdown(block_device_t* d);
+
+struct device_operations zram_device_ops = {
+    .read = zram_read,
+    .write = zram_write,
+    .shutdown = zram_shutdown,
+};
+
+/* Private */
+
+static inline u64 now(void)
+{
+    return cpu_has(X86_FEATURE_TSC) ? rdtsc() : 0;
+}
+
+static bool page_is_zero(void const* page)
+{
+    u32 const* word = page;
+
+    for (u32 i = 0; i < PAGE_SIZE / sizeof(u32); i += 1) {
+        if (word[i]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void zram_free_slot(zram_t* z, u32 index)
+{
+    zram_slot_t* slot = &z->z_table[index];
+
+    if (slot->data) {
+        kfree(slot->data);
+        z->z_stats.pages_stored -= 1;
+        z->z_stats.compr_size -= slot->size;
+    }
+    if (slot->flags & ZRAM_HUGE) {
+        z->z_stats.huge_pages -= 1;
+    }
+    if (slot->flags & ZRAM_ZERO) {
+        z->z_stats.zero_pages -= 1;
+    }
+
+    slot->data = NULL;
+    slot->size = 0;
+    slot->flags = 0;
+}
+
+static s32 zram_load(zram_t const* z, u32 index, void* page)
+{
+    zram_slot_t const* slot = &z->z_table[index];
+
+    if (!slot->data) {
+        memset(page, 0, PAGE_SIZE);
+        return 0;
+    }
+
+    if (slot->flags & ZRAM_HUGE) {
+        memcpy(page, slot->data, PAGE_SIZE);
+        return 0;
+    }
+
+    if (lz4_decompress(slot->data, slot->size, page, PAGE_SIZE) != PAGE_SIZE) {
+        printk("zram: page %u is corrupt\n", index);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Replaces page `index` with `page`. Zero pages take no memory at all, pages
+ * that barely compress are kept as they are, so reading them back costs a
+ * copy instead of a decompression. On failure the old content stays.
+ */
+static s32 zram_store(zram_t* z, u32 index, void const* page)
+{
+    if (page_is_zero(page)) {
+        zram_free_slot(z, index);
+        z->z_table[index].flags = ZRAM_ZERO;
+        z->z_stats.zero_pages += 1;
+        return 0;
+    }
+
+    void const* from = zram_cbuf;
+    u16 flags = 0;
+    s32 size = lz4_compress(page, PAGE_SIZE, zram_cbuf, sizeof(zram_cbuf));
+    if (size < 0) {
+        from = page;
+        size = PAGE_SIZE;
+        flags = ZRAM_HUGE;
+    }
+
+    void* data = kmalloc(size);
+    if (!data) {
+        return -1;
+    }
+
+    memcpy(data, from, size);
+    zram_free_slot(z, index);
+
+    z->z_table[index].data = data;
+    z->z_table[index].size = (u16)size;
+    z->z_table[index].flags = flags;
+
+    z->z_stats.pages_stored += 1;
+    z->z_stats.compr_size += size;
+    if (flags & ZRAM_HUGE) {
+        z->z_stats.huge_pages += 1;
+    }
+
+    return 0;
+}
+
+static bool zram_valid(block_device_t const* d, u32 lba, u32 count, size_t len)
+{
+    return count <= d->d_nr_sectors && lba <= d->d_nr_sectors - count
+        && len >= count * ZRAM_SECTOR_SIZE;
+}
+
+static s32
+zram_read(block_device_t* d, u32 lba, u32 count, void* buf, size_t len)
+{
+    zram_t* z = d->d_data;
+    u8* out = buf;
+    u64 start = now();
+
+    if (!zram_valid(d, lba, count, len)) {
+        return -1;
+    }
+
+    while (count > 0) {
+        u32 index = lba / ZRAM_SECTORS_PER_PAGE;
+        u32 first = lba % ZRAM_SECTORS_PER_PAGE;
+        u32 n = min(ZRAM_SECTORS_PER_PAGE - first, count);
+
+        if (n == ZRAM_SECTORS_PER_PAGE) {
+            if (zram_load(z, index, out) < 0) {
+                return -1;
+            }
+        } else {
+            if (zram_load(z, index, zram_buf) < 0) {
+                return -1;
+            }
+            memcpy(
+                out, zram_buf + (first * ZRAM_SECTOR_SIZE),
+                n * ZRAM_SECTOR_SIZE
+            );
+        }
+
+        lba += n;
+        count -= n;
+        out += n * ZRAM_SECTOR_SIZE;
+    }
+
+    z->z_stats.reads += 1;
+    z->z_stats.read_cycles += now() - start;
+    return 0;
+}
+
+static s32
+zram_write(block_device_t* d, u32 lba, u32 count, void const* buf, size_t len)
+{
+    zram_t* z = d->d_data;
+    u8 const* in = buf;
+    u64 start = now();
+
+    if (!zram_valid(d, lba, count, len)) {
+        return -1;
+    }
+
+    while (count > 0) {
+        u32 index = lba / ZRAM_SECTORS_PER_PAGE;
+        u32 first = lba % ZRAM_SECTORS_PER_PAGE;
+        u32 n = min(ZRAM_SECTORS_PER_PAGE - first, count);
+        void const* page = in;
+
+        /* Part of a page: merge it with what is stored */
+        if (n != ZRAM_SECTORS_PER_PAGE) {
+            if (zram_load(z, index, zram_buf) < 0) {
+                return -1;
+            }
+            memcpy(
+                zram_buf + (first * ZRAM_SECTOR_SIZE), in, n * ZRAM_SECTOR_SIZE
+            );
+            page = zram_buf;
+        }
+
+        if (zram_store(z, index, page) < 0) {
+            return -1;
+        }
+
+        lba += n;
+        count -= n;
+        in += n * ZRAM_SECTOR_SIZE;
+    }
+
+    z->z_stats.writes += 1;
+    z->z_stats.write_cycles += now() - start;
+    return 0;
+}
+
+static void zram_shutdown(block_device_t* d)
+{
+    zram_t* z = d->d_data;
+
+    for (u32 index = 0; index < z->z_pages; index += 1) {
+        zram_free_slot(z, index);
+    }
+}
+
+/* Parses "<bytes>", "<n>K" or "<n>M" */
+static u32 parse_size(char const* str)
+{
+    u32 size = 0;
+
+    while (*str >= '0' && *str <= '9') {
+        size = (size * 10) + (u32)(*str - '0');
+        str += 1;
+    }
+
+    if (*str == 'K' || *str == 'k') {
+        size *= 1024;
+    } else if (*str == 'M' || *str == 'm') {
+        size *= 1024 * 1024;
+    }
+
+    return size;
+}
+
+/* Public */
+
+void zram_init(char const* cmdline)
+{
+    char const* param = strnstr(cmdline, "zram=", strlen(cmdline));
+    if (!param) {
+        return;
+    }
+
+    u32 pages = parse_size(param + 5) / PAGE_SIZE;
+    if (pages == 0) {
+        printk("zram: invalid size\n");
+        return;
+    }
+
+    zram0.z_table = vmalloc(pages * sizeof(zram_slot_t));
+    if (!zram0.z_table) {
+        printk("zram: no memory for %u pages\n", pages);
+        return;
+    }
+
+    memset(zram0.z_table, 0, pages * sizeof(zram_slot_t));
+    zram0.z_pages = pages;
+
+    register_block_device(MKDEV(RAMDISK_MAJOR, 0), BLOCK_DEVICE_ZRAM, &zram0);
+    printk("zram: /dev/zram0, %u KB\n", pages * (PAGE_SIZE / 1024));
+}
+
+void zram_dump(void)
+{
+    zram_stats_t const* s = &zram0.z_stats;
+
+    if (!zram0.z_pages) {
+        return;
+    }
+
+    u32 orig = (s->pages_stored + s->zero_pages) * PAGE_SIZE;
+    u32 ratio = s->compr_size ? (u32)(((u64)orig * 100) / s->compr_size) : 0;
+
+    printk(
+        "zram0: %u of %u pages used (%u zero, %u uncompressed)\n",
+        s->pages_stored + s->zero_pages, zram0.z_pages, s->zero_pages,
+        s->huge_pages
+    );
+    printk(
+        "  %u KB in %u KB, ratio %u.%02u\n", orig / 1024, s->compr_size / 1024,
+        ratio / 100, ratio % 100
+    );
+    printk(
+        "  %u reads, %u cycles avg; %u writes, %u cycles avg\n", s->reads,
+        s->reads ? (u32)(s->read_cycles / s->reads) : 0, s->writes,
+        s->writes ? (u32)(s->write_cycles / s->writes) : 0
+    );
+}
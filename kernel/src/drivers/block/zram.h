@@ -0,0 +1,53 @@
+#ifndef ZRAM_H
+#define ZRAM_H
+
+#include "memory/consts.h"
+
+#include <types.h>
+
+#define ZRAM_SECTOR_SIZE 512
+#define ZRAM_SECTORS_PER_PAGE (PAGE_SIZE / ZRAM_SECTOR_SIZE)
+
+/* Pages that do not shrink below this are stored as they are */
+#define ZRAM_MAX_COMPRESSED (PAGE_SIZE * 3 / 4)
+
+/* zram_slot_t flags */
+#define ZRAM_ZERO (1 << 0) // All zeroes, nothing is stored
+#define ZRAM_HUGE (1 << 1) // Did not compress, stored uncompressed
+
+/* One page of the disk */
+typedef struct {
+    void* data; // kmalloc()ed, NULL for zero and never written pages
+    u16 size;
+    u16 flags;
+} zram_slot_t;
+
+typedef struct {
+    u32 pages_stored; // Pages holding data, zero pages not included
+    u32 zero_pages;
+    u32 huge_pages;
+    u32 compr_size; // Bytes of memory the stored pages take
+
+    u32 reads;
+    u32 writes;
+    u64 read_cycles; // Spent in reads, 0 without a TSC
+    u64 write_cycles;
+} zram_stats_t;
+
+typedef struct {
+    u32 z_pages;
+    zram_slot_t* z_table; // vmalloc()ed, one slot per page
+    zram_stats_t z_stats;
+} zram_t;
+
+/**
+ * Creates /dev/zram0 if the command line has "zram=<size>", with the size
+ * in bytes or with a K or M suffix. It can be used as swap with
+ * "swap=/dev/zram0".
+ */
+void zram_init(char const* cmdline);
+
+/* Prints the compression ratio and the average cost of reads and writes */
+void zram_dump(void);
+
+#endif /* ZRAM_H */
@@ -4,21 +4,199 @@
 #include "idt/idt.h"
 #include "idt/syscalls.h"
 #include "lib/math.h"
-#include "memory/buddy_allocator/buddy.h"
 #include "memory/consts.h"
+#include "memory/kmalloc.h"
+#include "memory/mmap.h"
+#include "memory/vma.h"
 #include "memory/vmm.h"
 #include "sys/process/process.h"
 
 #include <ferrite/elf.h>
 #include <ferrite/string.h>
 #include <uapi/errno.h>
+#include <uapi/mman.h>
 
 #define MAX_HEAP_SIZE (128 * 1024 * 1024)
 #define MAX_ARGS 10
 
+/* Bounds the program header table read at exec time */
+#define MAX_PHDRS 128
+
+static u32 segment_vm_flags(elf32_phdr_t const* phdr)
+{
+    u32 flags = 0;
+
+    if (phdr->p_flags & PF_R) {
+        flags |= VM_READ;
+    }
+    if (phdr->p_flags & PF_W) {
+        flags |= VM_WRITE;
+    }
+    if (phdr->p_flags & PF_X) {
+        flags |= VM_EXEC;
+    }
+
+    return flags;
+}
+
+static u32 segment_prot(elf32_phdr_t const* phdr)
+{
+    u32 prot = 0;
+
+    if (phdr->p_flags & PF_R) {
+        prot |= PROT_READ;
+    }
+    if (phdr->p_flags & PF_W) {
+        prot |= PROT_WRITE;
+    }
+    if (phdr->p_flags & PF_X) {
+        prot |= PROT_EXEC;
+    }
+
+    return prot;
+}
+
+/*
+ * Rejects segments the loader cannot map: file and memory offsets must agree
+ * within a page and the whole segment must lie in the file and below
+ * KERNBASE.
+ */
+static bool segment_is_valid(vfs_inode_t const* node, elf32_phdr_t const* phdr)
+{
+    if (phdr->p_filesz > phdr->p_memsz) {
+        return false;
+    }
+
+    if ((phdr->p_vaddr - phdr->p_offset) & (PAGE_SIZE - 1)) {
+        return false;
+    }
+
+    if (phdr->p_offset + phdr->p_filesz < phdr->p_offset
+        || phdr->p_offset + phdr->p_filesz > node->i_size) {
+        return false;
+    }
+
+    return phdr->p_vaddr + phdr->p_memsz >= phdr->p_vaddr
+        && phdr->p_vaddr + phdr->p_memsz <= KERNBASE;
+}
+
+/*
+ * Handles a segment starting in the last page of the previous one. That page
+ * gets the permissions of both segments, and this segment's part of it is
+ * read in right away, through a write permission held only meanwhile.
+ */
+static int elf_share_page(binpgm_t* pgm, memory_t* mm, elf32_phdr_t const* phdr)
+{
+    u32 page = phdr->p_vaddr & PAGE_MASK;
+    vm_area_t const* vma = vma_find(mm, page);
+
+    u32 prot = segment_prot(phdr);
+    if (vma->vm_flags & VM_READ) {
+        prot |= PROT_READ;
+    }
+    if (vma->vm_flags & VM_WRITE) {
+        prot |= PROT_WRITE;
+    }
+    if (vma->vm_flags & VM_EXEC) {
+        prot |= PROT_EXEC;
+    }
+
+    s32 retval = do_mprotect(mm, page, PAGE_SIZE, prot | PROT_WRITE);
+    if (retval < 0) {
+        return retval;
+    }
+
+    u32 end = min(phdr->p_vaddr + phdr->p_memsz, page + PAGE_SIZE);
+    u32 data_end = min(phdr->p_vaddr + phdr->p_filesz, end);
+
+    if (data_end > phdr->p_vaddr
+        && read_exec(
+               pgm->b_node, phdr->p_offset, (char*)phdr->p_vaddr,
+               data_end - phdr->p_vaddr
+           ) < 0) {
+        return -EIO;
+    }
+
+    memset((char*)data_end, 0, end - data_end);
+    return do_mprotect(mm, page, PAGE_SIZE, prot);
+}
+
+/*
+ * Sets up the areas of a PT_LOAD segment without reading anything: the file
+ * part becomes a private file mapping and the BSS an anonymous area, so
+ * both are faulted in on first touch.
+ */
+static int elf_map_segment(binpgm_t* pgm, memory_t* mm, elf32_phdr_t const* phdr)
+{
+    u32 flags = segment_vm_flags(phdr);
+    u32 start = phdr->p_vaddr & PAGE_MASK;
+    u32 offset = phdr->p_offset & PAGE_MASK;
+    u32 data_end = phdr->p_vaddr + phdr->p_filesz;
+    u32 file_end = ALIGN(data_end, PAGE_SIZE);
+    u32 end = ALIGN(phdr->p_vaddr + phdr->p_memsz, PAGE_SIZE);
+
+    vm_area_t const* prev = vma_find(mm, start);
+    if (prev && prev->vm_start <= start) {
+        int retval = elf_share_page(pgm, mm, phdr);
+        if (retval < 0) {
+            return retval;
+        }
+
+        start += PAGE_SIZE;
+        offset += PAGE_SIZE;
+        if (file_end < start) {
+            file_end = start;
+        }
+    }
+
+    if (start < file_end
+        && !vma_create(
+            mm, start, file_end, flags, VMA_FILE, pgm->b_node, offset
+        )) {
+        return -ENOMEM;
+    }
+
+    if (file_end < end
+        && !vma_create(mm, file_end, end, flags, VMA_ANON, NULL, 0)) {
+        return -ENOMEM;
+    }
+
+    /*
+     * The last file page holds whatever follows the segment in the file.
+     * Where that is BSS, clear it, which gives the process its own copy of
+     * just that page. A read-only segment is writable only meanwhile.
+     */
+    if (phdr->p_memsz > phdr->p_filesz && data_end > start
+        && (data_end & (PAGE_SIZE - 1))) {
+        u32 page = data_end & PAGE_MASK;
+        u32 zero_end = min(phdr->p_vaddr + phdr->p_memsz, file_end);
+        u32 prot = segment_prot(phdr);
+        s32 retval;
+
+        if (!(flags & VM_WRITE)) {
+            retval = do_mprotect(mm, page, PAGE_SIZE, prot | PROT_WRITE);
+            if (retval < 0) {
+                return retval;
+            }
+        }
+
+        memset((char*)data_end, 0, zero_end - data_end);
+
+        if (!(flags & VM_WRITE)) {
+            retval = do_mprotect(mm, page, PAGE_SIZE, prot);
+            if (retval < 0) {
+                return retval;
+            }
+        }
+    }
+
+    return 0;
+}
+
 int load_elf_binary(binpgm_t* pgm, trapframe_t* regs)
 {
     unsigned int bss_end = 0;
+    memory_t* mm = &myproc()->mm;
     elf32_hdr_t* elf = (elf32_hdr_t*)pgm->b_buf;
 
     if (memcmp(elf->e_ident, ELFMAG, SELFMAG) != 0) {
@@ -29,40 +207,46 @@ int load_elf_binary(binpgm_t* pgm, trapframe_t* regs)
         return -ENOEXEC;
     }
 
-    for (int i = 0; i < elf->e_phnum; i++) {
-        elf32_phdr_t* phdr = (elf32_phdr_t*)(pgm->b_buf + elf->e_phoff
-                                             + (i * sizeof(elf32_phdr_t)));
-        if (phdr->p_type != PT_LOAD) {
-            continue;
-        }
+    if (elf->e_phentsize != sizeof(elf32_phdr_t) || elf->e_phnum == 0
+        || elf->e_phnum > MAX_PHDRS) {
+        return -ENOEXEC;
+    }
 
-        u32 addr = phdr->p_vaddr & PAGE_MASK;
-        u32 end = ALIGN(phdr->p_vaddr + phdr->p_memsz, PAGE_SIZE);
+    /* The program headers need not fit in b_buf, read all of them */
+    int phsize = elf->e_phnum * sizeof(elf32_phdr_t);
+    elf32_phdr_t* phdrs = kmalloc(phsize);
+    if (!phdrs) {
+        return -ENOMEM;
+    }
 
-        for (; addr < end; addr += PAGE_SIZE) {
-            void* old_page = vmm_unmap_page((void*)addr);
-            if (old_page && buddy_manages((paddr_t)old_page)) {
-                buddy_dealloc((paddr_t)old_page, 0);
-            }
+    int retval = read_exec(pgm->b_node, elf->e_phoff, (char*)phdrs, phsize);
+    if (retval != phsize) {
+        retval = -ENOEXEC;
+        goto out;
+    }
 
-            if (vmm_map_page(NULL, (void*)addr, PTE_P | PTE_U | PTE_W) < 0) {
-                printk("Failed to map page at 0x%x\n", addr);
-                return -ENOMEM;
-            }
+    for (int i = 0; i < elf->e_phnum; i++) {
+        if (phdrs[i].p_type == PT_LOAD
+            && !segment_is_valid(pgm->b_node, &phdrs[i])) {
+            retval = -ENOEXEC;
+            goto out;
         }
+    }
 
-        if (phdr->p_filesz > 0) {
-            read_exec(
-                pgm->b_node, phdr->p_offset, (char*)phdr->p_vaddr,
-                phdr->p_filesz
-            );
+    retval = flush_old_exec();
+    if (retval < 0) {
+        goto out;
+    }
+
+    for (int i = 0; i < elf->e_phnum; i++) {
+        elf32_phdr_t* phdr = &phdrs[i];
+        if (phdr->p_type != PT_LOAD) {
+            continue;
         }
 
-        if (phdr->p_memsz > phdr->p_filesz) {
-            memset(
-                (char*)phdr->p_vaddr + phdr->p_filesz, 0,
-                phdr->p_memsz - phdr->p_filesz
-            );
+        retval = elf_map_segment(pgm, mm, phdr);
+        if (retval < 0) {
+            goto out;
         }
 
         unsigned int segment_end = phdr->p_vaddr + phdr->p_memsz;
@@ -71,31 +255,49 @@ int load_elf_binary(binpgm_t* pgm, trapframe_t* regs)
         }
     }
 
-    myproc()->mm.heap_start = ALIGN(bss_end, PAGE_SIZE);
-    myproc()->mm.current = myproc()->mm.heap_start;
-    myproc()->mm.heap_end = myproc()->mm.heap_start + MAX_HEAP_SIZE;
+    mm->heap_start = ALIGN(bss_end, PAGE_SIZE);
+    mm->current = mm->heap_start;
+    mm->heap_end = mm->heap_start + MAX_HEAP_SIZE;
 
-    myproc()->mm.stack_start = KERNBASE - (PAGE_SIZE * MAX_ARG_PAGES);
+    mm->stack_start = KERNBASE - (PAGE_SIZE * MAX_ARG_PAGES);
 
-    if (myproc()->mm.heap_end > myproc()->mm.stack_start) {
-        myproc()->mm.heap_end = myproc()->mm.stack_start;
+    if (mm->heap_end > mm->stack_start) {
+        mm->heap_end = mm->stack_start;
 
-        if (myproc()->mm.heap_end <= myproc()->mm.heap_start) {
+        if (mm->heap_end <= mm->heap_start) {
             printk("Error: No space for heap\n");
-            return -ENOMEM;
+            retval = -ENOMEM;
+            goto out;
         }
     }
 
+    /* The heap starts out empty and follows brk() */
+    if (!vma_create(
+            mm, mm->heap_start, mm->heap_start, VM_READ | VM_WRITE, VMA_HEAP,
+            NULL, 0
+        )) {
+        retval = -ENOMEM;
+        goto out;
+    }
+
+    if (!vma_create(
+            mm, mm->stack_start, KERNBASE, VM_READ | VM_WRITE | VM_GROWSDOWN,
+            VMA_STACK, NULL, 0
+        )) {
+        retval = -ENOMEM;
+        goto out;
+    }
+
     for (int i = 0; i < MAX_ARG_PAGES; i++) {
         if (pgm->b_page[i]) {
-            u32 vaddr = myproc()->mm.stack_start + (i * PAGE_SIZE);
+            u32 vaddr = mm->stack_start + (i * PAGE_SIZE);
             u32 paddr = V2P_WO(pgm->b_page[i]);
             vmm_remap_page((void*)vaddr, (void*)paddr, PTE_P | PTE_U | PTE_W);
             pgm->b_page[i] = 0;
         }
     }
 
-    u32 sp = myproc()->mm.stack_start + pgm->b_p;
+    u32 sp = mm->stack_start + pgm->b_p;
     char* str_ptr = (char*)sp;
     u32 argv_addrs[MAX_ARGS];
     int argc = pgm->argc;
@@ -108,7 +310,7 @@ int load_elf_binary(binpgm_t* pgm, trapframe_t* regs)
     int total_entries = 1 + argc + 1;
     int total_bytes = total_entries * 4;
 
-    sp = (myproc()->mm.stack_start + pgm->b_p - total_bytes) & ~0xF;
+    sp = (mm->stack_start + pgm->b_p - total_bytes) & ~0xF;
 
     u32* stack = (u32*)sp;
     stack[0] = argc;
@@ -123,5 +325,8 @@ int load_elf_binary(binpgm_t* pgm, trapframe_t* regs)
     regs->cs = USER_CS;
     regs->ss = regs->ds = regs->es = USER_DS;
 
-    return 0;
+    retval = 0;
+out:
+    kfree(phdrs);
+    return retval;
 }
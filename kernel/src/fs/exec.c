@@ -1,9 +1,14 @@
 #include "fs/exec.h"
+#include "arch/x86/io.h"
+#include "arch/x86/memlayout.h"
 #include "ferrite/types.h"
 #include "fs/vfs.h"
 #include "idt/idt.h"
 #include "memory/page.h"
+#include "memory/mmap.h"
+#include "memory/vmm.h"
 #include "sys/file/file.h"
+#include "sys/process/process.h"
 
 #include <ferrite/string.h>
 #include <lib/stdlib.h>
@@ -72,7 +77,7 @@ static unsigned long copy_strings(
 
 int read_exec(vfs_inode_t* node, int offset, char* addr, int count)
 {
-    if (count > PAGE_SIZE * 16 || (u32)offset > node->i_size) {
+    if (count < 0 || (u32)offset > node->i_size) {
         return -EINVAL;
     }
 
@@ -120,6 +125,35 @@ end_readexec:
 
 /* Public */
 
+/*
+ * Point of no return of execve(): drops the old image, including any frames
+ * that are still shared copy-on-write with the parent. A vfork() child gets a
+ * fresh page directory instead and hands the borrowed one back.
+ */
+int flush_old_exec(void)
+{
+    proc_t* p = myproc();
+
+    if (!p->vfork_parent) {
+        exit_mmap(&p->mm);
+        vmm_clear_pages();
+        return 0;
+    }
+
+    /* Keep the borrowed image until nothing can fail anymore */
+    void* pgdir = setup_kvm();
+    if (!pgdir) {
+        return -ENOMEM;
+    }
+
+    p->pgdir = pgdir;
+    lcr3(V2P_WO((u32)pgdir));
+
+    /* The areas go back to the parent with the page directory */
+    vfork_release(p);
+    return 0;
+}
+
 int do_execve(
     char const* filename,
     char const* const* argv,
@@ -41,6 +41,8 @@ typedef struct binfmt {
 /* exec.c */
 int read_exec(vfs_inode_t*, int, char*, int);
 
+int flush_old_exec(void);
+
 int do_execve(char const*, char const* const*, char const* const*, trapframe_t*);
 
 /* binfmt_elf.c */
@@ -2,11 +2,40 @@
 #include "drivers/printk.h"
 #include "fs/ext2/ext2.h"
 #include "fs/vfs.h"
+#include "memory/kmalloc.h"
 
 #include <uapi/errno.h>
 #include <ferrite/string.h>
 #include <stdbool.h>
 
+/* Private */
+
+/*
+ * Returns entry `index` of the block number table stored in block `table`,
+ * or 0 if there is no such table.
+ */
+static u32 ext2_table_entry(vfs_inode_t const* node, u32 table, u32 index)
+{
+    if (!table) {
+        return 0;
+    }
+
+    u32* entries = kmalloc(node->i_sb->s_blocksize);
+    if (!entries) {
+        return 0;
+    }
+
+    u32 block = 0;
+    if (ext2_read_block(node, (u8*)entries, table) >= 0) {
+        block = entries[index];
+    }
+
+    kfree(entries);
+    return block;
+}
+
+/* Public */
+
 s32 ext2_read_block(vfs_inode_t const* node, u8* buff, u32 block_num)
 {
     block_device_t* d = get_device(node->i_sb->s_dev);
@@ -51,3 +80,35 @@ s32 ext2_write_block(
 
     return d->d_op->write(d, sector_pos, count, tmp, sb->s_blocksize);
 }
+
+/*
+ * Translates the `index`-th block of a file into a block number on disk,
+ * following the single and double indirect blocks. Returns 0 for holes and
+ * for blocks beyond what the double indirect block can address.
+ */
+u32 ext2_bmap(vfs_inode_t const* node, u32 index)
+{
+    ext2_inode_t const* ext2_node = node->u.i_ext2;
+    u32 per_block = node->i_sb->s_blocksize / sizeof(u32);
+
+    if (index < EXT2_NDIR_BLOCKS) {
+        return ext2_node->i_block[index];
+    }
+
+    index -= EXT2_NDIR_BLOCKS;
+    if (index < per_block) {
+        return ext2_table_entry(
+            node, ext2_node->i_block[EXT2_IND_BLOCK], index
+        );
+    }
+
+    index -= per_block;
+    if (index < per_block * per_block) {
+        u32 table = ext2_table_entry(
+            node, ext2_node->i_block[EXT2_DIND_BLOCK], index / per_block
+        );
+        return ext2_table_entry(node, table, index % per_block);
+    }
+
+    return 0;
+}
@@ -5,6 +5,7 @@
 #include <uapi/stat.h>
 #include "fs/vfs.h"
 #include "lib/math.h"
+#include "memory/filemap.h"
 #include "memory/kmalloc.h"
 #include "sys/file/file.h"
 #include "sys/process/process.h"
@@ -417,6 +418,7 @@ repeat:
 
     if (current->i_links_count == 0) {
         current->u.i_ext2->i_dtime = now;
+        filemap_invalidate(current);
 
         for (int i = 0; i < 12 && current->u.i_ext2->i_block[i]; i++) {
             ext2_free_block(current, current->u.i_ext2->i_block[i]);
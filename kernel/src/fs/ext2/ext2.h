@@ -10,6 +10,11 @@ struct vfs_dentry;
 #define EXT2_MAGIC 0xEF53
 #define EXT2_ROOT_INO 2
 
+/* Layout of i_block[] */
+#define EXT2_NDIR_BLOCKS 12
+#define EXT2_IND_BLOCK 12
+#define EXT2_DIND_BLOCK 13
+
 #define FIFO 0x1000
 #define CHARACTER_DEVICE 0x2000
 #define DIRECTORY 0x4000
@@ -163,6 +168,8 @@ s32 ext2_read_block(vfs_inode_t const*, u8*, u32);
 
 s32 ext2_write_block(vfs_inode_t*, u32, void const*, u32, u32);
 
+u32 ext2_bmap(vfs_inode_t const*, u32);
+
 /* ialloc.c */
 
 vfs_inode_t* ext2_new_inode(vfs_inode_t const* dir, int mode, int* err);
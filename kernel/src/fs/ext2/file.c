@@ -65,17 +65,22 @@ int ext2_file_read(vfs_inode_t* node, file_t* file, void* buff, s32 count)
 
     while (bytes_copied < count && offset < ext2_node->i_size) {
         u32 i = offset / sb->s_blocksize;
-        if (i >= 12) {
-            break;
-        }
-
         u32 offset_in_block = offset % sb->s_blocksize;
         s32 bytes_in_this_block = (s32)sb->s_blocksize - offset_in_block;
         s32 bytes_remaining = (s32)ext2_node->i_size - offset;
         s32 bytes_to_copy = min(bytes_in_this_block, count - bytes_copied);
         bytes_to_copy = min(bytes_to_copy, bytes_remaining);
 
-        u32 addr = ext2_node->i_block[i] * sb->s_blocksize;
+        u32 block = ext2_bmap(node, i);
+        if (!block) {
+            /* A hole reads as zeros */
+            memset((u8*)buff + bytes_copied, 0, bytes_to_copy);
+            bytes_copied += bytes_to_copy;
+            offset += bytes_to_copy;
+            continue;
+        }
+
+        u32 addr = block * sb->s_blocksize;
         u32 sector_pos = addr / d->d_sector_size;
 
         if (d->d_op->read(
@@ -131,14 +136,16 @@ int ext2_file_write(
     u32 end_block = (offset + count - 1) / sb->s_blocksize;
 
     for (u32 i = start_block; i <= end_block; i += 1) {
-        if (i >= 12) {
-            return bytes_written > 0 ? (s32)bytes_written : -EFBIG;
-        }
-
         s32 block_num;
         s32 err = 0;
 
-        if (node->i_block[i] == 0) {
+        /* Blocks behind an indirect block can be rewritten, not allocated */
+        if (i >= EXT2_NDIR_BLOCKS) {
+            block_num = (s32)ext2_bmap(dir, i);
+            if (!block_num) {
+                return bytes_written > 0 ? (s32)bytes_written : -EFBIG;
+            }
+        } else if (node->i_block[i] == 0) {
             block_num = ext2_new_block(dir, &err);
             if (err) {
                 return err;
@@ -3,6 +3,7 @@
 #include <uapi/stat.h>
 #include "fs/vfs.h"
 #include "lib/math.h"
+#include "memory/filemap.h"
 
 #include <uapi/errno.h>
 #include <types.h>
@@ -16,6 +17,8 @@ int ext2_truncate(vfs_inode_t* node, off_t len)
     ext2_inode_t* ext2_node = node->u.i_ext2;
     vfs_superblock_t* sb = node->i_sb;
 
+    filemap_invalidate(node);
+
     if (len > (long)node->i_size) {
         time_t now = getepoch();
         node->i_size = len;
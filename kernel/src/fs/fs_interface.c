@@ -2,6 +2,7 @@
 #include "fs/mount.h"
 #include "fs/vfs.h"
 #include "idt/syscalls.h"
+#include "memory/filemap.h"
 #include "memory/kmalloc.h"
 #include "sys/process/process.h"
 #include <uapi/fcntl.h>
@@ -54,7 +55,15 @@ SYSCALL_ATTR int sys_write(int fd, void* buf, int count)
     }
 
     if (f->f_op && f->f_op->write) {
-        return f->f_op->write(f->f_inode, f, buf, count);
+        off_t pos = f->f_pos;
+        int ret = f->f_op->write(f->f_inode, f, buf, count);
+
+        /* Write through the page cache, mappings of the file stay coherent */
+        if (ret > 0 && S_ISREG(f->f_inode->i_mode)) {
+            filemap_update(f->f_inode, (u32)pos, buf, (u32)ret);
+        }
+
+        return ret;
     }
 
     return -1;
@@ -18,14 +18,43 @@ vfs_mount_t* mount_table = NULL;
 
 /* Private */
 
-typedef struct {
-    int valid;
-    dev_t dev;
-    char drive_letter;
-    int partition;
-} parsed_device_t;
-
-static parsed_device_t parse_device_path(char const* device)
+vfs_mount_t* find_mount_by_inode(vfs_inode_t* mounted_root)
+{
+    vfs_mount_t* tmp = mount_table;
+    while (tmp) {
+        vfs_inode_t* mountpoint = vfs_lookup(tmp->m_name);
+        if (mountpoint) {
+            if (mountpoint->i_mount
+                && mountpoint->i_mount->i_sb == mounted_root->i_sb
+                && mountpoint->i_mount->i_ino == mounted_root->i_ino) {
+                inode_put(mountpoint);
+                return tmp;
+            }
+            inode_put(mountpoint);
+        }
+        tmp = tmp->next;
+    }
+    return NULL;
+}
+
+vfs_mount_t* find_mount_by_path(char const* path)
+{
+    vfs_mount_t* tmp = mount_table;
+
+    while (tmp) {
+        if (strcmp(tmp->m_name, path) == 0) {
+            return tmp;
+        }
+
+        tmp = tmp->next;
+    }
+
+    return NULL;
+}
+
+/* Public */
+
+parsed_device_t parse_device_path(char const* device)
 {
     parsed_device_t result = { .valid = 0 };
 
@@ -35,6 +64,18 @@ static parsed_device_t parse_device_path(char const* device)
     }
 
     char const* type_device = device + 5;
+    if (strncmp(type_device, "zram", 4) == 0) {
+        char minor = type_device[4];
+        if (minor < '0' || minor > '9' || type_device[5] != '\0') {
+            printk("Invalid zram device. Expected /dev/zramN\n");
+            return result;
+        }
+
+        result.valid = 1;
+        result.dev = MKDEV(RAMDISK_MAJOR, minor - '0');
+        return result;
+    }
+
     if (strncmp(type_device, "hd", 2) != 0) {
         printk("Unsupported device type. Expected 'hd'\n");
         return result;
@@ -83,42 +124,6 @@ static parsed_device_t parse_device_path(char const* device)
     return result;
 }
 
-vfs_mount_t* find_mount_by_inode(vfs_inode_t* mounted_root)
-{
-    vfs_mount_t* tmp = mount_table;
-    while (tmp) {
-        vfs_inode_t* mountpoint = vfs_lookup(tmp->m_name);
-        if (mountpoint) {
-            if (mountpoint->i_mount
-                && mountpoint->i_mount->i_sb == mounted_root->i_sb
-                && mountpoint->i_mount->i_ino == mounted_root->i_ino) {
-                inode_put(mountpoint);
-                return tmp;
-            }
-            inode_put(mountpoint);
-        }
-        tmp = tmp->next;
-    }
-    return NULL;
-}
-
-vfs_mount_t* find_mount_by_path(char const* path)
-{
-    vfs_mount_t* tmp = mount_table;
-
-    while (tmp) {
-        if (strcmp(tmp->m_name, path) == 0) {
-            return tmp;
-        }
-
-        tmp = tmp->next;
-    }
-
-    return NULL;
-}
-
-/* Public */
-
 int vfs_mount(
     char const* device,
     char const* dir_name,
@@ -19,6 +19,19 @@ typedef struct vfs_mount {
     struct vfs_mount* next;
 } vfs_mount_t;
 
+typedef struct {
+    int valid;
+    dev_t dev;
+    char drive_letter;
+    int partition;
+} parsed_device_t;
+
+/**
+ * Parses a device path of the form /dev/hdX[Y] or /dev/zramN. `valid` is 0
+ * if the path is malformed, the reason has been printed already.
+ */
+parsed_device_t parse_device_path(char const* device);
+
 vfs_mount_t* find_mount_by_inode(vfs_inode_t* mounted_root);
 
 vfs_mount_t* find_mount_by_path(char const* path);
@@ -14,12 +14,12 @@ struct ext2_block_group_descriptor;
 #define MAY_WRITE 2
 #define MAY_READ 4
 
-#define MS_RDONLY 1   /* mount read-only */
-#define MS_NOSUID 2   /* ignore suid and sgid bits */
-#define MS_NODEV 4    /* disallow access to device special files */
-#define MS_NOEXEC 8   /* disallow program execution */
-#define MS_SYNC 16    /* writes are synced at once */
-#define MS_REMOUNT 32 /* alter flags of a mounted FS */
+#define MS_RDONLY 1       /* mount read-only */
+#define MS_NOSUID 2       /* ignore suid and sgid bits */
+#define MS_NODEV 4        /* disallow access to device special files */
+#define MS_NOEXEC 8       /* disallow program execution */
+#define MS_SYNCHRONOUS 16 /* writes are synced at once */
+#define MS_REMOUNT 32     /* alter flags of a mounted FS */
 
 #define IS_RDONLY(inode) \
     (((inode)->i_sb) && ((inode)->i_sb->s_flags & MS_RDONLY))
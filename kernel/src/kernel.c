@@ -1,3 +1,4 @@
+#include "arch/x86/cpu.h"
 #include "arch/x86/gdt/gdt.h"
 #include "arch/x86/idt/idt.h"
 #include "arch/x86/io.h"
@@ -5,21 +6,51 @@
 #include "arch/x86/pit.h"
 #include "arch/x86/time/rtc.h"
 #include "drivers/block/ide.h"
+#include "drivers/block/zram.h"
 #include "drivers/vga.h"
 #include "fs/mount.h"
 #include "fs/vfs.h"
 #include "memory/buddy_allocator/buddy.h"
+#include "memory/filemap.h"
+#include "memory/kmalloc.h"
 #include "memory/memblock.h"
 #include "memory/pmm.h"
+#include "memory/swap.h"
+#include "memory/vma.h"
 #include "memory/vmalloc.h"
 #include "memory/vmm.h"
+#include "memory/vmscan.h"
 #include "sys/process/process.h"
 
 #include <drivers/serial.h>
+#include <ferrite/string.h>
 #include <types.h>
 #include <lib/stdlib.h>
 
 extern void test_printk_formatting(void);
+extern void test_buddy_allocator(void);
+extern void test_fork_cow(void);
+extern void test_vmm_range(void);
+extern void test_vmm_tlb(void);
+extern void test_vma(void);
+extern void test_vmalloc(void);
+extern void test_kmemtrace(void);
+extern void test_meminfo(void);
+extern void test_highmem(void);
+extern void test_swap(void);
+extern void test_zram(void);
+extern void test_sched(void);
+extern void test_pid(void);
+
+/*
+ * The self-tests write to the swap and zram devices and take over the run
+ * queue for a while, so only test builds (-D__TEST) run them at boot.
+ */
+#ifdef __TEST
+#    define RUN_TEST(test) test()
+#else
+#    define RUN_TEST(test) ((void)0)
+#endif
 
 __attribute__((noreturn)) void kmain(u32 magic, multiboot_info_t* mbd)
 {
@@ -40,19 +71,56 @@ __attribute__((noreturn)) void kmain(u32 magic, multiboot_info_t* mbd)
     vga_init();
     rtc_init();
     serial_init();
+    cpu_init();
+
+    /* "nopae" keeps the two-level page tables on CPUs with PAE as well */
+    char const* cmdline = (char const*)mbd->cmdline;
+    if (strnstr(cmdline, "nopae", strlen(cmdline))) {
+        boot_cpu.features &= ~X86_FEATURE_PAE;
+    }
+
+    /* "nopse nopge" build the direct map from 4 KB, non-global pages */
+    if (strnstr(cmdline, "nopse", strlen(cmdline))) {
+        boot_cpu.features &= ~X86_FEATURE_PSE;
+    }
+
+    if (strnstr(cmdline, "nopge", strlen(cmdline))) {
+        boot_cpu.features &= ~X86_FEATURE_PGE;
+    }
 
     test_printk_formatting();
 
     pmm_init_from_map(mbd);
-    memblock_init();
+    memblock_init(mbd);
 
     vmm_init_pages();
     buddy_init();
     memblock_deactivate();
+    RUN_TEST(test_buddy_allocator);
+    RUN_TEST(test_fork_cow);
+    RUN_TEST(test_vmm_range);
+    RUN_TEST(test_vmm_tlb);
+    kmalloc_init();
+    vma_init();
+    filemap_init();
+    vmscan_init();
+    proc_init();
+    RUN_TEST(test_vma);
     vmalloc_init();
+    RUN_TEST(test_vmalloc);
+    RUN_TEST(test_kmemtrace);
+    RUN_TEST(test_meminfo);
+    RUN_TEST(test_highmem);
 
     ide_init();
     // FUTURE: Will add other type of devices
+    zram_init(cmdline);
+    RUN_TEST(test_zram);
+
+    swap_init(cmdline);
+    RUN_TEST(test_swap);
+    RUN_TEST(test_sched);
+    RUN_TEST(test_pid);
 
     mount_root_device((char*)mbd->cmdline);
     vfs_init();
@@ -0,0 +1,232 @@
+#include "lib/lz4.h"
+
+#include <ferrite/string.h>
+#include <types.h>
+
+#define LZ4_HASH_BITS 12
+#define LZ4_MIN_MATCH 4
+#define LZ4_MFLIMIT 12      // No match may start in the last 12 bytes
+#define LZ4_LAST_LITERALS 5 // and the last 5 bytes are always literals
+#define LZ4_RUN_MASK 15
+
+/* Positions of the last occurrence of each hashed 4-byte sequence */
+static u16 lz4_hash_table[1 << LZ4_HASH_BITS];
+
+/* Private */
+
+static inline u32 read32(u8 const* p)
+{
+    u32 val;
+
+    memcpy(&val, p, sizeof(u32));
+    return val;
+}
+
+static inline u32 lz4_hash(u32 seq)
+{
+    return (seq * 2654435761U) >> (32 - LZ4_HASH_BITS);
+}
+
+/* Writes a length of 15 or more as a run of 255s and a remainder */
+static u8* write_length(u8* op, u8 const* op_end, u32 len)
+{
+    for (; len >= 255; len -= 255) {
+        if (op >= op_end) {
+            return NULL;
+        }
+        *op++ = 255;
+    }
+
+    if (op >= op_end) {
+        return NULL;
+    }
+    *op++ = (u8)len;
+
+    return op;
+}
+
+/*
+ * Emits one sequence: `lit_len` literals, then a match of `match_len` bytes
+ * `offset` back. A match length of 0 ends the block.
+ */
+static u8* emit_sequence(
+    u8* op,
+    u8 const* op_end,
+    u8 const* lit,
+    u32 lit_len,
+    u32 offset,
+    u32 match_len
+)
+{
+    if (op >= op_end) {
+        return NULL;
+    }
+
+    u8* token = op++;
+    u32 ml = match_len ? match_len - LZ4_MIN_MATCH : 0;
+
+    *token = (u8)((lit_len < LZ4_RUN_MASK ? lit_len : LZ4_RUN_MASK) << 4);
+    if (lit_len >= LZ4_RUN_MASK) {
+        op = write_length(op, op_end, lit_len - LZ4_RUN_MASK);
+        if (!op) {
+            return NULL;
+        }
+    }
+
+    if ((u32)(op_end - op) < lit_len) {
+        return NULL;
+    }
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+
+    if (!match_len) {
+        return op;
+    }
+
+    if (op_end - op < 2) {
+        return NULL;
+    }
+    *op++ = (u8)offset;
+    *op++ = (u8)(offset >> 8);
+
+    *token |= (u8)(ml < LZ4_RUN_MASK ? ml : LZ4_RUN_MASK);
+    if (ml >= LZ4_RUN_MASK) {
+        op = write_length(op, op_end, ml - LZ4_RUN_MASK);
+    }
+
+    return op;
+}
+
+/* Reads the extra bytes of a length that started out as 15 */
+static s32 read_length(u8 const** ip, u8 const* ip_end, u32* len)
+{
+    u8 byte;
+
+    do {
+        if (*ip >= ip_end) {
+            return -1;
+        }
+
+        byte = *(*ip)++;
+        *len += byte;
+    } while (byte == 255);
+
+    return 0;
+}
+
+/* Public */
+
+s32 lz4_compress(void const* src, u32 src_len, void* dst, u32 dst_cap)
+{
+    u8 const* in = src;
+    u8* op = dst;
+    u8 const* op_end = op + dst_cap;
+    u32 anchor = 0;
+
+    if (src_len > LZ4_MAX_INPUT) {
+        return -1;
+    }
+
+    memset(lz4_hash_table, 0, sizeof(lz4_hash_table));
+
+    u32 pos = 0;
+    while (src_len >= LZ4_MFLIMIT && pos <= src_len - LZ4_MFLIMIT) {
+        u32 seq = read32(in + pos);
+        u32 hash = lz4_hash(seq);
+        u32 ref = lz4_hash_table[hash];
+
+        lz4_hash_table[hash] = (u16)pos;
+        if (ref >= pos || read32(in + ref) != seq) {
+            pos += 1;
+            continue;
+        }
+
+        u32 len = LZ4_MIN_MATCH;
+        u32 max = src_len - LZ4_LAST_LITERALS - pos;
+        while (len < max && in[ref + len] == in[pos + len]) {
+            len += 1;
+        }
+
+        /* Whatever matches in front of it is cheaper as match than literal */
+        while (pos > anchor && ref > 0 && in[pos - 1] == in[ref - 1]) {
+            pos -= 1;
+            ref -= 1;
+            len += 1;
+        }
+
+        op = emit_sequence(
+            op, op_end, in + anchor, pos - anchor, pos - ref, len
+        );
+        if (!op) {
+            return -1;
+        }
+
+        pos += len;
+        anchor = pos;
+    }
+
+    op = emit_sequence(op, op_end, in + anchor, src_len - anchor, 0, 0);
+    if (!op) {
+        return -1;
+    }
+
+    return (s32)(op - (u8*)dst);
+}
+
+s32 lz4_decompress(void const* src, u32 src_len, void* dst, u32 dst_cap)
+{
+    u8 const* ip = src;
+    u8 const* ip_end = ip + src_len;
+    u8* op = dst;
+    u8 const* op_end = op + dst_cap;
+
+    while (ip < ip_end) {
+        u8 token = *ip++;
+
+        u32 lit_len = token >> 4;
+        if (lit_len == LZ4_RUN_MASK && read_length(&ip, ip_end, &lit_len) < 0) {
+            return -1;
+        }
+
+        if ((u32)(ip_end - ip) < lit_len || (u32)(op_end - op) < lit_len) {
+            return -1;
+        }
+        memcpy(op, ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+
+        /* The last sequence has no match */
+        if (ip == ip_end) {
+            break;
+        }
+
+        if (ip_end - ip < 2) {
+            return -1;
+        }
+        u32 offset = ip[0] | ((u32)ip[1] << 8);
+        ip += 2;
+
+        if (offset == 0 || offset > (u32)(op - (u8*)dst)) {
+            return -1;
+        }
+
+        u32 match_len = token & LZ4_RUN_MASK;
+        if (match_len == LZ4_RUN_MASK
+            && read_length(&ip, ip_end, &match_len) < 0) {
+            return -1;
+        }
+
+        match_len += LZ4_MIN_MATCH;
+        if ((u32)(op_end - op) < match_len) {
+            return -1;
+        }
+
+        /* Byte by byte, the match may overlap what it is producing */
+        u8 const* match = op - offset;
+        for (u32 i = 0; i < match_len; i += 1) {
+            *op++ = *match++;
+        }
+    }
+
+    return (s32)(op - (u8*)dst);
+}
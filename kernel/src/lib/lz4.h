@@ -0,0 +1,28 @@
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <types.h>
+
+/* Largest input lz4_compress() takes, match offsets are 16 bits */
+#define LZ4_MAX_INPUT 0xFFFF
+
+/**
+ * Compresses `src_len` bytes into the LZ4 block format. Fast rather than
+ * tight: one hash probe per position, no lazy matching. Not reentrant, the
+ * hash table is static to keep it off the kernel stack.
+ *
+ * @return The compressed size, or -1 if it would not fit into `dst_cap`
+ *         bytes or the input is too large.
+ */
+s32 lz4_compress(void const* src, u32 src_len, void* dst, u32 dst_cap);
+
+/**
+ * Decompresses an LZ4 block. Corrupt input never reads or writes outside
+ * the two buffers.
+ *
+ * @return The decompressed size, or -1 if the block is corrupt or does not
+ *         fit into `dst_cap` bytes.
+ */
+s32 lz4_decompress(void const* src, u32 src_len, void* dst, u32 dst_cap);
+
+#endif /* LZ4_H */
@@ -13,6 +13,7 @@
 #define PAGE_MASK (~(PAGE_SIZE - 1))
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
 
 /**
  * @brief  Calculates the base-2 logarithm of n, rounded down (floor).
@@ -35,6 +36,10 @@ static inline u32 ceil_log2(u32 n)
         __builtin_trap();
     }
 
+    if (n == 1) {
+        return 0;
+    }
+
     return (sizeof(u32) * 8) - __builtin_clz(n - 1);
 }
 
@@ -5,6 +5,7 @@
 #include "lib/math.h"
 #include "memory/consts.h"
 #include "memory/memblock.h"
+#include "memory/page.h"
 #include "memory/vmm.h"
 
 #include <ferrite/string.h>
@@ -12,285 +13,416 @@
 #include <stdbool.h>
 #include <types.h>
 
-static buddy_allocator_t g_buddy = { 0 };
+static buddy_allocator_t zones[BUDDY_NR_ZONES] = { 0 };
+
+static char const* const zone_names[BUDDY_NR_ZONES] = { "Normal", "HighMem" };
 
 /* Private */
 
-static int buddy_get_bit(int bit_index)
+static inline u32 block_index(buddy_allocator_t const* z, u32 pfn, u32 order)
+{
+    return (pfn - z->start_pfn) >> order;
+}
+
+static inline bool buddy_test_bit(buddy_allocator_t const* z, u32 order, u32 i)
+{
+    return (z->map[order][i / 8] >> (i % 8)) & 1;
+}
+
+static inline void buddy_set_bit(buddy_allocator_t* z, u32 order, u32 i)
+{
+    z->map[order][i / 8] |= (1 << (i % 8));
+}
+
+static inline void buddy_clear_bit(buddy_allocator_t* z, u32 order, u32 i)
+{
+    z->map[order][i / 8] &= ~(1 << (i % 8));
+}
+
+static inline buddy_node_t* buddy_node(buddy_allocator_t const* z, u32 pfn)
+{
+    if (z->nodes) {
+        return &z->nodes[pfn - z->start_pfn];
+    }
+
+    return (buddy_node_t*)P2V_WO(pfn << PAGE_SHIFT);
+}
+
+static inline u32 buddy_node_pfn(buddy_allocator_t const* z, buddy_node_t* node)
+{
+    if (z->nodes) {
+        return z->start_pfn + (u32)(node - z->nodes);
+    }
+
+    return V2P_WO((u32)node) >> PAGE_SHIFT;
+}
+
+static buddy_allocator_t* buddy_zone(u32 pfn)
 {
-    u32 byte_index = bit_index / 8;
-    u32 bit_in_byte = bit_index % 8;
+    for (u32 i = 0; i < BUDDY_NR_ZONES; i += 1) {
+        buddy_allocator_t* z = &zones[i];
 
-    if (byte_index >= g_buddy.map_size) {
-        return 1;
+        if (pfn >= z->start_pfn && pfn - z->start_pfn < z->pages) {
+            return z;
+        }
     }
 
-    return (g_buddy.map[byte_index] & (1 << bit_in_byte)) ? 1 : 0;
+    return NULL;
 }
 
 void buddy_visualize(void)
 {
     printk("\n--- Buddy Allocator Visualization ---\n");
-    printk(
-        "  Base Address: %p | Total Size: %u KB | Max Order: %u\n",
-        (void*)g_buddy.base, g_buddy.size / 1024, g_buddy.max_order
-    );
-    printk("-------------------------------------\n");
-
-    printk("  Free Lists by Order:\n");
-    for (int i = 0; i <= g_buddy.max_order; i++) {
-        buddy_node_t* node = g_buddy.free_lists[i];
-        int free_block_count = 0;
-        while (node) {
-            free_block_count++;
-            node = node->next;
+    for (u32 i = 0; i < BUDDY_NR_ZONES; i += 1) {
+        buddy_allocator_t const* z = &zones[i];
+        if (z->pages == 0) {
+            continue;
         }
-        int pages_per_block = 1 << i;
+
         printk(
-            "    Order %d (%d pages): %d free blocks\n", i, pages_per_block,
-            free_block_count
+            "  Zone %s: 0x%x | Total Size: %u KB | Max Order: %u\n",
+            zone_names[i], z->start_pfn << PAGE_SHIFT,
+            z->pages * (PAGE_SIZE / 1024), z->max_order
         );
+
+        printk("  Free Lists by Order:\n");
+        for (int k = 0; k <= z->max_order; k++) {
+            int pages_per_block = 1 << k;
+            printk(
+                "    Order %d (%d pages): %u free blocks\n", k,
+                pages_per_block, z->free_count[k]
+            );
+        }
+        printk("-------------------------------------\n");
     }
-    printk("-------------------------------------\n");
 
-    printk("  Allocation Bitmap ('X' = allocated, '.' = free):\n");
-    size_t total_pages = g_buddy.size / PAGE_SIZE;
-    int bits_per_line = 32;
+    mem_map_dump();
+    printk("-------------------------------------\n");
+}
 
-    for (size_t i = 0; i < total_pages; i++) {
-        if (i % bits_per_line == 0) {
-            if (i > 0) {
-                printk("\n");
-            }
-            printk("    [%d-%d] ", i, i + bits_per_line - 1);
-        }
+static inline void buddy_list_add(buddy_allocator_t* z, u32 pfn, u32 k)
+{
+    buddy_node_t* node = buddy_node(z, pfn);
+    buddy_node_t* head = z->free_lists[k];
 
-        printk("%c", buddy_get_bit(i) ? 'X' : '.');
+    node->prev = NULL;
+    node->next = head;
+    if (head) {
+        head->prev = node;
     }
+    z->free_lists[k] = node;
+
+    page_t* page = pfn_to_page(pfn);
+    page->count = 0;
+    page->order = k;
+    page->flags = PG_buddy;
 
-    printk("\n-------------------------------------\n");
+    z->free_count[k] += 1;
+    buddy_set_bit(z, k, block_index(z, pfn, k));
 }
 
-static bool is_block_free(u32 i, u32 order)
+static inline void buddy_list_del(buddy_allocator_t* z, u32 pfn, u32 k)
 {
-    u32 blocks_to_check = 1 << order;
+    buddy_node_t* node = buddy_node(z, pfn);
 
-    for (u32 j = 0; j < blocks_to_check; j++) {
-        u32 current_page_index = i + j;
-        u32 byte_index = current_page_index / 8;
-        u32 bit_in_byte = current_page_index % 8;
-
-        if (byte_index >= g_buddy.map_size) {
-            return false;
-        }
+    if (node->prev) {
+        node->prev->next = node->next;
+    } else {
+        z->free_lists[k] = node->next;
+    }
 
-        if ((g_buddy.map[byte_index] & (1 << bit_in_byte)) != 0) {
-            return false;
-        }
+    if (node->next) {
+        node->next->prev = node->prev;
     }
 
-    return true;
+    pfn_to_page(pfn)->flags &= ~PG_buddy;
+
+    z->free_count[k] -= 1;
+    buddy_clear_bit(z, k, block_index(z, pfn, k));
 }
 
-static bool remove_from_free_list(vaddr_t vaddr, u32 order)
+/*
+ * Puts the frames [start, end) of zone `z` on its free lists as the largest
+ * naturally aligned blocks that fit.
+ */
+static void buddy_seed_range(buddy_allocator_t* z, u32 start, u32 end)
 {
-    if (order > g_buddy.max_order) {
-        abort("Invalid order provided to remove_from_free_list");
+    if (start >= end) {
+        return;
     }
 
-    buddy_node_t* target = (buddy_node_t*)vaddr;
-    buddy_node_t* head = g_buddy.free_lists[order];
-
-    if (head == target) {
-        g_buddy.free_lists[order] = head->next;
-        return true;
+    for (u32 pfn = start; pfn < end; pfn += 1) {
+        pfn_to_page(pfn)->flags = 0;
     }
 
-    buddy_node_t* prev = head;
-    buddy_node_t* current = head->next;
+    while (start < end) {
+        u32 index = start - z->start_pfn;
+        u32 order = z->max_order;
 
-    while (current) {
-        if (current == target) {
-            prev->next = current->next;
-            return true;
+        while (order > 0
+               && ((index & ((1 << order) - 1))
+                   || (1u << order) > end - start)) {
+            order -= 1;
         }
-        prev = current;
-        current = current->next;
-    }
 
-    return false;
+        buddy_list_add(z, start, order);
+        start += 1 << order;
+    }
 }
 
-static void mark_free(vaddr_t vaddr, u32 order)
+/*
+ * Sets up zone `z` over the frames [start_pfn, end_pfn). Its bitmaps, and
+ * for highmem its free list nodes, come from memblock.
+ */
+static void
+buddy_zone_init(buddy_allocator_t* z, u32 start_pfn, u32 end_pfn, bool mapped)
 {
-    u32 i = (vaddr - g_buddy.base) / PAGE_SIZE;
-    u32 blocks_to_mark = 1 << order;
+    z->start_pfn = start_pfn;
+    z->pages = end_pfn - start_pfn;
+    z->max_order = floor_log2(z->pages);
+    if (z->max_order > MAX_ORDER) {
+        z->max_order = MAX_ORDER;
+    }
 
-    for (u32 j = 0; j < blocks_to_mark; j++) {
-        u32 current = i + j;
-        u32 byte_index = current / 8;
-        u32 bit_index = current % 8;
+    /* One bit per block for every order: ~2 bits per page in total */
+    size_t map_size_needed = 0;
+    for (u32 k = 0; k <= z->max_order; k++) {
+        map_size_needed += ALIGN(CEIL_DIV((z->pages >> k), 8), sizeof(size_t));
+    }
+    z->map_size = map_size_needed;
 
-        if (byte_index >= g_buddy.map_size) {
-            abort("Deallocation address out of map bounds!");
-        }
+    paddr_t map_ptr = (paddr_t)memblock(z->map_size);
+    if (!map_ptr) {
+        abort("Could not allocate the bitmap for Buddy Allocator");
+    }
+    u8* map = (u8*)P2V_WO(map_ptr);
+    memset(map, 0, z->map_size);
 
-        g_buddy.map[byte_index] &= ~(1 << bit_index);
+    for (u32 k = 0; k <= z->max_order; k++) {
+        z->map[k] = map;
+        map += ALIGN(CEIL_DIV((z->pages >> k), 8), sizeof(size_t));
+    }
+
+    if (!mapped) {
+        paddr_t nodes = (paddr_t)memblock(z->pages * sizeof(buddy_node_t));
+        if (!nodes) {
+            abort("Could not allocate the highmem free list nodes");
+        }
+        z->nodes = (buddy_node_t*)P2V_WO(nodes);
     }
 }
 
-static void mark_allocated(vaddr_t vaddr, u32 order)
+/* Public */
+
+int buddy_manages(paddr_t addr)
 {
-    u32 i = (vaddr - g_buddy.base) / PAGE_SIZE;
-    u32 blocks_to_mark = 1 << order;
+    return buddy_manages_pfn(addr >> PAGE_SHIFT);
+}
 
-    for (u32 j = 0; j < blocks_to_mark; j++) {
-        u32 current = i + j;
-        u32 byte_index = current / 8;
-        u32 bit_in_byte = current % 8;
+int buddy_manages_pfn(u32 pfn) { return buddy_zone(pfn) != NULL; }
 
-        if (byte_index >= g_buddy.map_size) {
-            abort("Allocation address out of map bounds!");
-        }
+u32 buddy_get_max_order(void) { return zones[BUDDY_ZONE_NORMAL].max_order; }
+
+size_t buddy_get_total_memory(void)
+{
+    size_t pages = 0;
 
-        g_buddy.map[byte_index] |= (1 << bit_in_byte);
+    for (u32 i = 0; i < BUDDY_NR_ZONES; i += 1) {
+        pages += zones[i].pages;
     }
+
+    /* Only PAE reaches past 4 GB, which no longer fits */
+    if (pages >= (1u << (32 - PAGE_SHIFT))) {
+        return (size_t)-1 & PAGE_MASK;
+    }
+
+    return pages * PAGE_SIZE;
 }
 
-static inline void buddy_list_add(vaddr_t vaddr, u32 k)
+size_t buddy_get_zone_pages(u32 zone) { return zones[zone].pages; }
+
+size_t buddy_get_zone_free_pages(u32 zone)
 {
-    buddy_node_t* node = (buddy_node_t*)vaddr;
-    node->next = g_buddy.free_lists[k];
-    g_buddy.free_lists[k] = node;
-}
+    buddy_allocator_t const* z = &zones[zone];
+    size_t pages = 0;
 
-/* Public */
+    for (u32 k = 0; k <= z->max_order; k++) {
+        pages += (size_t)z->free_count[k] << k;
+    }
 
-int buddy_manages(paddr_t addr)
+    return pages;
+}
+
+size_t buddy_get_free_pages(void)
 {
-    return (addr >= g_buddy.base && addr < g_buddy.base + g_buddy.size);
+    size_t pages = 0;
+
+    for (u32 i = 0; i < BUDDY_NR_ZONES; i += 1) {
+        pages += buddy_get_zone_free_pages(i);
+    }
+
+    return pages;
 }
 
-u32 buddy_get_max_order(void) { return g_buddy.max_order; }
+u32 buddy_get_free_blocks(u32 order)
+{
+    u32 blocks = 0;
 
-size_t buddy_get_total_memory(void) { return g_buddy.size; }
+    for (u32 i = 0; i < BUDDY_NR_ZONES; i += 1) {
+        if (order <= zones[i].max_order) {
+            blocks += zones[i].free_count[order];
+        }
+    }
 
-void buddy_dealloc(paddr_t paddr, u32 order)
+    return blocks;
+}
+
+/*
+ * Returns a block to the allocator and merges it with its buddy for as long
+ * as the buddy is free. Every step is a bit test and an O(1) unlink, so the
+ * whole call is O(max_order).
+ */
+void buddy_free_pages(u32 pfn, u32 order)
 {
-    vaddr_t vaddr = P2V_WO(paddr);
-    mark_free(vaddr, order);
+    buddy_allocator_t* z = buddy_zone(pfn);
 
-    paddr_t current_paddr = paddr;
-    u32 current_order = order;
+    if (!z || order > z->max_order) {
+        abort("buddy_dealloc: address not managed by the buddy allocator");
+    }
 
-    while (current_order < g_buddy.max_order) {
-        size_t block_size = PAGE_SIZE << current_order;
-        paddr_t buddy_paddr = current_paddr ^ block_size;
-        vaddr_t buddy_vaddr = P2V_WO(buddy_paddr);
-        u32 buddy_index = (buddy_vaddr - g_buddy.base) / PAGE_SIZE;
+    page_t* head = pfn_to_page(pfn);
+    if ((head->flags & PG_buddy)
+        || buddy_test_bit(z, order, block_index(z, pfn, order))) {
+        abort("buddy_dealloc: double free");
+    }
+    head->count = 0;
+    head->flags = 0;
 
-        if (!is_block_free(buddy_index, current_order)) {
+    u32 index = pfn - z->start_pfn;
+    while (order < z->max_order) {
+        u32 buddy_index = index ^ (1 << order);
+        if (buddy_index + (1 << order) > z->pages) {
             break;
         }
 
-        if (!remove_from_free_list(buddy_vaddr, current_order)) {
+        if (!buddy_test_bit(z, order, buddy_index >> order)) {
             break;
         }
 
-        mark_allocated(buddy_vaddr, current_order);
+        buddy_list_del(z, z->start_pfn + buddy_index, order);
 
-        current_paddr
-            = (current_paddr < buddy_paddr) ? current_paddr : buddy_paddr;
-        current_order += 1;
+        index &= ~(1 << order);
+        order += 1;
     }
 
-    vaddr_t current_vaddr = P2V_WO(current_paddr);
-    buddy_list_add(current_vaddr, current_order);
+    buddy_list_add(z, z->start_pfn + index, order);
 }
 
-void* buddy_alloc(u32 order)
+void buddy_dealloc(paddr_t paddr, u32 order)
 {
-    if (order > g_buddy.max_order) {
+    buddy_free_pages(paddr >> PAGE_SHIFT, order);
+}
+
+page_t* buddy_alloc_zone(u32 zone, u32 order)
+{
+    buddy_allocator_t* z = &zones[zone];
+    if (z->pages == 0 || order > z->max_order) {
         return NULL;
     }
 
     u32 k = order;
-    while (k <= g_buddy.max_order && !g_buddy.free_lists[k]) {
+    while (k <= z->max_order && !z->free_lists[k]) {
         k += 1;
     }
 
-    if (!g_buddy.free_lists[k]) {
-        printk("Out of memory. No suitable block found.\n");
+    if (k > z->max_order) {
         return NULL;
     }
 
-    buddy_node_t* node = g_buddy.free_lists[k];
-    vaddr_t block_vaddr = (vaddr_t)node;
-    g_buddy.free_lists[k] = node->next;
+    u32 pfn = buddy_node_pfn(z, z->free_lists[k]);
+    buddy_list_del(z, pfn, k);
 
     while (k > order) {
         k -= 1;
-        vaddr_t buddy_vaddr = block_vaddr + (PAGE_SIZE << k);
-
-        buddy_list_add(buddy_vaddr, k);
+        buddy_list_add(z, pfn + (1 << k), k);
     }
 
-    mark_allocated(block_vaddr, order);
-    return (void*)V2P_WO(block_vaddr);
+    page_t* page = pfn_to_page(pfn);
+    page->count = 1;
+    page->order = order;
+    page->flags = 0;
+
+    return page;
 }
 
-void buddy_init(void)
+void* buddy_alloc(u32 order)
 {
-    paddr_t start_paddr = (paddr_t)get_next_free_addr();
-    paddr_t end_paddr = (paddr_t)get_heap_end_addr();
-    vaddr_t end_vaddr = P2V_WO(end_paddr);
-
-    size_t num_pages = (end_paddr - start_paddr) / PAGE_SIZE;
-    size_t map_size_needed = CEIL_DIV(num_pages, 8);
-    g_buddy.map_size = ALIGN(map_size_needed, sizeof(size_t));
-
-    paddr_t map_ptr = (paddr_t)memblock(g_buddy.map_size);
-    g_buddy.map = (u8*)P2V_WO(map_ptr);
-    if (!g_buddy.map) {
-        abort("Could not allocate the bitmap for Buddy Allocator");
-    }
-    memset(g_buddy.map, 0, g_buddy.map_size);
-
-    vaddr_t temp_base = ALIGN((u32)g_buddy.map + g_buddy.map_size, PAGE_SIZE);
-    size_t temp_size = end_vaddr - temp_base;
-    u32 temp_max_order = floor_log2(temp_size / PAGE_SIZE);
-
-    g_buddy.base = ALIGN(
-        (u32)g_buddy.map + g_buddy.map_size, PAGE_SIZE << temp_max_order
-    );
-    g_buddy.size = end_vaddr - g_buddy.base;
-    if (g_buddy.size < PAGE_SIZE) {
-        abort("Not enough memory for the buddy pool");
+    page_t* page = buddy_alloc_zone(BUDDY_ZONE_NORMAL, order);
+    if (!page) {
+        printk("Out of memory. No suitable block found.\n");
+        return NULL;
     }
 
-    g_buddy.max_order = floor_log2(g_buddy.size / PAGE_SIZE);
+    return (void*)page_to_phys(page);
+}
 
-    for (s32 i = 0; i <= MAX_ORDER; i++) {
-        g_buddy.free_lists[i] = NULL;
+void buddy_init(void)
+{
+    /*
+     * RAM the page tables cannot reach is left out: everything past 4 GB
+     * without PAE, past BUDDY_MAX_PFN with it.
+     */
+    u32 end_pfn = min(memblock_end_pfn(), vmm_max_pfn());
+    end_pfn = min(end_pfn, (u32)BUDDY_MAX_PFN);
+    mem_map_init(end_pfn);
+
+    /*
+     * The zones span all of RAM from physical 0, so block indices match
+     * physical alignment. Holes and whatever memblock handed out simply
+     * never make it onto a free list.
+     */
+    u32 normal_end_pfn = min(end_pfn, ZONE_NORMAL >> PAGE_SHIFT);
+
+    buddy_zone_init(&zones[BUDDY_ZONE_NORMAL], 0, normal_end_pfn, true);
+    if (end_pfn > normal_end_pfn) {
+        buddy_zone_init(
+            &zones[BUDDY_ZONE_HIGHMEM], normal_end_pfn, end_pfn, false
+        );
     }
 
-    size_t remaining = g_buddy.size;
-    vaddr_t current_addr = g_buddy.base;
+    for (u32 i = 0; i < memblock_region_count(); i += 1) {
+        memblock_region_t const* r = memblock_get_region(i);
+        /* memblock allocations leave bases inside a page that is in use */
+        u32 start = ALIGN(r->base, PAGE_SIZE) >> PAGE_SHIFT;
+        u32 end = r->end >> PAGE_SHIFT;
 
-    while (remaining >= PAGE_SIZE) {
-        u32 order = floor_log2(remaining / PAGE_SIZE);
-        if (order > g_buddy.max_order) {
-            order = g_buddy.max_order;
+        if (start >= end_pfn) {
+            break;
         }
+        end = min(end, end_pfn);
 
-        vmm_remap_page(SCRATCH_VADDR, (void*)V2P_WO(current_addr), 0);
-        buddy_node_t* block = (buddy_node_t*)SCRATCH_VADDR;
+        if (start < normal_end_pfn) {
+            buddy_seed_range(
+                &zones[BUDDY_ZONE_NORMAL], start, min(end, normal_end_pfn)
+            );
+        }
+        if (end > normal_end_pfn) {
+            buddy_seed_range(
+                &zones[BUDDY_ZONE_HIGHMEM],
+                start > normal_end_pfn ? start : normal_end_pfn, end
+            );
+        }
+    }
 
-        block->next = g_buddy.free_lists[order];
-        g_buddy.free_lists[order] = (buddy_node_t*)current_addr;
+    if (buddy_get_zone_free_pages(BUDDY_ZONE_NORMAL) == 0) {
+        abort("Not enough memory for the buddy pool");
+    }
 
-        size_t block_size = PAGE_SIZE << order;
-        current_addr += block_size;
-        remaining -= block_size;
+    if (zones[BUDDY_ZONE_HIGHMEM].pages > 0) {
+        printk(
+            "buddy: %u KB lowmem, %u KB highmem\n",
+            buddy_get_zone_free_pages(BUDDY_ZONE_NORMAL) * (PAGE_SIZE / 1024),
+            buddy_get_zone_free_pages(BUDDY_ZONE_HIGHMEM) * (PAGE_SIZE / 1024)
+        );
     }
 }
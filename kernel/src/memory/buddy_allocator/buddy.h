@@ -1,38 +1,84 @@
 #ifndef BUDDY_H
 #define BUDDY_H
 
+#include "memory/page.h"
+
 #include <types.h>
 
 #define MAX_ORDER 32
 #define MIN_ORDER 0
 
-// A node in a free list, stored within the free block itself.
+// A node in a free list, stored within the free block itself or, for
+// highmem, in the node array of its zone.
 typedef struct buddy_node {
     struct buddy_node* next;
+    struct buddy_node* prev;
 } buddy_node_t;
 
+/* Physical memory zones, each with free lists of its own */
+#define BUDDY_ZONE_NORMAL 0  // Direct-mapped at KERNBASE, below ZONE_NORMAL
+#define BUDDY_ZONE_HIGHMEM 1 // Above ZONE_NORMAL, only reachable via kmap()
+#define BUDDY_NR_ZONES 2
+
+/*
+ * Highmem stops at 16 GB: every frame costs 12 bytes of lowmem for its
+ * descriptor and free list node, the full 64 GB of PAE would take 192 MB.
+ */
+#define BUDDY_MAX_PFN (1 << 22)
+
 typedef struct {
-    vaddr_t base; // Starting physical address of the managed memory.
-    size_t size;  // Total size of the managed memory in bytes.
+    u32 start_pfn; // First frame of the zone.
+    u32 pages;     // Number of frames the zone spans.
+    buddy_node_t* nodes; // Free list nodes for frames the kernel has no
+                         // mapping of, NULL if the zone is direct-mapped and
+                         // the nodes live in the free blocks themselves.
     buddy_node_t* free_lists[MAX_ORDER + 1]; // Array of free lists, indexed by
                                              // block order.
-    u8* map;         // Bitmap to track block states for efficient merging.
-    size_t map_size; // Size of the state bitmap in bytes.
-    u8 max_order;    // Actual max order, calculated from the total memory size.
+    u32 free_count[MAX_ORDER + 1]; // Number of blocks on each free list.
+    u8* map[MAX_ORDER + 1]; // Per-order bitmaps, a set bit means that block is
+                            // on the free list of that order.
+    size_t map_size;        // Size of all bitmaps together in bytes.
+    u8 max_order; // Actual max order, calculated from the zone size.
 } buddy_allocator_t;
 
 void buddy_init(void);
 
+/**
+ * Allocates a block of 2^order frames from the direct-mapped zone.
+ *
+ * @return Its physical address, or NULL if no block is large enough.
+ */
 void* buddy_alloc(u32 order);
 
+/**
+ * Same as buddy_alloc(), but from `zone` and without complaining when it is
+ * empty, so callers can fall back to another zone. Highmem frames may lie
+ * above 4 GB, hence the descriptor instead of an address.
+ */
+page_t* buddy_alloc_zone(u32 zone, u32 order);
+
 void buddy_dealloc(paddr_t paddr, u32 order);
 
+/* buddy_dealloc() by frame number, for frames above 4 GB */
+void buddy_free_pages(u32 pfn, u32 order);
+
+/* Largest order of the direct-mapped zone */
 u32 buddy_get_max_order(void);
 
 size_t buddy_get_total_memory(void);
 
+size_t buddy_get_free_pages(void);
+
+size_t buddy_get_zone_pages(u32 zone);
+
+size_t buddy_get_zone_free_pages(u32 zone);
+
+u32 buddy_get_free_blocks(u32 order);
+
 void buddy_visualize(void);
 
 int buddy_manages(paddr_t);
 
+int buddy_manages_pfn(u32 pfn);
+
 #endif /* BUDDY_H */
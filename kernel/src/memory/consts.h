@@ -2,6 +2,14 @@
 #define CONSTS_H
 
 #define PAGE_SIZE 0x1000
-#define SCRATCH_VADDR ((void*)0xFFBFF000)
+#define PAGE_SHIFT 12
+#define SCRATCH_VADDR ((void*)0xFF5FF000)
+
+/*
+ * Temporary mappings of highmem frames, in the page table of SCRATCH_VADDR.
+ * Both stay below 0xFF800000, where PAE keeps its recursive mapping.
+ */
+#define KMAP_BASE 0xFF400000
+#define KMAP_SLOTS 64
 
 #endif /* CONSTS_H */
@@ -0,0 +1,269 @@
+#include "memory/filemap.h"
+#include "lib/math.h"
+#include "lib/stdlib.h"
+#include "memory/consts.h"
+#include "memory/highmem.h"
+#include "memory/page.h"
+#include "memory/slab.h"
+#include "sys/file/file.h"
+
+#include <ferrite/string.h>
+#include <types.h>
+#include <uapi/errno.h>
+#include <uapi/fcntl.h>
+
+static kmem_cache_t* page_cache_cache = NULL;
+static cached_page_t* page_hash_table[PAGE_CACHE_BUCKETS] = { 0 };
+static u32 nr_cached_pages = 0;
+
+/* Private */
+
+static inline u32 page_hash(dev_t dev, unsigned long ino, u32 offset)
+{
+    return (dev ^ ino ^ (offset >> PAGE_SHIFT)) % PAGE_CACHE_BUCKETS;
+}
+
+static inline bool
+page_matches(cached_page_t const* pc, vfs_inode_t const* inode, u32 offset)
+{
+    return pc->pc_dev == inode->i_dev && pc->pc_ino == inode->i_ino
+        && pc->pc_offset == offset;
+}
+
+static cached_page_t* filemap_lookup(vfs_inode_t const* inode, u32 offset)
+{
+    u32 hash = page_hash(inode->i_dev, inode->i_ino, offset);
+
+    for (cached_page_t* pc = page_hash_table[hash]; pc; pc = pc->pc_next) {
+        if (page_matches(pc, inode, offset)) {
+            return pc;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Reads or writes `count` bytes at `offset` of `inode` through its file
+ * operations, the same way read_exec() does for executables.
+ */
+static s32
+filemap_io(vfs_inode_t* inode, u32 offset, void* buf, u32 count, bool write)
+{
+    if (!inode->i_op || !inode->i_op->default_file_ops) {
+        return -EINVAL;
+    }
+
+    file_t file;
+    file.f_mode = write ? FMODE_WRITE : FMODE_READ;
+    file.f_flags = write ? O_WRONLY : O_RDONLY;
+    file.f_count = 1;
+    file.f_inode = inode;
+    file.f_pos = (off_t)offset;
+    file.f_op = inode->i_op->default_file_ops;
+
+    if (write) {
+        if (!file.f_op->write) {
+            return -EINVAL;
+        }
+
+        return file.f_op->write(inode, &file, buf, (int)count);
+    }
+
+    if (!file.f_op->read) {
+        return -EINVAL;
+    }
+
+    return file.f_op->read(inode, &file, buf, (int)count);
+}
+
+/*
+ * Frees an entry already taken off its hash chain, writing the page back to
+ * `inode` first if it is dirty, and drops the cache's reference on it. A
+ * page that is still mapped lives on, but is no longer found by lookups.
+ */
+static void filemap_drop(cached_page_t* pc, vfs_inode_t* inode)
+{
+    page_t* page = pc->pc_page;
+
+    if (page->flags & PG_dirty) {
+        filemap_write_page(inode, pc->pc_offset, page);
+    }
+
+    page->flags &= ~(PG_pagecache | PG_text);
+    put_page(page);
+    kmem_cache_free(page_cache_cache, pc);
+    nr_cached_pages -= 1;
+}
+
+/* Public */
+
+void filemap_init(void)
+{
+    page_cache_cache = kmem_cache_create("page_cache", sizeof(cached_page_t));
+    if (!page_cache_cache) {
+        abort("filemap_init: could not create the page cache");
+    }
+}
+
+page_t* filemap_get_page(vfs_inode_t* inode, u32 offset, bool* major)
+{
+    u32 hash = page_hash(inode->i_dev, inode->i_ino, offset);
+
+    cached_page_t* cached = filemap_lookup(inode, offset);
+    if (cached) {
+        get_page(cached->pc_page);
+        *major = false;
+        return cached->pc_page;
+    }
+
+    page_t* page = alloc_highpage(false);
+    if (!page) {
+        return NULL;
+    }
+
+    u32 count = 0;
+    if (offset < inode->i_size) {
+        count = min(inode->i_size - offset, PAGE_SIZE);
+    }
+
+    u8* data = kmap(page);
+    s32 ret = count > 0 ? filemap_io(inode, offset, data, count, false) : 0;
+    memset(data + count, 0, PAGE_SIZE - count);
+    kunmap(page);
+
+    if (ret < 0) {
+        put_page(page);
+        return NULL;
+    }
+
+    cached_page_t* pc = kmem_cache_alloc(page_cache_cache);
+    if (!pc) {
+        put_page(page);
+        return NULL;
+    }
+
+    pc->pc_dev = inode->i_dev;
+    pc->pc_ino = inode->i_ino;
+    pc->pc_offset = offset;
+    pc->pc_page = page;
+    pc->pc_next = page_hash_table[hash];
+    page_hash_table[hash] = pc;
+
+    page->flags |= PG_pagecache;
+    get_page(page);
+    nr_cached_pages += 1;
+
+    *major = true;
+    return page;
+}
+
+s32 filemap_write_page(vfs_inode_t* inode, u32 offset, page_t* page)
+{
+    if (offset < inode->i_size) {
+        u32 count = min(inode->i_size - offset, PAGE_SIZE);
+        s32 ret = filemap_io(inode, offset, kmap(page), count, true);
+
+        kunmap(page);
+        if (ret < 0) {
+            return -EIO;
+        }
+    }
+
+    page->flags &= ~PG_dirty;
+    return 0;
+}
+
+void filemap_update(
+    vfs_inode_t const* inode,
+    u32 offset,
+    void const* buf,
+    u32 count
+)
+{
+    u8 const* src = buf;
+
+    while (count > 0) {
+        u32 in_page = offset & ~PAGE_MASK;
+        u32 chunk = min(count, PAGE_SIZE - in_page);
+
+        cached_page_t* pc = filemap_lookup(inode, offset & PAGE_MASK);
+        if (pc) {
+            u8* data = kmap(pc->pc_page);
+            memcpy(data + in_page, src, chunk);
+            kunmap(pc->pc_page);
+        }
+
+        offset += chunk;
+        src += chunk;
+        count -= chunk;
+    }
+}
+
+void filemap_release(vfs_inode_t* inode)
+{
+    for (u32 hash = 0; hash < PAGE_CACHE_BUCKETS; hash += 1) {
+        cached_page_t** link = &page_hash_table[hash];
+
+        while (*link) {
+            cached_page_t* pc = *link;
+            page_t* desc = pc->pc_page;
+
+            if (pc->pc_dev != inode->i_dev || pc->pc_ino != inode->i_ino
+                || page_count(desc) > 1 || desc->flags & PG_text) {
+                link = &pc->pc_next;
+                continue;
+            }
+
+            *link = pc->pc_next;
+            filemap_drop(pc, inode);
+        }
+    }
+}
+
+void filemap_invalidate(vfs_inode_t* inode)
+{
+    for (u32 hash = 0; hash < PAGE_CACHE_BUCKETS; hash += 1) {
+        cached_page_t** link = &page_hash_table[hash];
+
+        while (*link) {
+            cached_page_t* pc = *link;
+
+            if (pc->pc_dev != inode->i_dev || pc->pc_ino != inode->i_ino) {
+                link = &pc->pc_next;
+                continue;
+            }
+
+            *link = pc->pc_next;
+            filemap_drop(pc, inode);
+        }
+    }
+}
+
+u32 filemap_shrink(void)
+{
+    u32 freed = 0;
+
+    for (u32 hash = 0; hash < PAGE_CACHE_BUCKETS; hash += 1) {
+        cached_page_t** link = &page_hash_table[hash];
+
+        while (*link) {
+            cached_page_t* pc = *link;
+            page_t const* desc = pc->pc_page;
+
+            /* Without the inode at hand, dirty pages cannot be written back */
+            if (page_count(desc) > 1 || desc->flags & PG_dirty) {
+                link = &pc->pc_next;
+                continue;
+            }
+
+            *link = pc->pc_next;
+            filemap_drop(pc, NULL);
+            freed += 1;
+        }
+    }
+
+    return freed;
+}
+
+u32 filemap_nr_pages(void) { return nr_cached_pages; }
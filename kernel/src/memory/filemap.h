@@ -0,0 +1,79 @@
+#ifndef FILEMAP_H
+#define FILEMAP_H
+
+#include "fs/vfs.h"
+#include "memory/page.h"
+
+#include <stdbool.h>
+#include <types.h>
+
+#define PAGE_CACHE_BUCKETS 64
+
+/*
+ * A page of file data shared by every mapping of that file. The cache holds
+ * one reference on the frame, each page table entry pointing at it another.
+ */
+typedef struct cached_page {
+    dev_t pc_dev;
+    unsigned long pc_ino;
+    u32 pc_offset; // Page-aligned offset into the file
+
+    page_t* pc_page; // May be highmem, see kmap()
+
+    struct cached_page* pc_next;
+} cached_page_t;
+
+void filemap_init(void);
+
+/**
+ * Returns the page holding the data at `offset` of `inode`, reading it from
+ * disk if it is not cached yet. The caller gets its own reference.
+ *
+ * @param major Set if the page had to be read from disk.
+ * @return      The page, or NULL on failure.
+ */
+page_t* filemap_get_page(vfs_inode_t* inode, u32 offset, bool* major);
+
+/**
+ * Writes a cached page back to the file. Nothing beyond the end of the file
+ * is written, so a mapping never changes the size of its file.
+ */
+s32 filemap_write_page(vfs_inode_t* inode, u32 offset, page_t* page);
+
+/**
+ * Copies `count` bytes that write() just put at `offset` of `inode` into the
+ * cached pages they fall into, so that shared mappings of the file see them
+ * and a later write-back does not bring the old data back.
+ */
+void filemap_update(
+    vfs_inode_t const* inode,
+    u32 offset,
+    void const* buf,
+    u32 count
+);
+
+/**
+ * Drops the pages of `inode` that are no longer mapped anywhere, writing
+ * back those still marked dirty. Pages marked PG_text stay cached, so the
+ * next exec of the same binary finds its text without going to disk.
+ */
+void filemap_release(vfs_inode_t* inode);
+
+/**
+ * Takes every page of `inode` out of the cache, mapped or not, after writing
+ * back the dirty ones. Called before the file changes behind the cache's
+ * back: truncation and deletion.
+ */
+void filemap_invalidate(vfs_inode_t* inode);
+
+/**
+ * Frees every cached page that is not mapped anywhere.
+ *
+ * @return The number of pages freed.
+ */
+u32 filemap_shrink(void);
+
+/* Number of pages in the cache, mapped or not */
+u32 filemap_nr_pages(void);
+
+#endif /* FILEMAP_H */
@@ -0,0 +1,103 @@
+#include "memory/highmem.h"
+#include "arch/x86/io.h"
+#include "lib/stdlib.h"
+#include "memory/consts.h"
+#include "memory/page.h"
+#include "memory/vmm.h"
+
+#include <ferrite/string.h>
+#include <types.h>
+
+/*
+ * A slot keeps its mapping after the last kunmap(), so mapping the same
+ * frame again costs nothing. The TLB entry only has to go when the slot is
+ * handed to another frame.
+ */
+static page_t* kmap_pages[KMAP_SLOTS] = { 0 };
+static u16 kmap_count[KMAP_SLOTS] = { 0 };
+static u32 kmap_next = 0;
+
+/* Private */
+
+static inline u32 kmap_slot_addr(u32 slot)
+{
+    return KMAP_BASE + (slot * PAGE_SIZE);
+}
+
+/* Public */
+
+void* kmap(page_t* page)
+{
+    if (!page_is_highmem(page)) {
+        return page_address(page);
+    }
+
+    bool irq = irq_save();
+
+    for (u32 slot = 0; slot < KMAP_SLOTS; slot += 1) {
+        if (kmap_pages[slot] == page) {
+            kmap_count[slot] += 1;
+            irq_restore(irq);
+            return (void*)kmap_slot_addr(slot);
+        }
+    }
+
+    /* Round robin, so recently released mappings stay around a while */
+    for (u32 i = 0; i < KMAP_SLOTS; i += 1) {
+        u32 slot = (kmap_next + i) % KMAP_SLOTS;
+        if (kmap_count[slot] > 0) {
+            continue;
+        }
+
+        u32 vaddr = kmap_slot_addr(slot);
+        vmm_set_pte(vaddr, pfn_pte(page_to_pfn(page), PTE_NX | PTE_W | PTE_P));
+        if (kmap_pages[slot]) {
+            vmm_flush_page(vaddr);
+        }
+
+        kmap_pages[slot] = page;
+        kmap_count[slot] = 1;
+        kmap_next = slot + 1;
+
+        irq_restore(irq);
+        return (void*)vaddr;
+    }
+
+    abort("kmap: out of slots");
+}
+
+void kunmap(page_t* page)
+{
+    if (!page_is_highmem(page)) {
+        return;
+    }
+
+    bool irq = irq_save();
+
+    for (u32 slot = 0; slot < KMAP_SLOTS; slot += 1) {
+        if (kmap_pages[slot] == page && kmap_count[slot] > 0) {
+            kmap_count[slot] -= 1;
+            irq_restore(irq);
+            return;
+        }
+    }
+
+    abort("kunmap: page is not mapped");
+}
+
+void clear_highpage(page_t* page)
+{
+    memset(kmap(page), 0, PAGE_SIZE);
+    kunmap(page);
+}
+
+void copy_highpage(page_t* dst, page_t* src)
+{
+    void* to = kmap(dst);
+    void const* from = kmap(src);
+
+    memcpy(to, from, PAGE_SIZE);
+
+    kunmap(src);
+    kunmap(dst);
+}
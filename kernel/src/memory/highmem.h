@@ -0,0 +1,20 @@
+#ifndef HIGHMEM_H
+#define HIGHMEM_H
+
+#include "memory/page.h"
+
+/**
+ * Returns a kernel address for `page`. Lowmem frames are simply found in the
+ * direct map; highmem frames get one of the KMAP_SLOTS slots of the kmap
+ * window until the matching kunmap(). Mapping the same frame twice shares
+ * the slot.
+ */
+void* kmap(page_t* page);
+
+void kunmap(page_t* page);
+
+void clear_highpage(page_t* page);
+
+void copy_highpage(page_t* dst, page_t* src);
+
+#endif /* HIGHMEM_H */
@@ -5,7 +5,9 @@
 #include "memory/buddy_allocator/buddy.h"
 #include "memory/consts.h"
 #include "memory/kmalloc.h"
+#include "memory/kmemtrace.h"
 #include "memory/memory.h"
+#include "memory/slab.h"
 
 #include <types.h>
 
@@ -16,7 +18,11 @@ void kfree(void* ptr)
         return;
     }
 
-    block_header_t* header = (block_header_t*)ptr - 1;
+    /*
+     * Slab pages and page-sized blocks both keep their header at the start
+     * of the page the pointer lives in.
+     */
+    block_header_t* header = (block_header_t*)((u32)ptr & PAGE_MASK);
     if (header->magic != MAGIC) {
         abort("The given pointer is corrupt\n");
     }
@@ -25,11 +31,25 @@ void kfree(void* ptr)
         abort("kfree() is used on a vmalloc() pointer\n");
     }
 
+    kmemtrace_free(ptr);
+
+    if (header->flags & MEM_SLAB) {
+        slab_t* s = (slab_t*)header;
+        kmem_cache_free(s->s_cache, ptr);
+        return;
+    }
+
+    if ((void*)(header + 1) != ptr) {
+        abort("The given pointer is corrupt\n");
+    }
+
     u32 vaddr = (u32)header;
     size_t size = header->size;
     u32 pages = CEIL_DIV(size, PAGE_SIZE);
     u32 order = ceil_log2(pages);
 
+    header->magic = 0;
+
     u32 paddr = V2P_WO(vaddr);
     buddy_dealloc(paddr, order);
 }
@@ -1,33 +1,43 @@
 #include "memory/kmalloc.h"
 #include "arch/x86/memlayout.h"
 #include "lib/math.h"
+#include "lib/stdlib.h"
 #include "memory/buddy_allocator/buddy.h"
 #include "memory/consts.h"
+#include "memory/kmemtrace.h"
 #include "memory/memory.h"
+#include "memory/slab.h"
 
 #include <types.h>
 
-/* Public */
+#define KMALLOC_NUM_CACHES 8
 
-/**
- * @brief Allocates a physically contiguous memory block.
- *
- * Fast and suitable for most kernel allocations, especially for hardware/DMA
- * buffers that require physical contiguity.
- *
- * @param n The number of bytes to allocate.
- * @return A pointer to the allocated memory, or NULL on failure.
+/*
+ * General purpose caches. Like the size table of Linux 1.x, the two largest
+ * classes give up a few bytes to the in-page slab header so that four, and
+ * two objects still share a page.
  */
-void* kmalloc(size_t n)
-{
-    if (n == 0 || n >= MAXIMUM_SLAB_ALLOCATION) {
-        return NULL;
-    }
+static size_t const kmalloc_sizes[KMALLOC_NUM_CACHES]
+    = { 16, 32, 64, 128, 256, 512, SLAB_FIT(4), SLAB_FIT(2) };
 
+static char const* const kmalloc_names[KMALLOC_NUM_CACHES]
+    = { "size-16",  "size-32",  "size-64", "size-128",
+        "size-256", "size-512", "size-1k", "size-2k" };
+
+static kmem_cache_t* kmalloc_caches[KMALLOC_NUM_CACHES] = { 0 };
+
+/* Private */
+
+static void* kmalloc_large(size_t n)
+{
     size_t total_size = ALIGN(n + sizeof(block_header_t), PAGE_SIZE);
 
     u32 num_pages = CEIL_DIV(total_size, PAGE_SIZE);
     u32 order = ceil_log2(num_pages);
+    if (order > buddy_get_max_order()) {
+        return NULL;
+    }
+
     void* paddr = buddy_alloc(order);
     if (!paddr) {
         return NULL;
@@ -41,3 +51,48 @@ void* kmalloc(size_t n)
 
     return (void*)(header + 1);
 }
+
+/* Public */
+
+void kmalloc_init(void)
+{
+    kmem_cache_init();
+
+    for (s32 i = 0; i < KMALLOC_NUM_CACHES; i += 1) {
+        kmalloc_caches[i]
+            = kmem_cache_create(kmalloc_names[i], kmalloc_sizes[i]);
+
+        if (!kmalloc_caches[i]) {
+            abort("kmalloc_init: could not create the general caches");
+        }
+    }
+}
+
+/**
+ * @brief Allocates a physically contiguous memory block.
+ *
+ * Fast and suitable for most kernel allocations, especially for hardware/DMA
+ * buffers that require physical contiguity. Requests up to 2 KB are served
+ * from the slab caches, anything bigger takes whole pages from the buddy
+ * allocator.
+ *
+ * @param n The number of bytes to allocate.
+ * @return A pointer to the allocated memory, or NULL on failure.
+ */
+void* kmalloc(size_t n)
+{
+    if (n == 0) {
+        return NULL;
+    }
+
+    s32 i = 0;
+    while (i < KMALLOC_NUM_CACHES && n > kmalloc_sizes[i]) {
+        i += 1;
+    }
+
+    void* ptr = i < KMALLOC_NUM_CACHES ? kmem_cache_alloc(kmalloc_caches[i])
+                                       : kmalloc_large(n);
+
+    kmemtrace_alloc(ptr, n, __builtin_return_address(0), KMEMTRACE_KMALLOC);
+    return ptr;
+}
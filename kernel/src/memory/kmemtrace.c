@@ -0,0 +1,296 @@
+#include "memory/kmemtrace.h"
+#include "arch/x86/io.h"
+#include "drivers/printk.h"
+
+#include <ferrite/string.h>
+#include <types.h>
+#include <uapi/errno.h>
+
+#ifdef __KMEMTRACE
+
+/* The live allocations printed by kmemtrace_dump(), the rest is counted */
+#    define KMEMTRACE_DUMP_MAX 64
+
+typedef struct kmemtrace_site {
+    void* caller; // NULL collects the call sites that did not fit
+    u32 allocs;
+    u32 failed;
+    u32 frees;
+    u32 live;
+    u32 live_bytes;
+    u32 total_bytes; // Everything it ever allocated, wraps around
+    struct kmemtrace_site* hash_next;
+} kmemtrace_site_t;
+
+typedef struct kmemtrace_record {
+    void const* ptr;
+    u32 size;
+    u8 type;
+    unsigned long long tick;
+    kmemtrace_site_t* site;
+    struct kmemtrace_record* hash_next;
+} kmemtrace_record_t;
+
+extern unsigned long long volatile ticks;
+
+/*
+ * Everything lives in static tables: kmalloc() cannot call into itself, and
+ * the profiler should not show up in its own numbers.
+ */
+static kmemtrace_record_t records[KMEMTRACE_RECORDS];
+static kmemtrace_record_t* record_hash[KMEMTRACE_BUCKETS] = { 0 };
+static kmemtrace_record_t* free_records = NULL;
+static u32 records_used = 0; // Taken from `records` at least once
+
+static kmemtrace_site_t sites[KMEMTRACE_SITES];
+static kmemtrace_site_t* site_hash[KMEMTRACE_BUCKETS] = { 0 };
+static kmemtrace_site_t other_site = { 0 };
+static u32 nr_sites = 0;
+
+static kmemtrace_stats_t stats = { 0 };
+
+/* Copies taken by kmemtrace_dump(), printk() enables interrupts */
+static kmemtrace_site_t site_snapshot[KMEMTRACE_SITES + 1];
+static kmemtrace_record_t old_snapshot[KMEMTRACE_DUMP_MAX];
+
+/* Private */
+
+static inline u32 kmemtrace_hash(void const* addr)
+{
+    return ((u32)addr >> 4) % KMEMTRACE_BUCKETS;
+}
+
+static kmemtrace_site_t* site_get(void* caller)
+{
+    u32 bucket = kmemtrace_hash(caller);
+
+    for (kmemtrace_site_t* s = site_hash[bucket]; s; s = s->hash_next) {
+        if (s->caller == caller) {
+            return s;
+        }
+    }
+
+    if (nr_sites == KMEMTRACE_SITES) {
+        return &other_site;
+    }
+
+    kmemtrace_site_t* s = &sites[nr_sites];
+    nr_sites += 1;
+    stats.sites = nr_sites;
+
+    memset(s, 0, sizeof(kmemtrace_site_t));
+    s->caller = caller;
+    s->hash_next = site_hash[bucket];
+    site_hash[bucket] = s;
+
+    return s;
+}
+
+static kmemtrace_record_t* record_alloc(void)
+{
+    if (free_records) {
+        kmemtrace_record_t* r = free_records;
+        free_records = r->hash_next;
+        return r;
+    }
+
+    if (records_used < KMEMTRACE_RECORDS) {
+        records_used += 1;
+        return &records[records_used - 1];
+    }
+
+    return NULL;
+}
+
+/* Busiest first, by the number of allocations */
+static void sort_sites(kmemtrace_site_t* list, u32 count)
+{
+    for (u32 i = 1; i < count; i += 1) {
+        kmemtrace_site_t tmp = list[i];
+        u32 j = i;
+
+        while (j > 0 && list[j - 1].allocs < tmp.allocs) {
+            list[j] = list[j - 1];
+            j -= 1;
+        }
+        list[j] = tmp;
+    }
+}
+
+static void dump_sites(void)
+{
+    bool irq = irq_save();
+    u32 count = nr_sites;
+
+    memcpy(site_snapshot, sites, count * sizeof(kmemtrace_site_t));
+    if (other_site.allocs) {
+        site_snapshot[count] = other_site;
+        count += 1;
+    }
+    irq_restore(irq);
+
+    sort_sites(site_snapshot, count);
+
+    printk("  call site      allocs  failed   frees    live   bytes   total\n");
+    for (u32 i = 0; i < count; i += 1) {
+        kmemtrace_site_t const* s = &site_snapshot[i];
+
+        if (!s->caller) {
+            printk("  other     ");
+        } else {
+            printk("  0x%08x", (u32)s->caller);
+        }
+        printk(
+            "  %6u  %6u  %6u  %6u  %6u  %6u\n", s->allocs, s->failed,
+            s->frees, s->live, s->live_bytes, s->total_bytes
+        );
+    }
+}
+
+/* Returns how many live allocations are older than `min_age` ticks */
+static u32 dump_old(u32 min_age)
+{
+    u32 found = 0;
+    bool irq = irq_save();
+    unsigned long long now = ticks;
+
+    for (u32 b = 0; b < KMEMTRACE_BUCKETS; b += 1) {
+        for (kmemtrace_record_t* r = record_hash[b]; r; r = r->hash_next) {
+            if (now - r->tick < min_age) {
+                continue;
+            }
+
+            if (found < KMEMTRACE_DUMP_MAX) {
+                old_snapshot[found] = *r;
+            }
+            found += 1;
+        }
+    }
+    irq_restore(irq);
+
+    printk("  live allocations older than %u ticks: %u\n", min_age, found);
+    for (u32 i = 0; i < found && i < KMEMTRACE_DUMP_MAX; i += 1) {
+        kmemtrace_record_t const* r = &old_snapshot[i];
+
+        printk(
+            "  0x%08x %7u bytes  %s  age %u  from 0x%08x\n", (u32)r->ptr,
+            r->size, r->type == KMEMTRACE_VMALLOC ? "vmalloc" : "kmalloc",
+            (u32)(now - r->tick), (u32)r->site->caller
+        );
+    }
+
+    if (found > KMEMTRACE_DUMP_MAX) {
+        printk("  ... and %u more\n", found - KMEMTRACE_DUMP_MAX);
+    }
+
+    return found;
+}
+
+/* Public */
+
+void kmemtrace_alloc(void const* ptr, size_t size, void* caller, u8 type)
+{
+    bool irq = irq_save();
+    kmemtrace_site_t* site = site_get(caller);
+
+    site->allocs += 1;
+    if (!ptr) {
+        site->failed += 1;
+        irq_restore(irq);
+        return;
+    }
+
+    site->total_bytes += size;
+
+    kmemtrace_record_t* r = record_alloc();
+    if (!r) {
+        /* Its free could not be matched, so it is not counted as live */
+        stats.untracked += 1;
+        irq_restore(irq);
+        return;
+    }
+
+    u32 bucket = kmemtrace_hash(ptr);
+    r->ptr = ptr;
+    r->size = size;
+    r->type = type;
+    r->tick = ticks;
+    r->site = site;
+    r->hash_next = record_hash[bucket];
+    record_hash[bucket] = r;
+
+    site->live += 1;
+    site->live_bytes += size;
+    stats.live += 1;
+    stats.live_bytes += size;
+    irq_restore(irq);
+}
+
+void kmemtrace_free(void const* ptr)
+{
+    bool irq = irq_save();
+    kmemtrace_record_t** link = &record_hash[kmemtrace_hash(ptr)];
+
+    while (*link && (*link)->ptr != ptr) {
+        link = &(*link)->hash_next;
+    }
+
+    kmemtrace_record_t* r = *link;
+    if (!r) {
+        irq_restore(irq);
+        return;
+    }
+
+    *link = r->hash_next;
+
+    r->site->frees += 1;
+    r->site->live -= 1;
+    r->site->live_bytes -= r->size;
+    stats.live -= 1;
+    stats.live_bytes -= r->size;
+
+    r->hash_next = free_records;
+    free_records = r;
+    irq_restore(irq);
+}
+
+s32 kmemtrace_dump(u32 min_age)
+{
+    kmemtrace_stats_t s;
+
+    kmemtrace_get_stats(&s);
+    printk(
+        "kmemtrace: %u live allocations, %u bytes, %u call sites, "
+        "%u untracked\n",
+        s.live, s.live_bytes, s.sites, s.untracked
+    );
+
+    dump_sites();
+    return (s32)dump_old(min_age);
+}
+
+void kmemtrace_get_stats(kmemtrace_stats_t* s)
+{
+    bool irq = irq_save();
+    *s = stats;
+    irq_restore(irq);
+}
+
+#else
+
+/* Public */
+
+s32 kmemtrace_dump(u32 min_age)
+{
+    (void)min_age;
+
+    printk("kmemtrace: not built in, rebuild with -D__KMEMTRACE\n");
+    return -ENOSYS;
+}
+
+void kmemtrace_get_stats(kmemtrace_stats_t* s)
+{
+    memset(s, 0, sizeof(kmemtrace_stats_t));
+}
+
+#endif /* __KMEMTRACE */
@@ -0,0 +1,67 @@
+#ifndef KMEMTRACE_H
+#define KMEMTRACE_H
+
+#include <types.h>
+
+/*
+ * Call-site profiler for kmalloc() and vmalloc(), built in with
+ * -D__KMEMTRACE. Every live allocation remembers who made it and when, and
+ * every call site counts what it allocated and freed. Without the flag the
+ * hooks compile to nothing.
+ */
+
+#define KMEMTRACE_RECORDS 4096 // Live allocations that can be tracked
+#define KMEMTRACE_SITES 256    // Distinct call sites
+#define KMEMTRACE_BUCKETS 512
+
+/* kmemtrace_alloc() types */
+#define KMEMTRACE_KMALLOC 0
+#define KMEMTRACE_VMALLOC 1
+
+typedef struct {
+    u32 live;      // Tracked allocations not freed yet
+    u32 live_bytes;
+    u32 sites;
+    u32 untracked; // Allocations made while all records were in use
+} kmemtrace_stats_t;
+
+#ifdef __KMEMTRACE
+
+/**
+ * Records that `caller` got `size` bytes at `ptr`. A NULL `ptr` is a failed
+ * allocation and is only counted for the call site.
+ */
+void kmemtrace_alloc(void const* ptr, size_t size, void* caller, u8 type);
+
+/* Forgets `ptr`. Pointers that were never recorded are ignored. */
+void kmemtrace_free(void const* ptr);
+
+#else
+
+static inline void
+kmemtrace_alloc(void const* ptr, size_t size, void* caller, u8 type)
+{
+    (void)ptr;
+    (void)size;
+    (void)caller;
+    (void)type;
+}
+
+static inline void kmemtrace_free(void const* ptr) { (void)ptr; }
+
+#endif /* __KMEMTRACE */
+
+/**
+ * Prints every call site with its allocation count, frees and the bytes it
+ * holds, busiest first, followed by the live allocations older than
+ * `min_age` ticks. Call sites are return addresses, `addr2line -e
+ * kernel.elf` turns them into lines.
+ *
+ * @return The number of live allocations older than `min_age`, or -ENOSYS
+ *         when the kernel was built without __KMEMTRACE.
+ */
+s32 kmemtrace_dump(u32 min_age);
+
+void kmemtrace_get_stats(kmemtrace_stats_t* stats);
+
+#endif /* KMEMTRACE_H */
@@ -1,5 +1,8 @@
+#include "lib/math.h"
 #include "lib/stdlib.h"
+#include "memory/consts.h"
 #include "memory/memory.h"
+#include "memory/slab.h"
 
 size_t ksize(void* ptr)
 {
@@ -7,11 +10,15 @@ size_t ksize(void* ptr)
         return 0;
     }
 
-    block_header_t* header_ptr = (block_header_t*)ptr - 1;
+    block_header_t* header_ptr = (block_header_t*)((u32)ptr & PAGE_MASK);
 
     if (header_ptr->magic != MAGIC) {
         abort("Corrupt pointer provided to ksize");
     }
 
+    if (header_ptr->flags & MEM_SLAB) {
+        return ((slab_t*)header_ptr)->s_cache->c_objsize;
+    }
+
     return header_ptr->size;
 }
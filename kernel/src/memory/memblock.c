@@ -1,45 +1,183 @@
 #include "memory/memblock.h"
+#include "arch/x86/memlayout.h"
+#include "drivers/printk.h"
+#include "lib/math.h"
+#include "lib/stdlib.h"
 #include "memory/consts.h"
 #include "memory/pmm.h"
+#include "memory/vmm.h"
 
+#include <ferrite/string.h>
 #include <types.h>
 #include <stdbool.h>
 
+extern u32 _kernel_start[];
+
 static bool bumpalloc_is_active = false;
-static void* next_free_addr = NULL;
-static void* heap_end_addr = NULL;
 
-static void kbrk(size_t heap_size)
+static memblock_region_t regions[MEMBLOCK_MAX_REGIONS];
+static u32 region_count = 0;
+static u32 end_pfn = 0;
+
+/* Private */
+
+static void memblock_remove_at(u32 i)
 {
-    next_free_addr = (void*)pmm_get_first_addr();
-    heap_end_addr = (void*)heap_size;
+    region_count -= 1;
+    memmove(
+        &regions[i], &regions[i + 1],
+        (region_count - i) * sizeof(memblock_region_t)
+    );
 }
 
-/* Public */
+static void memblock_insert_at(u32 i, u64 base, u64 end)
+{
+    if (region_count == MEMBLOCK_MAX_REGIONS) {
+        printk(
+            "memblock: too many regions, dropping 0x%llx-0x%llx\n", base, end
+        );
+        return;
+    }
+
+    memmove(
+        &regions[i + 1], &regions[i],
+        (region_count - i) * sizeof(memblock_region_t)
+    );
+    regions[i].base = base;
+    regions[i].end = end;
+    region_count += 1;
+}
+
+/*
+ * Adds the whole pages of [base, end) to the sorted region list, merging it
+ * with the regions it overlaps or touches.
+ */
+static void memblock_add(u64 base, u64 end)
+{
+    base = ALIGN(base, PAGE_SIZE);
+    end &= PAGE_MASK;
+    if (base >= end) {
+        return;
+    }
+
+    u32 i = 0;
+    while (i < region_count && regions[i].end < base) {
+        i += 1;
+    }
 
-void* get_next_free_addr(void) { return next_free_addr; }
+    if (i == region_count || regions[i].base > end) {
+        memblock_insert_at(i, base, end);
+        return;
+    }
+
+    if (base < regions[i].base) {
+        regions[i].base = base;
+    }
+    if (end > regions[i].end) {
+        regions[i].end = end;
+    }
 
-void* get_heap_end_addr(void) { return heap_end_addr; }
+    while (i + 1 < region_count && regions[i + 1].base <= regions[i].end) {
+        if (regions[i + 1].end > regions[i].end) {
+            regions[i].end = regions[i + 1].end;
+        }
+        memblock_remove_at(i + 1);
+    }
+}
+
+/* Public */
 
 void memblock_deactivate(void) { bumpalloc_is_active = false; }
 
 bool memblock_is_active(void) { return bumpalloc_is_active; }
 
-/*
- * FIXME: This implementation only uses the first available memory region and
- * assumes it is contiguous. It does not correctly handle fragmented
- * physical memory maps.
- *
- * Future work should involve parsing the entire memory map to manage
- * multiple, non-contiguous free regions.
- *
- * Example:
- * map[0000001000] 1 being taken, 0 being free. Will be devestating for our
- * memblock()
- */
-void memblock_init(void)
+u32 memblock_region_count(void) { return region_count; }
+
+memblock_region_t const* memblock_get_region(u32 i)
 {
-    kbrk(pmm_bitmap_len() * PAGE_SIZE * 8);
+    return i < region_count ? &regions[i] : NULL;
+}
+
+u32 memblock_end_pfn(void) { return end_pfn; }
+
+void memblock_reserve(paddr_t base, size_t size)
+{
+    u64 start = base & PAGE_MASK;
+    u64 end = ALIGN((u64)base + size, PAGE_SIZE);
+
+    for (u32 i = 0; i < region_count;) {
+        memblock_region_t* r = &regions[i];
+
+        if (r->end <= start || r->base >= end) {
+            i += 1;
+            continue;
+        }
+
+        /* The reserved range punches a hole into the region */
+        if (r->base < start && r->end > end) {
+            memblock_insert_at(i + 1, end, r->end);
+            regions[i].end = start;
+            return;
+        }
+
+        if (r->base < start) {
+            r->end = start;
+            i += 1;
+        } else if (r->end > end) {
+            r->base = end;
+            i += 1;
+        } else {
+            memblock_remove_at(i);
+        }
+    }
+}
+
+void memblock_init(multiboot_info_t* mbd)
+{
+    region_count = 0;
+
+    for (u32 i = 0; i < mbd->mmap_length; i += sizeof(multiboot_mmap_t)) {
+        multiboot_mmap_t* entry = (multiboot_mmap_t*)(mbd->mmap_addr + i);
+
+        if (entry->type != MULTIBOOT_MEMORY_AVAILABLE) {
+            continue;
+        }
+
+        /* Kept whole, buddy_init() decides what the page tables can reach */
+        u64 base = ((u64)entry->addr_high << 32) | entry->addr_low;
+        u64 end = base + (((u64)entry->len_high << 32) | entry->len_low);
+        if (end < base || end > MEMBLOCK_MAX_ADDR) {
+            end = MEMBLOCK_MAX_ADDR;
+        }
+
+        memblock_add(base, end);
+    }
+
+    if (region_count == 0) {
+        abort("memblock: no usable memory in the memory map");
+    }
+    end_pfn = regions[region_count - 1].end >> PAGE_SHIFT;
+
+    /* Keep NULL dereferences faulting on physical addresses as well */
+    memblock_reserve(0, PAGE_SIZE);
+
+    paddr_t kernel_start = V2P_WO((u32)_kernel_start);
+    paddr_t kernel_end = V2P_WO((u32)pmm_bitmap) + pmm_bitmap_len();
+    memblock_reserve(kernel_start, kernel_end - kernel_start);
+
+    /* Still read through the identity map later on */
+    memblock_reserve((paddr_t)mbd, sizeof(multiboot_info_t));
+    memblock_reserve(mbd->mmap_addr, mbd->mmap_length);
+    if (mbd->flags & (1 << 2)) {
+        memblock_reserve(mbd->cmdline, strlen((char const*)mbd->cmdline) + 1);
+    }
+
+    for (u32 i = 0; i < region_count; i += 1) {
+        printk(
+            "memblock: 0x%llx-0x%llx (%llu KB)\n", regions[i].base,
+            regions[i].end, (regions[i].end - regions[i].base) / 1024
+        );
+    }
 
     bumpalloc_is_active = true;
 }
@@ -48,6 +186,10 @@ void memblock_init(void)
  * WARNING:
  * Memblock is meant for early allocation & returns a Physical Address.
  * Please use with cautiously.
+ *
+ * Takes the memory from the first region with enough room left below
+ * ZONE_NORMAL, so the kernel can reach it through the direct map. Requests of
+ * a page or more are page-aligned.
  */
 void* memblock(size_t num_bytes)
 {
@@ -55,13 +197,20 @@ void* memblock(size_t num_bytes)
         return NULL;
     }
 
-    void* new_heap_end = (void*)((u32)next_free_addr + num_bytes);
-    if (new_heap_end > heap_end_addr) {
-        return NULL;
-    }
+    u32 align = num_bytes >= PAGE_SIZE ? PAGE_SIZE : sizeof(u32);
 
-    void* ptr = next_free_addr;
-    next_free_addr = (void*)((u32)next_free_addr + num_bytes);
+    for (u32 i = 0; i < region_count; i += 1) {
+        memblock_region_t* r = &regions[i];
+        u64 addr = ALIGN(r->base, (u64)align);
+        u64 end = min(r->end, (u64)ZONE_NORMAL);
+
+        if (addr >= end || end - addr < num_bytes) {
+            continue;
+        }
+
+        r->base = addr + num_bytes;
+        return (void*)(u32)addr;
+    }
 
-    return ptr;
+    return NULL;
 }
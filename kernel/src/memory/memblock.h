@@ -1,16 +1,50 @@
 #ifndef MEMBLOCK_H
 #define MEMBLOCK_H
 
+#include "arch/x86/multiboot.h"
+
 #include <types.h>
 #include <stdbool.h>
 
-void memblock_init(void);
+#define MEMBLOCK_MAX_REGIONS 32
+/* Frame numbers of everything below stay within 32 bits */
+#define MEMBLOCK_MAX_ADDR (1ULL << 44)
+
+/*
+ * A page-aligned range [base, end) of usable physical memory, which may lie
+ * above 4 GB.
+ */
+typedef struct memblock_region {
+    u64 base;
+    u64 end;
+} memblock_region_t;
+
+/**
+ * Builds the region list from every MULTIBOOT_MEMORY_AVAILABLE entry of the
+ * memory map, minus the kernel image, the multiboot data and the zero page.
+ */
+void memblock_init(multiboot_info_t* mbd);
 
 void* memblock(size_t);
 
-void* get_next_free_addr(void);
+/**
+ * Takes [base, base + size) out of the region list, page-aligned outwards.
+ */
+void memblock_reserve(paddr_t base, size_t size);
+
+u32 memblock_region_count(void);
+
+/**
+ * Returns the i-th free region, lowest address first. What memblock() handed
+ * out is no longer part of it.
+ */
+memblock_region_t const* memblock_get_region(u32 i);
 
-void* get_heap_end_addr(void);
+/**
+ * Returns the frame number past the highest usable page the memory map
+ * reported.
+ */
+u32 memblock_end_pfn(void);
 
 void memblock_deactivate(void);
 void memblock_activate(void);
@@ -0,0 +1,107 @@
+#include "memory/meminfo.h"
+#include "arch/x86/io.h"
+#include "memory/buddy_allocator/buddy.h"
+#include "memory/consts.h"
+#include "memory/filemap.h"
+#include "memory/slab.h"
+#include "memory/swap.h"
+#include "memory/vmalloc.h"
+#include "memory/vmm.h"
+#include "sys/process/process.h"
+
+#include <ferrite/string.h>
+#include <types.h>
+
+/* Private */
+
+static void meminfo_buddy(struct meminfo* info)
+{
+    bool irq = irq_save();
+
+    info->highmem_total = buddy_get_zone_pages(BUDDY_ZONE_HIGHMEM);
+    info->highmem_free = buddy_get_zone_free_pages(BUDDY_ZONE_HIGHMEM);
+    info->total = buddy_get_zone_pages(BUDDY_ZONE_NORMAL) + info->highmem_total;
+    info->free = buddy_get_free_pages();
+
+    for (u32 order = 0; order < MEMINFO_NR_ORDERS; order += 1) {
+        info->free_blocks[order] = buddy_get_free_blocks(order);
+    }
+    irq_restore(irq);
+
+    /*
+     * Unusable free space index: everything in blocks below `order` is free
+     * but cannot serve an allocation of that order.
+     */
+    u32 unusable = 0;
+    for (u32 order = 0; order < MEMINFO_NR_ORDERS; order += 1) {
+        info->frag_index[order] = info->free
+            ? (u32)(((u64)unusable * 1000) / info->free)
+            : 0;
+        unusable += info->free_blocks[order] << order;
+    }
+}
+
+static void meminfo_slab(struct meminfo* info)
+{
+    for (kmem_cache_t const* c = kmem_cache_list(); c; c = c->c_next) {
+        info->slab_pages += c->c_nr_slabs;
+        info->slab_objects += c->c_nr_active;
+        info->slab_capacity += c->c_nr_slabs * c->c_num;
+        info->slab_bytes += c->c_nr_active * c->c_objsize;
+    }
+}
+
+static void meminfo_procs(struct meminfo* info)
+{
+    bool irq = irq_save();
+
+    for (proc_t const* p = proc_first(); p; p = p->proc_next) {
+        if (p->state == EMBRYO || p->state == ZOMBIE) {
+            continue;
+        }
+
+        if (info->nr_procs == MEMINFO_NR_PROCS) {
+            break;
+        }
+
+        struct meminfo_proc* mp = &info->procs[info->nr_procs];
+        mp->pid = p->pid;
+        mp->rss = p->pgdir ? vmm_pgdir_rss(p->pgdir) : 0;
+        mp->min_flt = p->mm.min_flt;
+        mp->maj_flt = p->mm.maj_flt;
+        memcpy(mp->name, p->name, sizeof(mp->name));
+        mp->name[sizeof(mp->name) - 1] = '\0';
+
+        info->nr_procs += 1;
+    }
+
+    irq_restore(irq);
+}
+
+/* Public */
+
+void meminfo_get(struct meminfo* info)
+{
+    swap_stats_t swap;
+    u32 vtotal, vused, vlargest;
+
+    memset(info, 0, sizeof(struct meminfo));
+    info->page_size = PAGE_SIZE;
+
+    meminfo_buddy(info);
+    meminfo_slab(info);
+
+    vmalloc_get_stats(&vtotal, &vused, &vlargest);
+    info->vmalloc_total = vtotal;
+    info->vmalloc_used = vused;
+    info->vmalloc_largest_free = vlargest;
+
+    info->page_tables = vmm_pt_pages();
+    info->page_cache = filemap_nr_pages();
+
+    swap_get_stats(&swap);
+    info->swap_total = swap.total;
+    info->swap_free = swap.total - swap.used;
+
+    meminfo_procs(info);
+}
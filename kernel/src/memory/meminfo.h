@@ -0,0 +1,13 @@
+#ifndef MEMINFO_H
+#define MEMINFO_H
+
+#include <uapi/meminfo.h>
+
+/**
+ * Fills in `info` from counters the allocators keep anyway. Only the
+ * resident set sizes walk page tables, one address space at a time, so
+ * polling it does not touch every frame like mem_map_dump().
+ */
+void meminfo_get(struct meminfo* info);
+
+#endif /* MEMINFO_H */
@@ -3,8 +3,8 @@
 
 #include <types.h>
 
-#define HEAP_START (void*)0xD0000000
-#define MAXIMUM_SLAB_ALLOCATION 16384
+/* The vmalloc area starts right above the direct map of ZONE_NORMAL */
+#define HEAP_START (void*)0xF8000000
 #define MAGIC 0xDEADBEEF
 
 /* Mask of the Flags variable in block_header struct */
@@ -13,15 +13,14 @@
 #define MEM_TYPE_KMALLOC 0x00
 #define MEM_TYPE_VMALLOC 0x01
 
-typedef struct free_list {
-    size_t size;
-    struct free_list* next;
-} free_list_t;
+/* Set on the header of a page that is carved into slab objects */
+#define MEM_SLAB 0x02
 
 typedef struct block_header {
     // Bitfield for memory block properties.
     // Bit 0: Allocator type (0 = kmalloc, 1 = vmalloc)
-    // Bits 1-7: Reserved for future use.
+    // Bit 1: Page belongs to the slab allocator
+    // Bits 2-7: Reserved for future use.
     u8 flags;
     size_t size;
     u32 magic;
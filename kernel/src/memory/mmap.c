@@ -0,0 +1,417 @@
+#include "memory/mmap.h"
+#include "arch/x86/memlayout.h"
+#include "lib/math.h"
+#include "memory/buddy_allocator/buddy.h"
+#include "memory/consts.h"
+#include "memory/filemap.h"
+#include "memory/page.h"
+#include "memory/swap.h"
+#include "memory/vma.h"
+#include "memory/vmm.h"
+#include "sys/file/file.h"
+
+#include <types.h>
+#include <uapi/errno.h>
+#include <uapi/mman.h>
+#include <uapi/stat.h>
+
+/* Private */
+
+static u32 prot_to_vm_flags(u32 prot)
+{
+    u32 flags = 0;
+
+    if (prot & PROT_READ) {
+        flags |= VM_READ;
+    }
+    if (prot & PROT_WRITE) {
+        flags |= VM_WRITE;
+    }
+    if (prot & PROT_EXEC) {
+        flags |= VM_EXEC;
+    }
+
+    return flags;
+}
+
+/*
+ * Turns a user range into page-aligned bounds below KERNBASE.
+ *
+ * @return 0 on success, -EINVAL if the range is unusable.
+ */
+static s32 user_range(u32 addr, u32 len, u32* end)
+{
+    if (addr & (PAGE_SIZE - 1) || len == 0) {
+        return -EINVAL;
+    }
+
+    u32 size = ALIGN(len, PAGE_SIZE);
+    if (size < len || addr >= KERNBASE || size > KERNBASE - addr) {
+        return -EINVAL;
+    }
+
+    *end = addr + size;
+    return 0;
+}
+
+/* Whether [addr, end) is neither mapped nor reserved for the heap or stack */
+static bool range_is_free(memory_t const* mm, u32 addr, u32 end)
+{
+    if (addr < IDENTITY_MAP_SIZE || end > KERNBASE - STACK_MAX_SIZE) {
+        return false;
+    }
+
+    if (addr < mm->heap_end && mm->heap_start < end) {
+        return false;
+    }
+
+    vm_area_t const* vma = vma_find(mm, addr);
+    return !vma || vma->vm_start >= end;
+}
+
+/*
+ * Picks an address for a new mapping: the hint if that range is free,
+ * otherwise the first gap above MMAP_BASE and the heap.
+ */
+static u32 get_unmapped_area(memory_t const* mm, u32 hint, u32 size)
+{
+    hint &= PAGE_MASK;
+    if (hint && hint + size > hint && range_is_free(mm, hint, hint + size)) {
+        return hint;
+    }
+
+    u32 addr = ALIGN(mm->heap_end, PAGE_SIZE);
+    if (addr < MMAP_BASE) {
+        addr = MMAP_BASE;
+    }
+
+    for (vm_area_t const* vma = vma_find(mm, addr); vma; vma = vma->vm_next) {
+        if (vma->vm_start >= addr + size) {
+            break;
+        }
+
+        if (vma->vm_end > addr) {
+            addr = vma->vm_end;
+        }
+    }
+
+    if (addr + size < addr || addr + size > KERNBASE - STACK_MAX_SIZE) {
+        return 0;
+    }
+
+    return addr;
+}
+
+/*
+ * Writes back the page mapped at `addr` if it belongs to a shared file
+ * mapping and was written to. The dirty bit moves from the page table entry
+ * to the page descriptor, so a write through another mapping is not lost
+ * either.
+ */
+static void sync_pte(vm_area_t const* vma, u32 addr, pte_t pte)
+{
+    if (vma->vm_type != VMA_FILE || !(vma->vm_flags & VM_SHARED)
+        || !buddy_manages_pfn(pte_pfn(pte))) {
+        return;
+    }
+
+    page_t* page = pfn_to_page(pte_pfn(pte));
+    if (pte & PTE_D) {
+        vmm_set_pte(addr, pte & ~(pte_t)PTE_D);
+        page->flags |= PG_dirty;
+    }
+
+    if (page->flags & PG_dirty) {
+        u32 offset = vma->vm_offset + (addr - vma->vm_start);
+        filemap_write_page(vma->vm_inode, offset, page);
+    }
+}
+
+/* Writes back and drops every page of `vma` in [start, end) */
+static void unmap_range(vm_area_t const* vma, u32 start, u32 end)
+{
+    for (u32 addr = start; addr < end; addr += PAGE_SIZE) {
+        pte_t pte = vmm_get_pte(addr);
+        if (pte_is_swap(pte)) {
+            swap_free(pte_swap_slot(pte));
+            vmm_set_pte(addr, 0);
+            continue;
+        }
+
+        if (!(pte & PTE_P)) {
+            continue;
+        }
+
+        sync_pte(vma, addr, pte);
+        vmm_set_pte(addr, 0);
+
+        if (buddy_manages_pfn(pte_pfn(pte))) {
+            put_page(pfn_to_page(pte_pfn(pte)));
+        }
+    }
+
+    vmm_flush_range(start, end);
+}
+
+/* Applies the permissions of `vma` to its pages that are already mapped */
+static void change_protection(vm_area_t const* vma)
+{
+    for (u32 addr = vma->vm_start; addr < vma->vm_end; addr += PAGE_SIZE) {
+        pte_t pte = vmm_get_pte(addr);
+        if (!(pte & PTE_P)) {
+            continue;
+        }
+
+        u32 flags = pte_flags(pte) & ~(PTE_U | PTE_W | PTE_NX);
+        if (vma->vm_flags & (VM_READ | VM_WRITE | VM_EXEC)) {
+            flags |= PTE_U;
+        }
+        if (!(vma->vm_flags & VM_EXEC)) {
+            flags |= PTE_NX;
+        }
+
+        /* Private pages may still be shared, let the fault handler decide */
+        if (vma->vm_flags & VM_WRITE) {
+            flags |= (flags & PTE_SHARED) ? PTE_W : PTE_COW;
+        }
+
+        vmm_set_pte(addr, pfn_pte(pte_pfn(pte), flags));
+    }
+}
+
+/*
+ * Whether [addr, end) is covered by areas without a gap.
+ */
+static bool range_is_mapped(memory_t const* mm, u32 addr, u32 end)
+{
+    for (vm_area_t const* vma = vma_find(mm, addr); addr < end;
+         vma = vma->vm_next) {
+        if (!vma || vma->vm_start > addr) {
+            return false;
+        }
+
+        addr = vma->vm_end;
+    }
+
+    return true;
+}
+
+/* Public */
+
+s32 do_mmap(
+    memory_t* mm,
+    u32 addr,
+    u32 len,
+    u32 prot,
+    u32 flags,
+    s32 fd,
+    u32 offset
+)
+{
+    u32 type = flags & MAP_TYPE;
+    if (type != MAP_SHARED && type != MAP_PRIVATE) {
+        return -EINVAL;
+    }
+
+    if (len == 0 || offset & (PAGE_SIZE - 1)) {
+        return -EINVAL;
+    }
+
+    u32 size = ALIGN(len, PAGE_SIZE);
+    if (size < len) {
+        return -ENOMEM;
+    }
+
+    u32 vm_flags = prot_to_vm_flags(prot);
+    if (type == MAP_SHARED) {
+        vm_flags |= VM_SHARED | VM_MAYWRITE;
+    }
+
+    vfs_inode_t* inode = NULL;
+    if (!(flags & MAP_ANONYMOUS)) {
+        file_t* file = fd_get(fd);
+        if (!file || !file->f_inode) {
+            return -EBADF;
+        }
+
+        if (!S_ISREG(file->f_inode->i_mode)) {
+            return -ENODEV;
+        }
+
+        if (!(file->f_mode & FMODE_READ)) {
+            return -EACCES;
+        }
+
+        if (type == MAP_SHARED && !(file->f_mode & FMODE_WRITE)) {
+            if (prot & PROT_WRITE) {
+                return -EACCES;
+            }
+
+            vm_flags &= ~VM_MAYWRITE;
+        }
+
+        inode = file->f_inode;
+    }
+
+    if (flags & MAP_FIXED) {
+        u32 end;
+        s32 retval = user_range(addr, len, &end);
+        if (retval < 0) {
+            return retval;
+        }
+
+        /* Page tables down there are the kernel's, shared by everyone */
+        if (addr < IDENTITY_MAP_SIZE) {
+            return -EPERM;
+        }
+
+        retval = do_munmap(mm, addr, len);
+        if (retval < 0) {
+            return retval;
+        }
+    } else {
+        addr = get_unmapped_area(mm, addr, size);
+        if (!addr) {
+            return -ENOMEM;
+        }
+    }
+
+    if (!vma_create(
+            mm, addr, addr + size, vm_flags, inode ? VMA_FILE : VMA_ANON,
+            inode, inode ? offset : 0
+        )) {
+        return -ENOMEM;
+    }
+
+    return (s32)addr;
+}
+
+s32 do_munmap(memory_t* mm, u32 addr, u32 len)
+{
+    u32 end;
+    s32 retval = user_range(addr, len, &end);
+    if (retval < 0) {
+        return retval;
+    }
+
+    vm_area_t* vma = vma_find(mm, addr);
+    while (vma && vma->vm_start < end) {
+        /* An empty heap has nothing to unmap and must stay for brk() */
+        if (vma->vm_start == vma->vm_end) {
+            vma = vma->vm_next;
+            continue;
+        }
+
+        if (vma->vm_start < addr) {
+            if (!vma_split(mm, vma, addr)) {
+                return -ENOMEM;
+            }
+
+            vma = vma->vm_next;
+            continue;
+        }
+
+        if (vma->vm_end > end && !vma_split(mm, vma, end)) {
+            return -ENOMEM;
+        }
+
+        vm_area_t* next = vma->vm_next;
+
+        unmap_range(vma, vma->vm_start, vma->vm_end);
+        if (vma->vm_inode) {
+            filemap_release(vma->vm_inode);
+        }
+
+        vma_unlink(mm, vma);
+        vma = next;
+    }
+
+    return 0;
+}
+
+s32 do_mprotect(memory_t* mm, u32 addr, u32 len, u32 prot)
+{
+    u32 end;
+    s32 retval = user_range(addr, len, &end);
+    if (retval < 0) {
+        return retval;
+    }
+
+    if (!range_is_mapped(mm, addr, end)) {
+        return -ENOMEM;
+    }
+
+    for (vm_area_t* vma = vma_find(mm, addr); vma && vma->vm_start < end;
+         vma = vma->vm_next) {
+        if ((prot & PROT_WRITE) && (vma->vm_flags & VM_SHARED)
+            && !(vma->vm_flags & VM_MAYWRITE)) {
+            return -EACCES;
+        }
+    }
+
+    vm_area_t* vma = vma_find(mm, addr);
+    while (vma && vma->vm_start < end) {
+        if (vma->vm_start < addr) {
+            if (!vma_split(mm, vma, addr)) {
+                return -ENOMEM;
+            }
+
+            vma = vma->vm_next;
+            continue;
+        }
+
+        if (vma->vm_end > end && !vma_split(mm, vma, end)) {
+            return -ENOMEM;
+        }
+
+        vma->vm_flags &= ~(VM_READ | VM_WRITE | VM_EXEC);
+        vma->vm_flags |= prot_to_vm_flags(prot);
+        change_protection(vma);
+
+        vma = vma->vm_next;
+    }
+
+    vmm_flush_range(addr, end);
+    return 0;
+}
+
+s32 do_msync(memory_t* mm, u32 addr, u32 len, u32 flags)
+{
+    if (flags & ~(MS_ASYNC | MS_INVALIDATE | MS_SYNC)) {
+        return -EINVAL;
+    }
+
+    u32 end;
+    s32 retval = user_range(addr, len, &end);
+    if (retval < 0) {
+        return retval;
+    }
+
+    if (!range_is_mapped(mm, addr, end)) {
+        return -ENOMEM;
+    }
+
+    /* There is no background writeback, so MS_ASYNC syncs right away too */
+    for (vm_area_t* vma = vma_find(mm, addr); vma && vma->vm_start < end;
+         vma = vma->vm_next) {
+        u32 start = vma->vm_start < addr ? addr : vma->vm_start;
+        u32 stop = vma->vm_end > end ? end : vma->vm_end;
+
+        for (u32 page = start; page < stop; page += PAGE_SIZE) {
+            pte_t pte = vmm_get_pte(page);
+            if (pte & PTE_P) {
+                sync_pte(vma, page, pte);
+            }
+        }
+    }
+
+    vmm_flush_range(addr, end);
+    return 0;
+}
+
+void exit_mmap(memory_t* mm)
+{
+    /* Never has to split an area, so this cannot fail */
+    do_munmap(mm, 0, KERNBASE);
+    vma_release_all(mm);
+}
@@ -0,0 +1,47 @@
+#ifndef MMAP_H
+#define MMAP_H
+
+#include "sys/process/process.h"
+
+#include <types.h>
+
+/* Where mmap() starts looking for room without a usable hint */
+#define MMAP_BASE 0x40000000
+
+/**
+ * Maps `len` bytes of anonymous memory or of the file open on `fd` into
+ * `mm`. Nothing is read until the pages are touched.
+ *
+ * @return The address of the mapping, or a negative errno. Addresses above
+ *         2 GB are negative too, compare against -4095 to tell them apart.
+ */
+s32 do_mmap(
+    memory_t* mm,
+    u32 addr,
+    u32 len,
+    u32 prot,
+    u32 flags,
+    s32 fd,
+    u32 offset
+);
+
+/**
+ * Removes every mapping in [addr, addr + len), writing dirty pages of shared
+ * file mappings back first.
+ */
+s32 do_munmap(memory_t* mm, u32 addr, u32 len);
+
+s32 do_mprotect(memory_t* mm, u32 addr, u32 len, u32 prot);
+
+/**
+ * Writes the dirty pages of the shared file mappings in [addr, addr + len)
+ * back to their files.
+ */
+s32 do_msync(memory_t* mm, u32 addr, u32 len, u32 flags);
+
+/**
+ * Unmaps every area of the current address space and frees the list.
+ */
+void exit_mmap(memory_t* mm);
+
+#endif /* MMAP_H */
@@ -1,31 +1,227 @@
+#include "memory/page.h"
+#include "arch/x86/io.h"
 #include "arch/x86/memlayout.h"
 #include "drivers/printk.h"
+#include "lib/stdlib.h"
 #include "memory/buddy_allocator/buddy.h"
 #include "memory/consts.h"
+#include "memory/filemap.h"
+#include "memory/highmem.h"
+#include "memory/memblock.h"
+#include "memory/swap.h"
+#include "memory/vmscan.h"
 
 #include <ferrite/string.h>
 #include <types.h>
 
+page_t* mem_map = NULL;
+u32 max_pfn = 0;
+
+static void* zero_pool[ZERO_POOL_SIZE];
+static u32 zero_pool_count = 0;
+static u32 zero_pool_hits = 0;
+static u32 zero_pool_misses = 0;
+
+/* Private */
+
+/* buddy_alloc() without the complaint, get_free_page() reclaims instead */
+static void* lowmem_alloc(void)
+{
+    page_t* page = buddy_alloc_zone(BUDDY_ZONE_NORMAL, 0);
+
+    return page ? (void*)page_to_phys(page) : NULL;
+}
+
+/* Public */
+
+/*
+ * Allocates the descriptor array for every frame below `end_pfn` from
+ * memblock. All frames start out reserved; buddy_init() clears the flag for
+ * the frames it takes over.
+ */
+void mem_map_init(u32 end_pfn)
+{
+    max_pfn = end_pfn;
+
+    paddr_t paddr = (paddr_t)memblock(max_pfn * sizeof(page_t));
+    if (!paddr) {
+        abort("Could not allocate mem_map");
+    }
+
+    mem_map = (page_t*)P2V_WO(paddr);
+    for (u32 pfn = 0; pfn < max_pfn; pfn += 1) {
+        mem_map[pfn].count = 0;
+        mem_map[pfn].order = 0;
+        mem_map[pfn].flags = PG_reserved;
+    }
+}
+
+/*
+ * Drops a reference to a block allocated from the buddy allocator and gives
+ * it back once the last user is gone.
+ */
+void put_page(page_t* page)
+{
+    if (page->flags & (PG_reserved | PG_buddy)) {
+        return;
+    }
+
+    if (page->count == 0) {
+        abort("put_page: page is not in use");
+    }
+
+    page->count -= 1;
+    if (page->count > 0) {
+        return;
+    }
+
+    lru_del(page);
+    buddy_free_pages(page_to_pfn(page), page->order);
+}
+
+void mem_map_dump(void)
+{
+    u32 reserved = 0, free = 0, used = 0, shared = 0;
+    u32 slab = 0, pagecache = 0, text = 0, dirty = 0, locked = 0;
+    u32 active = 0, inactive = 0;
+    swap_stats_t swap;
+
+    for (u32 pfn = 0; pfn < max_pfn; pfn += 1) {
+        page_t const* page = &mem_map[pfn];
+
+        if (page->flags & PG_reserved) {
+            reserved += 1;
+            continue;
+        }
+
+        if (page->flags & PG_buddy) {
+            free += 1 << page->order;
+            pfn += (1 << page->order) - 1;
+            continue;
+        }
+
+        if (page->count == 0) {
+            continue; // Tail of a multi-page block
+        }
+
+        used += 1 << page->order;
+        shared += page->count > 1;
+        slab += (page->flags & PG_slab) != 0;
+        pagecache += (page->flags & PG_pagecache) != 0;
+        text += (page->flags & PG_text) != 0;
+        dirty += (page->flags & PG_dirty) != 0;
+        locked += (page->flags & PG_locked) != 0;
+    }
+
+    printk("  Page States (%u frames):\n", max_pfn);
+    printk("    reserved:  %u\n", reserved);
+    printk("    free:      %u\n", free);
+    printk("    in use:    %u (%u shared)\n", used, shared);
+    printk("    slab:      %u\n", slab);
+    printk("    pagecache: %u (%u text)\n", pagecache, text);
+    printk("    dirty:     %u\n", dirty);
+    printk("    locked:    %u\n", locked);
+    printk(
+        "    zeroed:    %u pooled, %u hits, %u misses\n", zero_pool_count,
+        zero_pool_hits, zero_pool_misses
+    );
+
+    lru_get_stats(&active, &inactive);
+    swap_get_stats(&swap);
+    printk("    lru:       %u active, %u inactive\n", active, inactive);
+    printk(
+        "    swap:      %u/%u used, %u in, %u out\n", swap.used, swap.total,
+        swap.pswpin, swap.pswpout
+    );
+}
+
 /*
- * Allocates a single 4KB page from the buddy allocator, converts it to a
- * virtual address, zeros it, and returns the usable virtual address.
+ * Hands out a zeroed 4KB page. Pages cleared ahead of time by the idle loop
+ * are used first; otherwise one comes from the buddy allocator and is
+ * zeroed right here.
  */
 void* get_free_page(void)
 {
-    void* paddr = buddy_alloc(0);
+    bool irq = irq_save();
+    void* vaddr = NULL;
+
+    if (zero_pool_count > 0) {
+        zero_pool_count -= 1;
+        vaddr = zero_pool[zero_pool_count];
+        zero_pool_hits += 1;
+    } else {
+        zero_pool_misses += 1;
+    }
+    irq_restore(irq);
+
+    if (vaddr) {
+        return vaddr;
+    }
+
+    void* paddr = lowmem_alloc();
+
+    /* Unmapped page cache pages are only kept around while memory lasts */
+    if (!paddr && filemap_shrink() > 0) {
+        paddr = lowmem_alloc();
+    }
+
+    /* Then cold anonymous pages go out to swap */
+    while (!paddr && try_to_free_pages(BUDDY_ZONE_NORMAL, RECLAIM_BATCH) > 0) {
+        paddr = lowmem_alloc();
+    }
+
     if (!paddr) {
         return NULL;
     }
 
-    void* vaddr = (void*)P2V_WO((u32)paddr);
+    vaddr = (void*)P2V_WO((u32)paddr);
     memset(vaddr, 0, PAGE_SIZE);
 
     return vaddr;
 }
 
+void zero_pool_refill(void)
+{
+    for (u32 i = 0; i < ZERO_POOL_BATCH; i += 1) {
+        /* Leave the last free pages to whoever really needs them */
+        if (zero_pool_count >= ZERO_POOL_SIZE
+            || buddy_get_zone_free_pages(BUDDY_ZONE_NORMAL)
+                <= ZERO_POOL_SIZE) {
+            return;
+        }
+
+        void* paddr = buddy_alloc(0);
+        if (!paddr) {
+            return;
+        }
+
+        void* vaddr = (void*)P2V_WO((u32)paddr);
+        memset(vaddr, 0, PAGE_SIZE);
+
+        bool irq = irq_save();
+        if (zero_pool_count < ZERO_POOL_SIZE) {
+            zero_pool[zero_pool_count] = vaddr;
+            zero_pool_count += 1;
+            vaddr = NULL;
+        }
+        irq_restore(irq);
+
+        if (vaddr) {
+            free_page(vaddr);
+        }
+    }
+}
+
+void zero_pool_stats(u32* pooled, u32* hits, u32* misses)
+{
+    *pooled = zero_pool_count;
+    *hits = zero_pool_hits;
+    *misses = zero_pool_misses;
+}
+
 /*
- * Validates and frees a page-aligned virtual address by converting it back to
- * physical and returning it to the buddy allocator.
+ * Validates a page-aligned virtual address and drops a reference to it. The
+ * frame goes back to the buddy allocator when it was the last one.
  */
 void free_page(void* ptr)
 {
@@ -39,5 +235,40 @@ void free_page(void* ptr)
     }
 
     u32 paddr = V2P_WO((u32)ptr);
-    buddy_dealloc(paddr, 0);
+    if (!buddy_manages(paddr)) {
+        printk("free_page: ptr 0x%lx not managed\n", (unsigned long)ptr);
+        return;
+    }
+
+    put_page(phys_to_page(paddr));
+}
+
+page_t* alloc_highpage(bool zeroed)
+{
+    page_t* page = buddy_alloc_zone(BUDDY_ZONE_HIGHMEM, 0);
+
+    /* Lowmem, where the zeroed pool usually saves the clearing */
+    if (!page) {
+        void* vaddr = get_free_page();
+        if (vaddr) {
+            return virt_to_page(vaddr);
+        }
+
+        /* get_free_page() may have shrunk the page cache in highmem */
+        page = buddy_alloc_zone(BUDDY_ZONE_HIGHMEM, 0);
+        while (!page
+               && try_to_free_pages(BUDDY_ZONE_HIGHMEM, RECLAIM_BATCH) > 0) {
+            page = buddy_alloc_zone(BUDDY_ZONE_HIGHMEM, 0);
+        }
+
+        if (!page) {
+            return NULL;
+        }
+    }
+
+    if (zeroed) {
+        clear_highpage(page);
+    }
+
+    return page;
 }
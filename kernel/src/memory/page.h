@@ -1,8 +1,111 @@
 #ifndef PAGE_H
 #define PAGE_H
 
+#include "arch/x86/memlayout.h"
+#include "memory/consts.h"
+
+#include <stdbool.h>
+#include <types.h>
+
+/* page_t flags */
+#define PG_reserved (1 << 0) // Not managed by the buddy allocator
+#define PG_buddy (1 << 1)    // Head of a block on a buddy free list
+#define PG_slab (1 << 2)     // Carved into slab objects
+#define PG_pagecache (1 << 3)
+#define PG_dirty (1 << 4)
+#define PG_locked (1 << 5)
+#define PG_text (1 << 6) // Read-only file page kept cached after the last unmap
+#define PG_lru (1 << 7)  // Anonymous page on the reclaim lists, see vmscan.h
+
+/*
+ * One descriptor for every physical frame below the end of RAM, indexed by
+ * page frame number. Kept small on purpose: with 4 bytes per frame, 16 MB of
+ * RAM costs 16 KB of descriptors.
+ */
+typedef struct page {
+    u16 count; // Number of users; the frame is returned to the buddy at 0
+    u8 order;  // Order of the block this frame heads
+    u8 flags;
+} page_t;
+
+/* Zeroed frames kept ready for get_free_page() */
+#define ZERO_POOL_SIZE 32
+/* Frames zeroed per pass of the idle loop, so it still halts soon */
+#define ZERO_POOL_BATCH 4
+
+extern page_t* mem_map;
+extern u32 max_pfn;
+
+static inline bool pfn_valid(u32 pfn) { return pfn < max_pfn; }
+
+static inline page_t* pfn_to_page(u32 pfn) { return &mem_map[pfn]; }
+
+static inline u32 page_to_pfn(page_t const* page)
+{
+    return (u32)(page - mem_map);
+}
+
+static inline page_t* phys_to_page(paddr_t paddr)
+{
+    return pfn_to_page(paddr >> PAGE_SHIFT);
+}
+
+static inline page_t* virt_to_page(void const* vaddr)
+{
+    return phys_to_page(V2P_WO((u32)vaddr));
+}
+
+/* Only valid below 4 GB, use page_to_pfn() for frames that can be above */
+static inline paddr_t page_to_phys(page_t const* page)
+{
+    return (paddr_t)page_to_pfn(page) << PAGE_SHIFT;
+}
+
+/* Highmem frames have no kernel address, they have to be kmap()ed */
+static inline bool page_is_highmem(page_t const* page)
+{
+    return page_to_pfn(page) >= (ZONE_NORMAL >> PAGE_SHIFT);
+}
+
+/* Only valid for lowmem frames, see kmap() for the others */
+static inline void* page_address(page_t const* page)
+{
+    return (void*)P2V_WO(page_to_phys(page));
+}
+
+static inline u32 page_count(page_t const* page) { return page->count; }
+
+static inline void get_page(page_t* page) { page->count += 1; }
+
+void put_page(page_t* page);
+
+void mem_map_init(u32 end_pfn);
+
+void mem_map_dump(void);
+
 void* get_free_page(void);
 
+/**
+ * Zeroes up to ZERO_POOL_BATCH free frames into the pool. Called from the
+ * idle loop, so get_free_page() rarely has to clear a page itself.
+ */
+void zero_pool_refill(void);
+
+/**
+ * Reports how full the zeroed pool is and how often get_free_page() found
+ * a page in it (hits) or had to zero one itself (misses).
+ */
+void zero_pool_stats(u32* pooled, u32* hits, u32* misses);
+
 void free_page(void* ptr);
 
+/**
+ * Allocates a frame for memory the kernel only reaches through page tables
+ * or kmap(): user pages, the page cache and vmalloc(). Highmem is used first,
+ * so the direct-mapped frames are left to the kernel itself.
+ *
+ * @param zeroed Clear the frame, otherwise its content is undefined.
+ */
+page_t* alloc_highpage(bool zeroed);
+
 #endif /* PAGE_H */
@@ -7,6 +7,7 @@
 #include "memory/consts.h"
 #include "memory/vmm.h"
 
+#include <ferrite/string.h>
 #include <types.h>
 
 static u32 pmm_bitmap_size = 0;
@@ -19,7 +20,8 @@ static u32 get_total_memory(multiboot_info_t* mbd)
 
     for (u32 i = 0; i < mbd->mmap_length; i += sizeof(multiboot_mmap_t)) {
         multiboot_mmap_t* entry = (multiboot_mmap_t*)(mbd->mmap_addr + i);
-        if (entry->type == MULTIBOOT_MEMORY_AVAILABLE) {
+        /* The bitmap only covers the first 4 GB */
+        if (entry->type == MULTIBOOT_MEMORY_AVAILABLE && !entry->addr_high) {
             u32 block_end = entry->addr_low + entry->len_low;
             if (block_end > total_memory) {
                 total_memory = block_end;
@@ -30,6 +32,32 @@ static u32 get_total_memory(multiboot_info_t* mbd)
     return total_memory;
 }
 
+/*
+ * Marks the frames in [start, end) free, whole bytes at a time where the
+ * range allows it.
+ */
+static void pmm_clear_range(u32 start, u32 end)
+{
+    u32 first = start / PAGE_SIZE;
+    u32 last = end / PAGE_SIZE;
+
+    while (first < last && (first & 7)) {
+        pmm_clear_bit(first * PAGE_SIZE);
+        first += 1;
+    }
+
+    if (last - first >= 8) {
+        u32 bytes = (last - first) / 8;
+        memset((u8*)&pmm_bitmap[first / 8], 0, bytes);
+        first += bytes * 8;
+    }
+
+    while (first < last) {
+        pmm_clear_bit(first * PAGE_SIZE);
+        first += 1;
+    }
+}
+
 /* Public */
 
 void pmm_print_bit(u32 addr)
@@ -96,23 +124,16 @@ u32 pmm_get_first_addr(void)
 
 void* pmm_get_physaddr(void* vaddr)
 {
-    u32 pdindex = (u32)vaddr >> 22;
-    u32 ptindex = (u32)vaddr >> 12 & 0x03FF;
-    u32 offset = (u32)vaddr & 0xFFF;
-    u32 const* pd = (u32*)0xFFFFF000;
-
-    if (!(pd[pdindex] & PTE_P)) {
-        return 0;
-    }
-
-    u32* pt = (u32*)(0xFFC00000 + (pdindex * PAGE_SIZE));
-    if (!(pt[ptindex] & PTE_P)) {
+    pte_t entry = vmm_lookup((u32)vaddr);
+    if (!(entry & PTE_P)) {
         return 0;
     }
 
-    u32 phys_frame_addr = pt[ptindex] & ~0xFFF;
+    u32 offset_mask = entry & PTE_PS ? vmm_pt_span() - 1 : PAGE_SIZE - 1;
+    u64 paddr = (entry & PTE_ADDR_MASK & ~(u64)offset_mask)
+        + ((u32)vaddr & offset_mask);
 
-    return (void*)(phys_frame_addr + offset);
+    return (void*)(u32)paddr;
 }
 
 void pmm_init_from_map(multiboot_info_t* mbd)
@@ -129,9 +150,7 @@ void pmm_init_from_map(multiboot_info_t* mbd)
     printk("Kernel physical end: 0x%x\n", kernel_end);
     printk("first free page: 0x%x\n", first_free_page_paddr);
 
-    for (size_t i = 0; i < pmm_bitmap_size; i++) {
-        pmm_bitmap[i] = 0xFF;
-    }
+    memset((u8*)pmm_bitmap, 0xFF, pmm_bitmap_size);
 
     for (u32 i = 0; i < mbd->mmap_length; i += sizeof(multiboot_mmap_t)) {
         multiboot_mmap_t* entry = (multiboot_mmap_t*)(mbd->mmap_addr + i);
@@ -145,12 +164,14 @@ void pmm_init_from_map(multiboot_info_t* mbd)
             entry->len_low
         );
 
-        for (u32 p = 0; p < entry->len_low; p += PAGE_SIZE) {
-            u32 current_addr = entry->addr_low + p;
+        u32 start = ALIGN(entry->addr_low, PAGE_SIZE);
+        u32 end = (entry->addr_low + entry->len_low) & PAGE_MASK;
+        if (start < first_free_page_paddr) {
+            start = first_free_page_paddr;
+        }
 
-            if (current_addr >= first_free_page_paddr) {
-                pmm_clear_bit(current_addr);
-            }
+        if (start < end && end <= total_memory) {
+            pmm_clear_range(start, end);
         }
     }
 }
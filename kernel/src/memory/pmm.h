@@ -17,6 +17,7 @@ static inline void pmm_clear_bit(u32 addr)
     pmm_bitmap[byte] &= ~(1 << bit);
 }
 
+/* NULL if `vaddr` is not mapped. Frames above 4 GB come back truncated. */
 void* pmm_get_physaddr(void* vaddr);
 
 void pmm_init_from_map(multiboot_info_t*);
@@ -0,0 +1,254 @@
+#include "memory/slab.h"
+#include "arch/x86/memlayout.h"
+#include "drivers/printk.h"
+#include "lib/math.h"
+#include "lib/stdlib.h"
+#include "memory/buddy_allocator/buddy.h"
+#include "memory/consts.h"
+#include "memory/memory.h"
+#include "memory/page.h"
+
+#include <ferrite/string.h>
+#include <types.h>
+
+/*
+ * Caches are themselves allocated from a cache. This one is set up statically
+ * by kmem_cache_init() so that kmem_cache_create() has somewhere to allocate
+ * its first descriptor from.
+ */
+static kmem_cache_t cache_cache = { 0 };
+static kmem_cache_t* cache_chain = NULL;
+
+/* Private */
+
+static inline void slab_list_add(slab_t** head, slab_t* s)
+{
+    s->s_prev = NULL;
+    s->s_next = *head;
+    if (*head) {
+        (*head)->s_prev = s;
+    }
+    *head = s;
+}
+
+static inline void slab_list_del(slab_t** head, slab_t* s)
+{
+    if (s->s_prev) {
+        s->s_prev->s_next = s->s_next;
+    } else {
+        *head = s->s_next;
+    }
+
+    if (s->s_next) {
+        s->s_next->s_prev = s->s_prev;
+    }
+
+    s->s_prev = NULL;
+    s->s_next = NULL;
+}
+
+static inline slab_t* slab_of(void const* obj)
+{
+    return (slab_t*)((u32)obj & PAGE_MASK);
+}
+
+static void cache_setup(kmem_cache_t* c, char const* name, size_t size)
+{
+    memset(c, 0, sizeof(kmem_cache_t));
+    strlcpy(c->c_name, name, sizeof(c->c_name));
+
+    if (size < sizeof(void*)) {
+        size = sizeof(void*);
+    }
+
+    c->c_objsize = ALIGN(size, SLAB_ALIGN);
+    c->c_num = (PAGE_SIZE - SLAB_OBJ_OFFSET) / c->c_objsize;
+}
+
+static slab_t* slab_grow(kmem_cache_t* c)
+{
+    void* paddr = buddy_alloc(0);
+    if (!paddr) {
+        return NULL;
+    }
+
+    slab_t* s = (slab_t*)P2V_WO((u32)paddr);
+    virt_to_page(s)->flags |= PG_slab;
+    s->s_hdr.flags = MEM_TYPE_KMALLOC | MEM_SLAB;
+    s->s_hdr.size = PAGE_SIZE;
+    s->s_hdr.magic = MAGIC;
+
+    s->s_cache = c;
+    s->s_prev = NULL;
+    s->s_next = NULL;
+    s->s_inuse = 0;
+
+    char* obj = (char*)s + SLAB_OBJ_OFFSET;
+    s->s_freelist = obj;
+    for (u16 i = 0; i < c->c_num - 1; i += 1) {
+        *(void**)obj = obj + c->c_objsize;
+        obj += c->c_objsize;
+    }
+    *(void**)obj = NULL;
+
+    c->c_nr_slabs += 1;
+    return s;
+}
+
+static void slab_release(kmem_cache_t* c, slab_t* s)
+{
+    s->s_hdr.magic = 0;
+    c->c_nr_slabs -= 1;
+
+    buddy_dealloc(V2P_WO((u32)s), 0);
+}
+
+/* Public */
+
+kmem_cache_t* kmem_cache_list(void) { return cache_chain; }
+
+void kmem_cache_init(void)
+{
+    cache_setup(&cache_cache, "kmem_cache", sizeof(kmem_cache_t));
+
+    cache_cache.c_next = cache_chain;
+    cache_chain = &cache_cache;
+}
+
+/**
+ * @brief Creates a cache of equally sized objects.
+ *
+ * Objects are carved out of single pages, so `size` may not exceed
+ * SLAB_FIT(1). Anything bigger should go through kmalloc() instead.
+ *
+ * @return The new cache, or NULL on failure.
+ */
+kmem_cache_t* kmem_cache_create(char const* name, size_t size)
+{
+    if (!name || size == 0 || size > SLAB_FIT(1)) {
+        return NULL;
+    }
+
+    kmem_cache_t* c = kmem_cache_alloc(&cache_cache);
+    if (!c) {
+        return NULL;
+    }
+
+    cache_setup(c, name, size);
+
+    c->c_next = cache_chain;
+    cache_chain = c;
+
+    return c;
+}
+
+/*
+ * Releases every slab of the cache and the cache itself. All objects must
+ * have been freed by the caller.
+ */
+void kmem_cache_destroy(kmem_cache_t* c)
+{
+    if (!c || c == &cache_cache) {
+        return;
+    }
+
+    if (c->c_partial || c->c_full) {
+        printk("%s: cache %s still has objects in use\n", __func__, c->c_name);
+        return;
+    }
+
+    kmem_cache_shrink(c);
+
+    kmem_cache_t** it = &cache_chain;
+    while (*it && *it != c) {
+        it = &(*it)->c_next;
+    }
+    if (*it) {
+        *it = c->c_next;
+    }
+
+    kmem_cache_free(&cache_cache, c);
+}
+
+void* kmem_cache_alloc(kmem_cache_t* c)
+{
+    slab_t* s = c->c_partial;
+
+    if (!s) {
+        s = c->c_free;
+        if (s) {
+            slab_list_del(&c->c_free, s);
+        } else {
+            s = slab_grow(c);
+            if (!s) {
+                return NULL;
+            }
+        }
+
+        slab_list_add(&c->c_partial, s);
+    }
+
+    void* obj = s->s_freelist;
+    s->s_freelist = *(void**)obj;
+    s->s_inuse += 1;
+    c->c_nr_active += 1;
+
+    if (s->s_inuse == c->c_num) {
+        slab_list_del(&c->c_partial, s);
+        slab_list_add(&c->c_full, s);
+    }
+
+    return obj;
+}
+
+void kmem_cache_free(kmem_cache_t* c, void* obj)
+{
+    slab_t* s = slab_of(obj);
+    if (s->s_hdr.magic != MAGIC || !(s->s_hdr.flags & MEM_SLAB)) {
+        abort("kmem_cache_free: pointer is not a slab object");
+    }
+
+    if (s->s_cache != c) {
+        abort("kmem_cache_free: object freed to the wrong cache");
+    }
+
+    u32 offset = (u32)obj - ((u32)s + SLAB_OBJ_OFFSET);
+    if (offset % c->c_objsize != 0 || offset / c->c_objsize >= c->c_num) {
+        abort("kmem_cache_free: misaligned object");
+    }
+
+    if (s->s_inuse == c->c_num) {
+        slab_list_del(&c->c_full, s);
+        slab_list_add(&c->c_partial, s);
+    }
+
+    *(void**)obj = s->s_freelist;
+    s->s_freelist = obj;
+    s->s_inuse -= 1;
+    c->c_nr_active -= 1;
+
+    if (s->s_inuse > 0) {
+        return;
+    }
+
+    slab_list_del(&c->c_partial, s);
+
+    /* Keep a single empty slab around so alloc/free pairs do not bounce
+     * pages in and out of the buddy allocator. */
+    if (c->c_free) {
+        slab_release(c, s);
+        return;
+    }
+
+    slab_list_add(&c->c_free, s);
+}
+
+void kmem_cache_shrink(kmem_cache_t* c)
+{
+    while (c->c_free) {
+        slab_t* s = c->c_free;
+
+        slab_list_del(&c->c_free, s);
+        slab_release(c, s);
+    }
+}
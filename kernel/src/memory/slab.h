@@ -0,0 +1,65 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include "lib/math.h"
+#include "memory/consts.h"
+#include "memory/memory.h"
+
+#include <types.h>
+
+#define SLAB_NAME_LEN 16
+#define SLAB_ALIGN 8
+
+/*
+ * Every slab is exactly one page. The slab descriptor lives at the start of
+ * that page and begins with a block_header_t, so kfree() and ksize() can tell
+ * a slab object apart from a page-sized kmalloc() block by looking at the
+ * page the pointer falls in.
+ */
+typedef struct slab {
+    block_header_t s_hdr;
+
+    struct kmem_cache* s_cache;
+    struct slab* s_prev;
+    struct slab* s_next;
+
+    void* s_freelist; // First free object, free objects are chained in-place
+    u16 s_inuse;      // Number of objects handed out from this slab
+} slab_t;
+
+#define SLAB_OBJ_OFFSET ALIGN(sizeof(slab_t), SLAB_ALIGN)
+
+/* Largest object size that still fits `n` objects into one slab */
+#define SLAB_FIT(n) (((PAGE_SIZE - SLAB_OBJ_OFFSET) / (n)) & ~(SLAB_ALIGN - 1))
+
+typedef struct kmem_cache {
+    char c_name[SLAB_NAME_LEN];
+
+    size_t c_objsize; // Size of one object, rounded up to SLAB_ALIGN
+    u16 c_num;        // Objects per slab
+
+    slab_t* c_partial; // Slabs with both free and used objects
+    slab_t* c_full;    // Slabs without any free object
+    slab_t* c_free;    // Completely unused slabs, kept around to avoid churn
+
+    u32 c_nr_slabs;  // Slabs currently owned by this cache
+    u32 c_nr_active; // Objects currently handed out
+
+    struct kmem_cache* c_next;
+} kmem_cache_t;
+
+void kmem_cache_init(void);
+
+kmem_cache_t* kmem_cache_create(char const* name, size_t size);
+
+void kmem_cache_destroy(kmem_cache_t* cache);
+
+void* kmem_cache_alloc(kmem_cache_t* cache);
+
+void kmem_cache_free(kmem_cache_t* cache, void* obj);
+
+void kmem_cache_shrink(kmem_cache_t* cache);
+
+kmem_cache_t* kmem_cache_list(void);
+
+#endif /* SLAB_H */
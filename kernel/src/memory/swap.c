@@ -0,0 +1,184 @@
+#include "memory/swap.h"
+#include "drivers/block/device.h"
+#include "drivers/printk.h"
+#include "fs/mount.h"
+#include "lib/stdlib.h"
+#include "memory/consts.h"
+#include "memory/highmem.h"
+#include "memory/page.h"
+#include "memory/vmalloc.h"
+
+#include <ferrite/string.h>
+#include <types.h>
+
+/*
+ * The swap area is a whole disk cut into page-sized slots. Each slot has a
+ * reference count, one for every swap entry pointing at it, so fork() can
+ * share swapped out pages just like resident ones.
+ */
+static block_device_t* swap_device = NULL;
+static u8* swap_map = NULL;
+static u32 swap_slots = 0;
+static u32 swap_used = 0;
+static u32 swap_next = 1; // Where the search for a free slot starts
+
+static u32 swap_pswpin = 0;
+static u32 swap_pswpout = 0;
+
+/* Private */
+
+static inline u32 slot_sectors(void)
+{
+    return PAGE_SIZE / swap_device->d_sector_size;
+}
+
+static s32 swap_io(u32 slot, page_t* page, bool write)
+{
+    u32 count = slot_sectors();
+    u32 lba = slot * count;
+    void* buf = kmap(page);
+    s32 ret;
+
+    if (write) {
+        ret = swap_device->d_op->write(swap_device, lba, count, buf, PAGE_SIZE);
+    } else {
+        ret = swap_device->d_op->read(swap_device, lba, count, buf, PAGE_SIZE);
+    }
+
+    kunmap(page);
+    return ret;
+}
+
+/* Public */
+
+void swap_init(char const* cmdline)
+{
+    char const* param = strnstr(cmdline, "swap=", strlen(cmdline));
+    if (!param) {
+        return;
+    }
+
+    char device[32];
+    u32 len = 0;
+    param += 5;
+    while (param[len] && param[len] != ' ' && len < sizeof(device) - 1) {
+        device[len] = param[len];
+        len += 1;
+    }
+    device[len] = '\0';
+
+    parsed_device_t parsed = parse_device_path(device);
+    if (!parsed.valid) {
+        return;
+    }
+
+    block_device_t* d = get_device(parsed.dev);
+    if (!d || !d->d_op || !d->d_sector_size
+        || PAGE_SIZE % d->d_sector_size != 0) {
+        printk("swap: %s is not usable, running without swap\n", device);
+        return;
+    }
+
+    u32 slots = d->d_nr_sectors / (PAGE_SIZE / d->d_sector_size);
+    if (slots > SWAP_MAX_SLOTS) {
+        slots = SWAP_MAX_SLOTS;
+    }
+
+    if (slots < 2) {
+        printk("swap: %s is too small\n", device);
+        return;
+    }
+
+    swap_map = vmalloc(slots);
+    if (!swap_map) {
+        printk("swap: no memory for the slot map\n");
+        return;
+    }
+
+    memset(swap_map, 0, slots);
+    swap_device = d;
+    swap_slots = slots;
+
+    printk("swap: %s, %u KB\n", device, (slots - 1) * (PAGE_SIZE / 1024));
+}
+
+bool swap_enabled(void) { return swap_device != NULL; }
+
+u32 swap_alloc(void)
+{
+    if (!swap_device || swap_used == swap_slots - 1) {
+        return 0;
+    }
+
+    /* Next fit, so slots written one after the other end up adjacent */
+    for (u32 i = 0; i < swap_slots; i += 1) {
+        u32 slot = swap_next + i;
+        if (slot >= swap_slots) {
+            slot -= swap_slots - 1;
+        }
+
+        if (swap_map[slot] == 0) {
+            swap_map[slot] = 1;
+            swap_used += 1;
+            swap_next = slot + 1 < swap_slots ? slot + 1 : 1;
+            return slot;
+        }
+    }
+
+    return 0;
+}
+
+void swap_dup(u32 slot)
+{
+    if (slot == 0 || slot >= swap_slots || swap_map[slot] == 0) {
+        abort("swap_dup: slot is not in use");
+    }
+
+    if (swap_map[slot] == SWAP_MAP_MAX) {
+        abort("swap_dup: too many references");
+    }
+
+    swap_map[slot] += 1;
+}
+
+void swap_free(u32 slot)
+{
+    if (slot == 0 || slot >= swap_slots || swap_map[slot] == 0) {
+        abort("swap_free: slot is not in use");
+    }
+
+    swap_map[slot] -= 1;
+    if (swap_map[slot] == 0) {
+        swap_used -= 1;
+    }
+}
+
+s32 swap_write_page(u32 slot, page_t* page)
+{
+    if (swap_io(slot, page, true) < 0) {
+        printk("swap: write to slot %u failed\n", slot);
+        return -1;
+    }
+
+    swap_pswpout += 1;
+    return 0;
+}
+
+s32 swap_read_page(u32 slot, page_t* page)
+{
+    if (swap_io(slot, page, false) < 0) {
+        printk("swap: read from slot %u failed\n", slot);
+        return -1;
+    }
+
+    swap_pswpin += 1;
+    return 0;
+}
+
+void swap_get_stats(swap_stats_t* stats)
+{
+    stats->total = swap_slots > 0 ? swap_slots - 1 : 0;
+    stats->used = swap_used;
+    stats->pswpin = swap_pswpin;
+    stats->pswpout = swap_pswpout;
+}
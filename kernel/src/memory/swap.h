@@ -0,0 +1,51 @@
+#ifndef SWAP_H
+#define SWAP_H
+
+#include "memory/page.h"
+
+#include <stdbool.h>
+#include <types.h>
+
+/* A slot has to fit where a swap entry keeps it, above the low 12 bits */
+#define SWAP_MAX_SLOTS (1 << 20)
+
+/* References a single slot can take, one per address space sharing it */
+#define SWAP_MAP_MAX 0xFF
+
+typedef struct {
+    u32 total;   // Slots on the swap device
+    u32 used;    // Slots holding a page
+    u32 pswpin;  // Pages read back from swap
+    u32 pswpout; // Pages written out to swap
+} swap_stats_t;
+
+/**
+ * Uses the whole disk named by "swap=/dev/hdX" on the command line as swap
+ * area. Without the option, or if the disk is missing, the kernel runs
+ * without swap and reclaim can only drop clean page cache.
+ */
+void swap_init(char const* cmdline);
+
+bool swap_enabled(void);
+
+/**
+ * Reserves a free slot with a single reference.
+ *
+ * @return The slot, or 0 if swap is full or disabled. Slot 0 is never handed
+ *         out, so a swap entry is never 0.
+ */
+u32 swap_alloc(void);
+
+/* Takes another reference on `slot`, for a swap entry copied by fork() */
+void swap_dup(u32 slot);
+
+/* Drops a reference on `slot`, which is free again after the last one */
+void swap_free(u32 slot);
+
+s32 swap_write_page(u32 slot, page_t* page);
+
+s32 swap_read_page(u32 slot, page_t* page);
+
+void swap_get_stats(swap_stats_t* stats);
+
+#endif /* SWAP_H */
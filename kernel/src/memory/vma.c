@@ -0,0 +1,482 @@
+#include "memory/vma.h"
+#include "arch/x86/cpu.h"
+#include "arch/x86/memlayout.h"
+#include "lib/math.h"
+#include "lib/stdlib.h"
+#include "memory/consts.h"
+#include "memory/filemap.h"
+#include "memory/highmem.h"
+#include "memory/page.h"
+#include "memory/slab.h"
+#include "memory/swap.h"
+#include "memory/vmm.h"
+#include "memory/vmscan.h"
+
+#include <ferrite/string.h>
+#include <types.h>
+
+static kmem_cache_t* vma_cache = NULL;
+
+/* Private */
+
+static vm_area_t* vma_alloc(
+    u32 start,
+    u32 end,
+    u32 flags,
+    vma_type_e type,
+    vfs_inode_t* inode,
+    u32 offset
+)
+{
+    vm_area_t* vma = kmem_cache_alloc(vma_cache);
+    if (!vma) {
+        return NULL;
+    }
+
+    vma->vm_start = start;
+    vma->vm_end = end;
+    vma->vm_flags = flags;
+    vma->vm_type = type;
+    vma->vm_inode = inode;
+    vma->vm_offset = offset;
+    vma->vm_next = NULL;
+
+    if (inode) {
+        inode->i_count += 1;
+    }
+
+    return vma;
+}
+
+static void vma_free(vm_area_t* vma)
+{
+    if (vma->vm_inode) {
+        inode_put(vma->vm_inode);
+    }
+
+    kmem_cache_free(vma_cache, vma);
+}
+
+/*
+ * Lets the stack area grow down to `addr`, as long as it stays within
+ * STACK_MAX_SIZE and clear of the heap. vma_find() already guarantees that
+ * no other area lies in between. An access far below the stack pointer is
+ * a stray one and gets no stack.
+ */
+static s32 expand_stack(memory_t* mm, vm_area_t* vma, u32 addr, u32 sp)
+{
+    u32 start = addr & PAGE_MASK;
+
+    if (addr + STACK_FAULT_MARGIN < sp) {
+        return -1;
+    }
+
+    if (start < KERNBASE - STACK_MAX_SIZE || start < mm->heap_end) {
+        return -1;
+    }
+
+    vma->vm_start = start;
+    mm->stack_start = start;
+    return 0;
+}
+
+/* Page table flags for a page that belongs to this area alone */
+static u32 vma_pte_flags(vm_area_t const* vma)
+{
+    u32 flags = 0;
+
+    if (vma->vm_flags & (VM_READ | VM_WRITE | VM_EXEC)) {
+        flags |= PTE_U;
+    }
+    if (vma->vm_flags & VM_WRITE) {
+        flags |= PTE_W;
+    }
+    if (vma->vm_flags & VM_SHARED) {
+        flags |= PTE_SHARED;
+    }
+    if (!(vma->vm_flags & VM_EXEC)) {
+        flags |= PTE_NX;
+    }
+
+    return flags;
+}
+
+/*
+ * Looks up the page cache frame for `addr`. Shared and read-only areas map it
+ * as is. Writable private areas map it copy-on-write, or take a private copy
+ * right away when the fault is a write or the CPU would not catch the kernel
+ * writing to a read-only page.
+ */
+static page_t* filemap_fault(
+    vm_area_t const* vma,
+    u32 addr,
+    bool write,
+    u32* flags,
+    bool* major
+)
+{
+    u32 offset = vma->vm_offset + (addr - vma->vm_start);
+
+    page_t* page = filemap_get_page(vma->vm_inode, offset, major);
+    if (!page) {
+        return NULL;
+    }
+
+    if (vma->vm_flags & VM_SHARED) {
+        return page;
+    }
+
+    /* Text and read-only data: keep it cached for the next exec */
+    if (!(vma->vm_flags & VM_WRITE)) {
+        page->flags |= PG_text;
+        return page;
+    }
+
+    if (!write && cpu_has(X86_FEATURE_WP)) {
+        *flags = (*flags & ~PTE_W) | PTE_COW;
+        return page;
+    }
+
+    page_t* copy = alloc_highpage(false);
+    if (copy) {
+        copy_highpage(copy, page);
+    }
+
+    put_page(page);
+    return copy;
+}
+
+/*
+ * Backs the page at `addr` with a frame: zero-filled for anonymous memory,
+ * from the page cache for files.
+ */
+static s32 map_new_page(vm_area_t const* vma, u32 addr, bool write, bool* major)
+{
+    u32 flags = vma_pte_flags(vma);
+    page_t* page = NULL;
+
+    *major = false;
+    if (vma->vm_type == VMA_FILE) {
+        page = filemap_fault(vma, addr, write, &flags, major);
+    } else {
+        page = alloc_highpage(true);
+    }
+
+    if (!page) {
+        return -1;
+    }
+
+    if (vmm_map_pfn(page_to_pfn(page), (void*)addr, flags) < 0) {
+        put_page(page);
+        return -1;
+    }
+
+    /* Private anonymous memory is what reclaim can push out to swap */
+    if (!(vma->vm_flags & VM_SHARED)) {
+        lru_add(page, vmm_current_pgdir(), addr);
+    }
+
+    return 0;
+}
+
+/*
+ * Reads the page at `addr` back from swap. Every address space sharing the
+ * slot after a fork() gets its own copy, so the page can be mapped with the
+ * permissions of the area and the slot reference dropped right away.
+ */
+static s32 do_swap_page(memory_t* mm, vm_area_t const* vma, u32 addr, pte_t pte)
+{
+    u32 slot = pte_swap_slot(pte);
+
+    page_t* page = alloc_highpage(false);
+    if (!page) {
+        return -1;
+    }
+
+    if (swap_read_page(slot, page) < 0) {
+        put_page(page);
+        return -1;
+    }
+
+    /* Not present before, so not in the TLB either */
+    vmm_set_pte(addr, pfn_pte(page_to_pfn(page), vma_pte_flags(vma) | PTE_P));
+    swap_free(slot);
+
+    if (!(vma->vm_flags & VM_SHARED)) {
+        lru_add(page, vmm_current_pgdir(), addr);
+    }
+
+    mm->maj_flt += 1;
+    return 0;
+}
+
+/*
+ * Maps the missing page at `addr`, reading it back if it was swapped out. For
+ * files, the other missing pages of the surrounding FAULT_AROUND_PAGES window
+ * are brought in as well, so sequential access takes one fault per window
+ * instead of one per page.
+ */
+static s32 do_no_page(memory_t* mm, vm_area_t const* vma, u32 addr, bool write)
+{
+    bool major;
+
+    addr &= PAGE_MASK;
+    pte_t pte = vmm_get_pte(addr);
+    if (pte_is_swap(pte)) {
+        return do_swap_page(mm, vma, addr, pte);
+    }
+
+    if (map_new_page(vma, addr, write, &major) < 0) {
+        return -1;
+    }
+
+    if (major) {
+        mm->maj_flt += 1;
+    } else {
+        mm->min_flt += 1;
+    }
+
+    if (vma->vm_type != VMA_FILE) {
+        return 0;
+    }
+
+    u32 window = FAULT_AROUND_PAGES * PAGE_SIZE;
+    u32 start = addr & ~(window - 1);
+    u32 end = start + window;
+
+    if (start < vma->vm_start) {
+        start = vma->vm_start;
+    }
+    if (end > vma->vm_end) {
+        end = vma->vm_end;
+    }
+
+    for (u32 page = start; page < end; page += PAGE_SIZE) {
+        /* Present, or a private copy waiting in swap */
+        if (page == addr || vmm_get_pte(page) != 0) {
+            continue;
+        }
+
+        /* Only an optimisation, the page can still be faulted in later */
+        if (map_new_page(vma, page, false, &major) < 0) {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/* Public */
+
+void vma_init(void)
+{
+    vma_cache = kmem_cache_create("vm_area", sizeof(vm_area_t));
+    if (!vma_cache) {
+        abort("vma_init: could not create the vm_area cache");
+    }
+}
+
+vm_area_t* vma_find(memory_t const* mm, u32 addr)
+{
+    for (vm_area_t* vma = mm->mmap; vma; vma = vma->vm_next) {
+        if (vma->vm_end > addr) {
+            return vma;
+        }
+    }
+
+    return NULL;
+}
+
+bool vma_access_ok(memory_t const* mm, u32 addr, u32 size, bool write)
+{
+    u32 end = addr + size;
+    u32 need = write ? VM_WRITE : VM_READ | VM_EXEC;
+
+    if (!addr || end < addr || end > KERNBASE) {
+        return false;
+    }
+
+    while (addr < end) {
+        vm_area_t const* vma = vma_find(mm, addr);
+        if (!vma || vma->vm_start > addr || !(vma->vm_flags & need)) {
+            return false;
+        }
+        addr = vma->vm_end;
+    }
+
+    return true;
+}
+
+vm_area_t* vma_find_type(memory_t const* mm, vma_type_e type)
+{
+    for (vm_area_t* vma = mm->mmap; vma; vma = vma->vm_next) {
+        if (vma->vm_type == type) {
+            return vma;
+        }
+    }
+
+    return NULL;
+}
+
+vm_area_t* vma_create(
+    memory_t* mm,
+    u32 start,
+    u32 end,
+    u32 flags,
+    vma_type_e type,
+    vfs_inode_t* inode,
+    u32 offset
+)
+{
+    if ((start | end) & (PAGE_SIZE - 1) || start > end || end > KERNBASE) {
+        return NULL;
+    }
+
+    vm_area_t* prev = NULL;
+    vm_area_t* next = mm->mmap;
+    while (next && next->vm_start < start) {
+        prev = next;
+        next = next->vm_next;
+    }
+
+    if ((prev && prev->vm_end > start) || (next && next->vm_start < end)) {
+        return NULL;
+    }
+
+    vm_area_t* vma = vma_alloc(start, end, flags, type, inode, offset);
+    if (!vma) {
+        return NULL;
+    }
+
+    vma->vm_next = next;
+    if (prev) {
+        prev->vm_next = vma;
+    } else {
+        mm->mmap = vma;
+    }
+
+    mm->map_count += 1;
+    return vma;
+}
+
+s32 vma_resize(vm_area_t* vma, u32 end)
+{
+    if (end & (PAGE_SIZE - 1) || end < vma->vm_start || end > KERNBASE) {
+        return -1;
+    }
+
+    if (vma->vm_next && end > vma->vm_next->vm_start) {
+        return -1;
+    }
+
+    vma->vm_end = end;
+    return 0;
+}
+
+vm_area_t* vma_split(memory_t* mm, vm_area_t* vma, u32 addr)
+{
+    vm_area_t* upper = vma_alloc(
+        addr, vma->vm_end, vma->vm_flags, vma->vm_type, vma->vm_inode,
+        vma->vm_offset + (addr - vma->vm_start)
+    );
+    if (!upper) {
+        return NULL;
+    }
+
+    upper->vm_next = vma->vm_next;
+    vma->vm_next = upper;
+    vma->vm_end = addr;
+
+    mm->map_count += 1;
+    return upper;
+}
+
+void vma_unlink(memory_t* mm, vm_area_t* vma)
+{
+    vm_area_t** link = &mm->mmap;
+    while (*link && *link != vma) {
+        link = &(*link)->vm_next;
+    }
+
+    if (!*link) {
+        abort("vma_unlink: area is not on the list");
+    }
+
+    *link = vma->vm_next;
+    mm->map_count -= 1;
+    vma_free(vma);
+}
+
+s32 vma_copy_all(memory_t* dst, memory_t const* src)
+{
+    vm_area_t** link = &dst->mmap;
+
+    dst->mmap = NULL;
+    dst->map_count = 0;
+
+    for (vm_area_t const* vma = src->mmap; vma; vma = vma->vm_next) {
+        vm_area_t* copy = vma_alloc(
+            vma->vm_start, vma->vm_end, vma->vm_flags, vma->vm_type,
+            vma->vm_inode, vma->vm_offset
+        );
+        if (!copy) {
+            vma_release_all(dst);
+            return -1;
+        }
+
+        *link = copy;
+        link = &copy->vm_next;
+        dst->map_count += 1;
+    }
+
+    return 0;
+}
+
+void vma_release_all(memory_t* mm)
+{
+    vm_area_t* vma = mm->mmap;
+
+    while (vma) {
+        vm_area_t* next = vma->vm_next;
+        vma_free(vma);
+        vma = next;
+    }
+
+    mm->mmap = NULL;
+    mm->map_count = 0;
+}
+
+s32 handle_mm_fault(memory_t* mm, u32 addr, u32 error_code, u32 sp)
+{
+    vm_area_t* vma = vma_find(mm, addr);
+    if (!vma) {
+        return -1;
+    }
+
+    if (vma->vm_start > addr) {
+        if (!(vma->vm_flags & VM_GROWSDOWN)
+            || expand_stack(mm, vma, addr, sp) < 0) {
+            return -1;
+        }
+    }
+
+    if (error_code & PF_WRITE) {
+        if (!(vma->vm_flags & VM_WRITE)) {
+            return -1;
+        }
+    } else if (!(vma->vm_flags & (VM_READ | VM_EXEC))) {
+        return -1;
+    }
+
+    if (!(error_code & PF_PRESENT)) {
+        return do_no_page(mm, vma, addr, error_code & PF_WRITE);
+    }
+
+    /* The page is there, so only a write to a shared frame is legitimate */
+    if ((error_code & PF_WRITE) && vmm_handle_cow(addr) == 0) {
+        mm->min_flt += 1;
+        return 0;
+    }
+
+    return -1;
+}
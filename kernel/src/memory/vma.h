@@ -0,0 +1,125 @@
+#ifndef VMA_H
+#define VMA_H
+
+#include "fs/vfs.h"
+#include "sys/process/process.h"
+
+#include <types.h>
+
+/* vm_flags */
+#define VM_READ (1 << 0)
+#define VM_WRITE (1 << 1)
+#define VM_EXEC (1 << 2)
+#define VM_SHARED (1 << 3)
+#define VM_GROWSDOWN (1 << 4) // Stack: faults just below vm_start extend it
+#define VM_MAYWRITE (1 << 5)  // VM_WRITE may be turned on by mprotect()
+
+/* How far the stack may grow below KERNBASE */
+#define STACK_MAX_SIZE (8 * 1024 * 1024)
+/*
+ * How far below the stack pointer a fault still grows the stack: enter can
+ * touch up to 64 KB below it, pusha 32 bytes.
+ */
+#define STACK_FAULT_MARGIN (65536 + 32 * sizeof(u32))
+
+/* Pages mapped together on a fault in a file-backed area */
+#define FAULT_AROUND_PAGES 4
+
+typedef enum { VMA_ANON, VMA_FILE, VMA_STACK, VMA_HEAP } vma_type_e;
+
+/*
+ * A contiguous, page-aligned range [vm_start, vm_end) of a user address space
+ * with the same permissions and backing. The areas of a process are kept on
+ * a singly linked list sorted by address and never overlap.
+ */
+typedef struct vm_area {
+    u32 vm_start;
+    u32 vm_end;
+    u32 vm_flags;
+    vma_type_e vm_type;
+
+    vfs_inode_t* vm_inode; // Backing file of a VMA_FILE area
+    u32 vm_offset;         // File offset of vm_start, page-aligned
+
+    struct vm_area* vm_next;
+} vm_area_t;
+
+void vma_init(void);
+
+/**
+ * Returns the first area that ends above `addr`, or NULL. The area does not
+ * necessarily contain `addr`; check vm_start.
+ */
+vm_area_t* vma_find(memory_t const* mm, u32 addr);
+
+/**
+ * Whether [addr, addr + size) lies in user space and is covered by areas
+ * that may be read, or written if `write` is set. System calls check user
+ * pointers with it before touching them, a bad pointer would otherwise
+ * fault in kernel mode.
+ */
+bool vma_access_ok(memory_t const* mm, u32 addr, u32 size, bool write);
+
+/**
+ * Returns the first area of the given type, or NULL.
+ */
+vm_area_t* vma_find_type(memory_t const* mm, vma_type_e type);
+
+/**
+ * Adds the area [start, end) to `mm`. File-backed areas take a reference on
+ * `inode`.
+ *
+ * @return The new area, or NULL if it overlaps an existing one or there is no
+ *         memory left.
+ */
+vm_area_t* vma_create(
+    memory_t* mm,
+    u32 start,
+    u32 end,
+    u32 flags,
+    vma_type_e type,
+    vfs_inode_t* inode,
+    u32 offset
+);
+
+/**
+ * Moves the end of `vma` to `end`. Fails with -1 if that would run into the
+ * next area.
+ */
+s32 vma_resize(vm_area_t* vma, u32 end);
+
+/**
+ * Splits `vma` at the page-aligned `addr` and returns the upper half.
+ */
+vm_area_t* vma_split(memory_t* mm, vm_area_t* vma, u32 addr);
+
+/**
+ * Takes `vma` off the list of `mm` and frees it. Its pages must already be
+ * unmapped.
+ */
+void vma_unlink(memory_t* mm, vm_area_t* vma);
+
+/**
+ * Gives `dst` its own copy of every area of `src`.
+ *
+ * @return 0 on success, -1 if out of memory. `dst` is left empty on failure.
+ */
+s32 vma_copy_all(memory_t* dst, memory_t const* src);
+
+/**
+ * Frees every area of `mm`. The pages mapped in them are not touched.
+ */
+void vma_release_all(memory_t* mm);
+
+/**
+ * Resolves a page fault at `addr` in the current address space against the
+ * areas of `mm`: missing pages are filled in, stack areas grow down and
+ * writes to copy-on-write pages are resolved.
+ *
+ * @param sp The user stack pointer. The stack only grows for faults within
+ *           STACK_FAULT_MARGIN below it.
+ * @return   0 if the fault was handled, -1 if the access is not allowed.
+ */
+s32 handle_mm_fault(memory_t* mm, u32 addr, u32 error_code, u32 sp);
+
+#endif /* VMA_H */
@@ -4,121 +4,190 @@
 #include "lib/stdlib.h"
 #include "memory/buddy_allocator/buddy.h"
 #include "memory/consts.h"
+#include "memory/kmemtrace.h"
 #include "memory/memory.h"
+#include "memory/slab.h"
 #include "memory/vmm.h"
 
 #include <types.h>
 
-static free_list_t* virtual_free_list_head = NULL;
+static kmem_cache_t* extent_cache = NULL;
+static vm_extent_t* free_extents = NULL;
+static u32 vmalloc_size = 0;
 
-/* Public */
+/* Private */
 
-free_list_t* get_free_list_head(void) { return virtual_free_list_head; }
+/*
+ * Takes `size` bytes from the first free extent large enough, first fit.
+ *
+ * @return The start of the range, or 0 if the area is exhausted.
+ */
+static u32 vmalloc_reserve(u32 size)
+{
+    vm_extent_t** link = &free_extents;
 
-void set_free_list_head(free_list_t* list) { virtual_free_list_head = list; }
+    while (*link && (*link)->size < size) {
+        link = &(*link)->next;
+    }
 
-void vmalloc_init(void)
-{
-    u32 heap_start_addr = (u32)HEAP_START;
+    vm_extent_t* extent = *link;
+    if (!extent) {
+        return 0;
+    }
 
-    void* first_page_phys = buddy_alloc(0);
-    if (!first_page_phys) {
-        abort("Not enough physical memory to start the heap!");
+    u32 start = extent->start;
+    extent->start += size;
+    extent->size -= size;
+
+    if (extent->size == 0) {
+        *link = extent->next;
+        kmem_cache_free(extent_cache, extent);
     }
 
-    s32 ret = vmm_map_page(first_page_phys, (void*)heap_start_addr, 0);
-    if (ret < 0) {
-        printk("Should not be possible\n");
+    return start;
+}
+
+/* Public */
+
+void vmalloc_init(void)
+{
+    extent_cache = kmem_cache_create("vmalloc_extent", sizeof(vm_extent_t));
+    if (!extent_cache) {
+        abort("vmalloc_init: could not create the extent cache");
     }
 
-    size_t max_virtual_size = 0xFFFFFFFF - heap_start_addr;
+    u32 heap_start_addr = (u32)HEAP_START;
+    size_t max_virtual_size = KMAP_BASE - heap_start_addr;
     size_t total_physical_memory = buddy_get_total_memory();
 
     size_t heap_size = max_virtual_size;
     if (total_physical_memory < heap_size) {
         heap_size = total_physical_memory;
     }
+    heap_size &= PAGE_MASK;
+
+    if (heap_size < 2 * PAGE_SIZE) {
+        abort("Not enough memory to start the heap");
+    }
+
+    /*
+     * Page directories copy the kernel half when a process is created, so
+     * page tables added later would only show up in the current one.
+     */
+    for (u32 addr = heap_start_addr; addr - heap_start_addr < heap_size;
+         addr += vmm_pt_span()) {
+        vmm_alloc_pt(addr);
+    }
+
+    free_extents = kmem_cache_alloc(extent_cache);
+    if (!free_extents) {
+        abort("vmalloc_init: out of memory");
+    }
+
+    free_extents->start = heap_start_addr;
+    free_extents->size = heap_size;
+    free_extents->next = NULL;
+    vmalloc_size = heap_size;
+}
+
+void vmalloc_release(u32 start, u32 size)
+{
+    vm_extent_t* prev = NULL;
+    vm_extent_t* next = free_extents;
+
+    while (next && next->start < start) {
+        prev = next;
+        next = next->next;
+    }
+
+    if ((prev && prev->start + prev->size > start)
+        || (next && start + size > next->start)) {
+        abort("vmalloc_release: range is already free");
+    }
+
+    bool merge_prev = prev && prev->start + prev->size == start;
+    bool merge_next = next && start + size == next->start;
+
+    if (merge_prev && merge_next) {
+        prev->size += size + next->size;
+        prev->next = next->next;
+        kmem_cache_free(extent_cache, next);
+        return;
+    }
+
+    if (merge_prev) {
+        prev->size += size;
+        return;
+    }
+
+    if (merge_next) {
+        next->start = start;
+        next->size += size;
+        return;
+    }
+
+    vm_extent_t* extent = kmem_cache_alloc(extent_cache);
+    if (!extent) {
+        /* The range is lost, but the rest of the area stays consistent */
+        printk("vmalloc_release: lost %u bytes at 0x%x\n", size, start);
+        return;
+    }
+
+    extent->start = start;
+    extent->size = size;
+    extent->next = next;
+
+    if (prev) {
+        prev->next = extent;
+    } else {
+        free_extents = extent;
+    }
+}
 
-    if (heap_size < sizeof(free_list_t)) {
-        abort("Not enough memory to allocate a free_list");
+void vmalloc_get_stats(u32* total, u32* used, u32* largest_free)
+{
+    u32 free = 0;
+
+    *largest_free = 0;
+    for (vm_extent_t const* e = free_extents; e; e = e->next) {
+        free += e->size;
+        *largest_free = max(*largest_free, e->size);
     }
 
-    virtual_free_list_head = (free_list_t*)HEAP_START;
-    virtual_free_list_head->size = heap_size;
-    virtual_free_list_head->next = NULL;
+    *total = vmalloc_size;
+    *used = vmalloc_size - free;
 }
 
 /**
- * FIXME: We might be able to do this with one
- * less buddy_alloc at the beginning
- *
  * @brief Allocates a virtually contiguous memory block.
  *
  * Slower than kmalloc. Used to allocate large memory regions that do not need
- * to be physically contiguous, such as for kernel modules.
+ * to be physically contiguous, such as for kernel modules. Every block is
+ * followed by an unmapped guard page, so running off its end faults.
  *
  * @param n The number of bytes to allocate.
  * @return A pointer to the allocated memory, or NULL on failure.
  */
 void* vmalloc(size_t n)
 {
-    if (n == 0 || !virtual_free_list_head) {
+    if (n == 0 || !extent_cache) {
         return NULL;
     }
 
     size_t total_size = ALIGN(n + sizeof(block_header_t), PAGE_SIZE);
-    free_list_t* current = virtual_free_list_head;
-    free_list_t* prev = NULL;
-    while (current) {
-        if (current->size >= total_size) {
-            break;
-        }
-        prev = current;
-        current = current->next;
-    }
-
-    if (!current) {
-        printk("Not enough Memory");
+    if (total_size < n) {
         return NULL;
     }
 
-    u32 vaddr = (u32)current;
-    if (current->size - total_size > sizeof(free_list_t)) {
-        free_list_t* new_free_node = (free_list_t*)(vaddr + total_size);
-
-        void* header_paddr = buddy_alloc(0);
-        if (!header_paddr) {
-            abort("Out of physical memory while splitting block!");
-        }
-
-        s32 ret = vmm_map_page(header_paddr, (void*)new_free_node, 0);
-        if (ret < 0) {
-            printk("Page already exists\n");
-        }
-
-        new_free_node->size = current->size - total_size;
-        new_free_node->next = current->next;
-
-        if (!prev) {
-            virtual_free_list_head = new_free_node;
-        } else {
-            prev->next = new_free_node;
-        }
-    } else {
-        if (!prev) {
-            virtual_free_list_head = current->next;
-        } else {
-            prev->next = current->next;
-        }
+    u32 vaddr = vmalloc_reserve(total_size + PAGE_SIZE);
+    if (!vaddr) {
+        printk("vmalloc: out of virtual address space\n");
+        return NULL;
     }
 
-    for (size_t i = 0; i < total_size / PAGE_SIZE; i += 1) {
-        void* paddr = buddy_alloc(0);
-        if (!paddr) {
-            abort("Out of physical memory during mapping");
-        }
-
-        vmm_map_page(paddr, (void*)(vaddr + (i * PAGE_SIZE)), 0);
+    if (vmm_map_range(NULL, (void*)vaddr, total_size, PTE_NX | PTE_W) < 0) {
+        vmalloc_release(vaddr, total_size + PAGE_SIZE);
+        return NULL;
     }
 
     block_header_t* header = (block_header_t*)vaddr;
@@ -126,5 +195,8 @@ void* vmalloc(size_t n)
     header->size = total_size;
     header->flags = MEM_TYPE_VMALLOC;
 
+    kmemtrace_alloc(
+        header + 1, n, __builtin_return_address(0), KMEMTRACE_VMALLOC
+    );
     return (void*)(header + 1);
 }
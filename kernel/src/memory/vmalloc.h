@@ -3,6 +3,16 @@
 
 #include "memory/memory.h"
 
+/*
+ * A free range of the vmalloc area. The extents live outside the area in a
+ * slab cache, sorted by address, and neighbours are merged when freed.
+ */
+typedef struct vm_extent {
+    u32 start;
+    u32 size;
+    struct vm_extent* next;
+} vm_extent_t;
+
 size_t vsize(void* ptr);
 
 void vfree(void* ptr);
@@ -11,8 +21,16 @@ void* vmalloc(size_t);
 
 void vmalloc_init(void);
 
-free_list_t* get_free_list_head(void);
-
-void set_free_list_head(free_list_t*);
+/**
+ * Gives the range [start, start + size) back to the vmalloc area, merging it
+ * with the free extents around it. Its pages must already be unmapped.
+ */
+void vmalloc_release(u32 start, u32 size);
+
+/**
+ * Bytes of address space in the vmalloc area, those in use, guard pages
+ * included, and the largest free range, which bounds the next vmalloc().
+ */
+void vmalloc_get_stats(u32* total, u32* used, u32* largest_free);
 
 #endif /* VMALLOC_H */
@@ -1,4 +1,6 @@
 #include "memory/vmm.h"
+#include "arch/x86/cpu.h"
+#include "arch/x86/io.h"
 #include "arch/x86/memlayout.h"
 #include "drivers/printk.h"
 #include <ferrite/string.h>
@@ -7,40 +9,183 @@
 #include "lib/stdlib.h"
 #include "memory/buddy_allocator/buddy.h"
 #include "memory/consts.h"
+#include "memory/highmem.h"
 #include "memory/memblock.h"
 #include "memory/pmm.h"
-#include "page.h"
+#include "memory/page.h"
+#include "memory/swap.h"
+#include "memory/vmscan.h"
 
-/* i386 does not support invld. Using flush_tlb() instead
+/* The i386 has no invlpg, flush_tlb() reloads CR3 there instead
  * https://wiki.osdev.org/TLB
  */
 extern void flush_tlb(void);
+
+/* Above this many pages, one CR3 reload is cheaper than invlpg per page */
+#define INVLPG_MAX_PAGES 32
 extern void load_page_directory(u32*);
 extern void enable_paging(void);
+extern void enable_pae(u32 pdpt_paddr);
 
+/*
+ * Recursive mappings of the current address space. Two-level paging points
+ * the last page directory entry back at the page directory. PAE points the
+ * last four entries of the fourth page directory at all four of them, which
+ * takes the top 8 MB.
+ */
+#define PT_WINDOW 0xFFC00000
+#define PD_WINDOW 0xFFFFF000
+#define PAE_PT_WINDOW 0xFF800000
+#define PAE_PD_WINDOW 0xFFFFC000
+
+/* PAE addresses 64 GB, 36 bits on every CPU that has it */
+#define PAE_MAX_PFN (1 << 24)
+
+/*
+ * The kernel's page directory. With PAE it holds the page directory pointer
+ * table in its first 32 bytes instead, the page directories come from
+ * memblock.
+ */
 u32 page_directory[1024] __attribute__((aligned(4096)));
 
-void visualize_paging(u32 limit_mb, u32 detailed_mb)
+static bool pae = false;
+static pte_t nx_bit = 0; // PTE_NX_BIT once EFER.NXE is on
+static u32 nr_pt_pages = 0; // Page tables and directories allocated so far
+
+/* Private */
+
+static inline u32 pde_shift(void) { return pae ? 21 : 22; }
+
+static inline u32 pt_entries(void) { return pae ? 512 : 1024; }
+
+/* The kernel half ends where the recursive mapping starts */
+static inline u32 pt_window(void) { return pae ? PAE_PT_WINDOW : PT_WINDOW; }
+
+static inline void* table_entry(void* table, u32 index)
 {
-    printk("--- Paging Visualization ---\n");
-    printk("Scanning up to %u MB of virtual address space.\n", limit_mb);
-    printk("'.' = Mapped Page (4KB) | ' ' = Unmapped Page | 'X' = Unmapped "
-           "Region (4MB)\n\n");
+    return (u8*)table + (index << (pae ? 3 : 2));
+}
+
+static inline pte_t entry_get(void const* entry)
+{
+    if (pae) {
+        return *(u64 const volatile*)entry;
+    }
+
+    return *(u32 const volatile*)entry;
+}
+
+/*
+ * PAE entries are written one half at a time. Clearing the low half first
+ * means the CPU never finds the present bit next to a half-written upper
+ * half.
+ */
+static inline void entry_set(void* entry, pte_t val)
+{
+    u32 volatile* half = entry;
+
+    if (!pae) {
+        half[0] = (u32)val;
+        return;
+    }
+
+    half[0] = 0;
+    half[1] = (u32)(val >> 32);
+    half[0] = (u32)val;
+}
+
+/* The page directory entry for `vaddr` in the current address space */
+static inline void* pde_ptr(u32 vaddr)
+{
+    if (pae) {
+        return (u64*)PAE_PD_WINDOW + (vaddr >> 21);
+    }
+
+    return (u32*)PD_WINDOW + (vaddr >> 22);
+}
+
+/* The page table entry for `vaddr`, its page table has to be present */
+static inline void* pte_ptr(u32 vaddr)
+{
+    if (pae) {
+        return (u64*)PAE_PT_WINDOW + (vaddr >> 12);
+    }
+
+    return (u32*)PT_WINDOW + (vaddr >> 12);
+}
+
+/*
+ * The page directory entry for `vaddr` in the address space `pgdir`, reached
+ * through the direct map so it need not be the current one.
+ */
+static void* pgdir_pde(u32* pgdir, u32 vaddr)
+{
+    if (!pae) {
+        return &pgdir[vaddr >> 22];
+    }
+
+    u64 const* pdpt = (u64 const*)pgdir;
+    u64* pd = (u64*)P2V_WO((u32)(pdpt[vaddr >> 30] & PTE_ADDR_MASK));
 
-    u32* page_directory = (u32*)0xFFFFF000;
-    u32 pd_limit = limit_mb / 4;
+    return &pd[vaddr >> 21 & 511];
+}
+
+static inline pte_t kernel_pde(u32 vaddr)
+{
+    return entry_get(pgdir_pde(page_directory, vaddr));
+}
+
+/* The entry for `vaddr` in the page table `pde` points to */
+static inline void* pt_entry(pte_t pde, u32 vaddr)
+{
+    void* pt = (void*)P2V_WO((u32)(pde & PTE_ADDR_MASK));
+
+    return table_entry(pt, vaddr >> 12 & (pt_entries() - 1));
+}
 
-    for (u32 pd_index = 0; pd_index < pd_limit; ++pd_index) {
-        u32 base_vaddr = pd_index * 0x400000; // 4 MB chunks
+/* Maps the page tables of `pgdir` into its own top end */
+static void vmm_set_recursive(u32* pgdir)
+{
+    if (!pae) {
+        pgdir[1023] = V2P_WO((u32)pgdir) | PTE_P | PTE_W;
+        return;
+    }
 
-        if (page_directory[pd_index] & PTE_P) {
-            printk("VAddr 0x%x - 0x%x: [", base_vaddr, base_vaddr + 0x3FFFFF);
+    u64 const* pdpt = (u64 const*)pgdir;
+    for (u32 i = 0; i < 4; i += 1) {
+        entry_set(
+            pgdir_pde(pgdir, PAE_PT_WINDOW + (i << 21)),
+            (pdpt[i] & PTE_ADDR_MASK) | PTE_W | PTE_P
+        );
+    }
+}
 
-            if ((pd_index * 4) < detailed_mb) {
-                u32* page_table = &((u32*)0xFFC00000)[pd_index * 1024];
+void visualize_paging(u32 limit_mb, u32 detailed_mb)
+{
+    u32 span = vmm_pt_span();
+    u32 span_mb = span >> 20;
 
-                for (int pt_index = 0; pt_index < 1024; ++pt_index) {
-                    if (page_table[pt_index] & PTE_P) {
+    printk("--- Paging Visualization ---\n");
+    printk("Scanning up to %u MB of virtual address space.\n", limit_mb);
+    printk(
+        "'.' = Mapped Page (4KB) | ' ' = Unmapped Page | 'X' = Unmapped "
+        "Region (%uMB)\n\n",
+        span_mb
+    );
+
+    for (u32 mb = 0; mb < limit_mb; mb += span_mb) {
+        u32 base_vaddr = mb << 20;
+        pte_t pde = entry_get(pde_ptr(base_vaddr));
+
+        if (pde & PTE_P) {
+            printk("VAddr 0x%x - 0x%x: [", base_vaddr, base_vaddr + span - 1);
+
+            if (pde & PTE_PS) {
+                printk("%u MB Page", span_mb);
+            } else if (mb < detailed_mb) {
+                for (u32 i = 0; i < pt_entries(); i += 1) {
+                    u32 vaddr = base_vaddr + (i * PAGE_SIZE);
+                    if (entry_get(pte_ptr(vaddr)) & PTE_P) {
                         printk(".");
                     } else {
                         printk(" ");
@@ -53,95 +198,480 @@ void visualize_paging(u32 limit_mb, u32 detailed_mb)
 
         } else {
             printk(
-                "VAddr 0x%x - 0x%x: [X]\n", base_vaddr, base_vaddr + 0x3FFFFF
+                "VAddr 0x%x - 0x%x: [X]\n", base_vaddr, base_vaddr + span - 1
             );
         }
 
-        if ((pd_index + 1) * 4 == detailed_mb) {
+        if (mb + span_mb == detailed_mb) {
             printk("\n--- End of Detailed View ---\n\n");
         }
     }
     printk("--- End of Visualization ---\n");
 }
 
+/* A zeroed page for a page table or directory */
+static void* pt_page_alloc(void)
+{
+    void* page = get_free_page();
+
+    if (page) {
+        nr_pt_pages += 1;
+    }
+
+    return page;
+}
+
+static void pt_page_free(void* page)
+{
+    nr_pt_pages -= 1;
+    free_page(page);
+}
+
+/*
+ * Frames mapped in on demand are only reached through the new mapping, so
+ * they can come from highmem. Returns 0, the reserved zero page, when memory
+ * ran out.
+ */
+static u32 vmm_alloc_frame(void)
+{
+    page_t* page = alloc_highpage(false);
+
+    return page ? page_to_pfn(page) : 0;
+}
+
+/*
+ * Returns the page table entry for `vaddr`, allocating its page table first
+ * if there is none yet. NULL once memory ran out, which is only fatal while
+ * booting.
+ */
+static void* vmm_alloc_pte(u32 vaddr)
+{
+    void* pde = pde_ptr(vaddr);
+    pte_t entry = entry_get(pde);
+
+    if (entry & PTE_PS) {
+        abort("vmm_alloc_pte: address lies in a large page");
+    }
+
+    if (!(entry & PTE_P)) {
+        u32 pt_paddr = 0;
+        bool zeroed = false;
+
+        if (memblock_is_active() == true) {
+            pt_paddr = (u32)memblock(PAGE_SIZE);
+            if (!pt_paddr) {
+                abort("Out of physical memory");
+            }
+            nr_pt_pages += 1;
+        } else {
+            void* page = pt_page_alloc();
+            if (!page) {
+                return NULL;
+            }
+
+            pt_paddr = V2P_WO((u32)page);
+            zeroed = true;
+        }
+
+        /* Not present before, so not in the TLB either */
+        entry_set(pde, pt_paddr | PTE_U | PTE_W | PTE_P);
+        if (!zeroed) {
+            memset((void*)((u32)pte_ptr(vaddr) & PAGE_MASK), 0, PAGE_SIZE);
+        }
+    }
+
+    return pte_ptr(vaddr);
+}
+
 /* Public */
 
+pte_t pfn_pte(u32 pfn, u32 flags)
+{
+    pte_t pte = ((pte_t)pfn << PAGE_SHIFT) | (flags & 0xFFF & ~PTE_NX);
+
+    if (flags & PTE_NX) {
+        pte |= nx_bit;
+    }
+
+    return pte;
+}
+
+bool vmm_pae_enabled(void) { return pae; }
+
+u32 vmm_max_pfn(void) { return pae ? PAE_MAX_PFN : 1 << (32 - PAGE_SHIFT); }
+
+u32 vmm_pt_span(void) { return 1 << pde_shift(); }
+
+void vmm_alloc_pt(u32 vaddr)
+{
+    if (!vmm_alloc_pte(vaddr)) {
+        abort("vmm_alloc_pt: out of memory");
+    }
+}
+
 void vmm_clear_pages(void)
 {
-    u32* pd = (u32*)0xFFFFF000;
+    u32 span = vmm_pt_span();
+
+    for (u32 vaddr = 0; vaddr < KERNBASE; vaddr += span) {
+        void* pde = pde_ptr(vaddr);
+        pte_t pt = entry_get(pde);
 
-    for (u32 pdi = 0; pdi < 768; pdi++) {
-        if (!(pd[pdi] & PTE_P)) {
+        if (!(pt & PTE_P) || pt == kernel_pde(vaddr)) {
             continue;
         }
 
-        u32* pt = (u32*)(0xFFC00000 + (pdi * PAGE_SIZE));
-        for (u32 pti = 0; pti < 1024; pti++) {
-            if (pt[pti] & PTE_P) {
-                u32 paddr = pt[pti] & PAGE_MASK;
+        for (u32 addr = vaddr; addr < vaddr + span; addr += PAGE_SIZE) {
+            void* pte = pte_ptr(addr);
+            pte_t entry = entry_get(pte);
 
-                if (buddy_manages((paddr_t)paddr)) {
-                    buddy_dealloc((paddr_t)paddr, 0);
+            if (entry & PTE_P) {
+                if (buddy_manages_pfn(pte_pfn(entry))) {
+                    put_page(pfn_to_page(pte_pfn(entry)));
                 }
-                pt[pti] = 0;
+                entry_set(pte, 0);
+            } else if (pte_is_swap(entry)) {
+                swap_free(pte_swap_slot(entry));
+                entry_set(pte, 0);
             }
         }
 
-        u32 pt_phys = pd[pdi] & PAGE_MASK;
-        pd[pdi] = 0;
+        entry_set(pde, 0);
 
-        if (buddy_manages((paddr_t)pt_phys)) {
-            buddy_dealloc((paddr_t)pt_phys, 0);
+        if (buddy_manages_pfn(pte_pfn(pt))) {
+            pt_page_free((void*)P2V_WO((u32)(pt & PTE_ADDR_MASK)));
         }
     }
 
     flush_tlb();
 }
 
+/*
+ * Resolves a write to a copy-on-write page of the current address space.
+ * The last user of a frame simply gets it back writable, everyone else gets
+ * a private copy.
+ *
+ * @return 0 if the fault was handled, -1 if `vaddr` is not a COW page.
+ */
+s32 vmm_handle_cow(u32 vaddr)
+{
+    pte_t pde = entry_get(pde_ptr(vaddr));
+    if (!(pde & PTE_P) || pde & PTE_PS) {
+        return -1;
+    }
+
+    void* pte = pte_ptr(vaddr);
+    pte_t entry = entry_get(pte);
+    if ((entry & (PTE_P | PTE_COW)) != (PTE_P | PTE_COW)) {
+        return -1;
+    }
+
+    u32 flags = (pte_flags(entry) & ~PTE_COW) | PTE_W;
+    page_t* page = pfn_to_page(pte_pfn(entry));
+
+    if (page_count(page) == 1) {
+        entry_set(pte, pfn_pte(pte_pfn(entry), flags));
+        vmm_flush_page(vaddr);
+        lru_add(page, vmm_current_pgdir(), vaddr);
+        return 0;
+    }
+
+    page_t* copy = alloc_highpage(false);
+    if (!copy) {
+        return -1;
+    }
+
+    copy_highpage(copy, page);
+    entry_set(pte, pfn_pte(page_to_pfn(copy), flags));
+    vmm_flush_page(vaddr);
+
+    put_page(page);
+    lru_add(copy, vmm_current_pgdir(), vaddr);
+    return 0;
+}
+
+pte_t vmm_get_pte(u32 vaddr)
+{
+    pte_t pde = entry_get(pde_ptr(vaddr));
+
+    if (!(pde & PTE_P) || pde & PTE_PS || pde == kernel_pde(vaddr)) {
+        return 0;
+    }
+
+    return entry_get(pte_ptr(vaddr));
+}
+
+void vmm_set_pte(u32 vaddr, pte_t pte) { entry_set(pte_ptr(vaddr), pte); }
+
+u32* vmm_current_pgdir(void) { return (u32*)P2V_WO(rcr3() & PAGE_MASK); }
+
+pte_t vmm_pgdir_get_pte(u32* pgdir, u32 vaddr)
+{
+    pte_t pde = entry_get(pgdir_pde(pgdir, vaddr));
+
+    if (!(pde & PTE_P) || pde & PTE_PS || pde == kernel_pde(vaddr)) {
+        return 0;
+    }
+
+    return entry_get(pt_entry(pde, vaddr));
+}
+
+u32 vmm_pgdir_rss(u32* pgdir)
+{
+    u32 span = vmm_pt_span();
+    u32 rss = 0;
+
+    for (u32 vaddr = 0; vaddr < KERNBASE; vaddr += span) {
+        pte_t pde = entry_get(pgdir_pde(pgdir, vaddr));
+        if (!(pde & PTE_P) || pde & PTE_PS || pde == kernel_pde(vaddr)) {
+            continue;
+        }
+
+        for (u32 addr = vaddr; addr < vaddr + span; addr += PAGE_SIZE) {
+            rss += (entry_get(pt_entry(pde, addr)) & PTE_P) != 0;
+        }
+    }
+
+    return rss;
+}
+
+u32 vmm_pt_pages(void) { return nr_pt_pages; }
+
+void vmm_pgdir_set_pte(u32* pgdir, u32 vaddr, pte_t pte)
+{
+    pte_t pde = entry_get(pgdir_pde(pgdir, vaddr));
+
+    entry_set(pt_entry(pde, vaddr), pte);
+    if (pgdir == vmm_current_pgdir()) {
+        vmm_flush_page(vaddr);
+    }
+}
+
+pte_t vmm_lookup(u32 vaddr)
+{
+    pte_t pde = entry_get(pde_ptr(vaddr));
+
+    if (!(pde & PTE_P)) {
+        return 0;
+    }
+
+    if (pde & PTE_PS) {
+        return pde;
+    }
+
+    return entry_get(pte_ptr(vaddr));
+}
+
+void* setup_kvm(void)
+{
+    u32* pgdir = (u32*)pt_page_alloc();
+    if (!pgdir) {
+        return NULL;
+    }
+
+    /* All four page directories are always there, PDPTEs are only loaded
+     * into the CPU along with CR3 */
+    if (pae) {
+        u64* pdpt = (u64*)pgdir;
+
+        for (u32 i = 0; i < 4; i += 1) {
+            void* pd = pt_page_alloc();
+            if (!pd) {
+                while (i > 0) {
+                    i -= 1;
+                    pt_page_free((void*)P2V_WO((u32)(pdpt[i] & PTE_ADDR_MASK)));
+                }
+                pt_page_free(pgdir);
+                return NULL;
+            }
+
+            /* Writable and user are reserved bits in a PDPTE */
+            pdpt[i] = V2P_WO((u32)pd) | PTE_P;
+        }
+    }
+
+    u32 span = vmm_pt_span();
+    for (u32 vaddr = 0; vaddr < IDENTITY_MAP_SIZE; vaddr += span) {
+        entry_set(pgdir_pde(pgdir, vaddr), kernel_pde(vaddr));
+    }
+
+    for (u32 vaddr = KERNBASE; vaddr < pt_window(); vaddr += span) {
+        entry_set(pgdir_pde(pgdir, vaddr), kernel_pde(vaddr));
+    }
+
+    vmm_set_recursive(pgdir);
+
+    return pgdir;
+}
+
+void* vmm_copy_pgdir(u32* parent_pgdir, bool cow)
+{
+    u32* child_pgdir = (u32*)setup_kvm();
+    if (!child_pgdir) {
+        return NULL;
+    }
+
+    u32 span = vmm_pt_span();
+
+    for (u32 vaddr = 0; vaddr < KERNBASE; vaddr += span) {
+        pte_t pde = entry_get(pgdir_pde(parent_pgdir, vaddr));
+        if (!(pde & PTE_P) || pde == kernel_pde(vaddr)) {
+            continue;
+        }
+
+        void* new_pt = pt_page_alloc();
+        if (!new_pt) {
+            goto fail;
+        }
+
+        pte_t child_pde = V2P_WO((u32)new_pt) | (pde & 0xFFF);
+        entry_set(pgdir_pde(child_pgdir, vaddr), child_pde);
+
+        for (u32 addr = vaddr; addr < vaddr + span; addr += PAGE_SIZE) {
+            void* parent_pte = pt_entry(pde, addr);
+            void* child_pte = pt_entry(child_pde, addr);
+            pte_t entry = entry_get(parent_pte);
+            if (pte_is_swap(entry)) {
+                swap_dup(pte_swap_slot(entry));
+                entry_set(child_pte, entry);
+                continue;
+            }
+
+            if (!(entry & PTE_P)) {
+                continue;
+            }
+
+            u32 pfn = pte_pfn(entry);
+
+            /* Shared mappings stay shared, whatever the parent writes */
+            if (entry & PTE_SHARED && buddy_manages_pfn(pfn)) {
+                get_page(pfn_to_page(pfn));
+                entry_set(child_pte, entry);
+                continue;
+            }
+
+            if (cow && buddy_manages_pfn(pfn)) {
+                if (entry & PTE_W) {
+                    entry = (entry & ~(pte_t)PTE_W) | PTE_COW;
+                    entry_set(parent_pte, entry);
+                }
+
+                /* Two mappings now, reclaim only handles pages with one */
+                lru_del(pfn_to_page(pfn));
+                get_page(pfn_to_page(pfn));
+                entry_set(child_pte, entry);
+                continue;
+            }
+
+            /* Device memory past the end of RAM has no frame to copy */
+            if (!pfn_valid(pfn)) {
+                entry_set(child_pte, entry);
+                continue;
+            }
+
+            page_t* new_page = alloc_highpage(false);
+            if (!new_page) {
+                goto fail;
+            }
+
+            /* Making room may have swapped out the page to copy */
+            entry = entry_get(parent_pte);
+            if (pte_is_swap(entry)) {
+                put_page(new_page);
+                swap_dup(pte_swap_slot(entry));
+                entry_set(child_pte, entry);
+                continue;
+            }
+
+            copy_highpage(new_page, pfn_to_page(pfn));
+
+            u32 flags = pte_flags(entry) & ~PTE_COW;
+            if (entry & PTE_COW) {
+                flags |= PTE_W;
+            }
+            entry_set(child_pte, pfn_pte(page_to_pfn(new_page), flags));
+            lru_add(new_page, child_pgdir, addr);
+        }
+    }
+
+    if (cow) {
+        flush_tlb();
+    }
+
+    return child_pgdir;
+
+fail:
+    vmm_free_pagedir(child_pgdir);
+    return NULL;
+}
+
 void vmm_free_pagedir(void* pgdir)
 {
     u32* pgdir_addr = (u32*)pgdir;
+    if (!pgdir_addr) {
+        return;
+    }
 
-    for (s32 i = 0; i < 768; i += 1) {
-        if (pgdir_addr[i] & PTE_P && pgdir_addr[i] != page_directory[i]) {
-            u32 pt_paddr = pgdir_addr[i] & ~0xFFF;
-            u32* pt_vaddr = (u32*)P2V_WO(pt_paddr);
+    u32 span = vmm_pt_span();
 
-            for (s32 j = 0; j < 1024; j += 1) {
-                if (pt_vaddr[j] & PTE_P) {
-                    u32 page_paddr = pt_vaddr[j] & ~0xFFF;
-                    free_page((void*)P2V_WO(page_paddr));
-                }
+    for (u32 vaddr = 0; vaddr < KERNBASE; vaddr += span) {
+        pte_t pde = entry_get(pgdir_pde(pgdir_addr, vaddr));
+        if (!(pde & PTE_P) || pde == kernel_pde(vaddr)) {
+            continue;
+        }
+
+        for (u32 addr = vaddr; addr < vaddr + span; addr += PAGE_SIZE) {
+            pte_t entry = entry_get(pt_entry(pde, addr));
+            if (entry & PTE_P && buddy_manages_pfn(pte_pfn(entry))) {
+                put_page(pfn_to_page(pte_pfn(entry)));
+            } else if (pte_is_swap(entry)) {
+                swap_free(pte_swap_slot(entry));
             }
+        }
+
+        pt_page_free((void*)P2V_WO((u32)(pde & PTE_ADDR_MASK)));
+    }
 
-            free_page(pt_vaddr);
+    if (pae) {
+        u64 const* pdpt = (u64 const*)pgdir_addr;
+
+        for (u32 i = 0; i < 4; i += 1) {
+            pt_page_free((void*)P2V_WO((u32)(pdpt[i] & PTE_ADDR_MASK)));
         }
     }
-    free_page(pgdir_addr);
+
+    pt_page_free(pgdir_addr);
 }
 
 void* vmm_unmap_page(void* vaddr)
 {
-    u32* pd = (u32*)0xFFFFF000;
-    u32 pdindex = (u32)vaddr >> 22;
-    u32 ptindex = (u32)vaddr >> 12 & 0x03FF;
-
-    if (!(pd[pdindex] & PTE_P)) {
+    pte_t pde = entry_get(pde_ptr((u32)vaddr));
+    if (!(pde & PTE_P) || pde & PTE_PS) {
         return NULL;
     }
 
-    u32* pt = (u32*)(0xFFC00000 + (pdindex * PAGE_SIZE));
-    u32* pte = &pt[ptindex];
+    void* pte = pte_ptr((u32)vaddr);
+    pte_t entry = entry_get(pte);
 
-    if (!(*pte & PTE_P)) {
+    if (!(entry & PTE_P)) {
         return NULL;
     }
 
-    void* paddr = (void*)(*pte & ~0xFFF);
-    *pte = 0;
-    flush_tlb();
+    entry_set(pte, 0);
+    vmm_flush_page((u32)vaddr);
 
-    return paddr;
+    return (void*)(pte_pfn(entry) << PAGE_SHIFT);
+}
+
+s32 vmm_map_pfn(u32 pfn, void* vaddr, u32 flags)
+{
+    void* pte = vmm_alloc_pte((u32)vaddr);
+    if (!pte || entry_get(pte) & PTE_P) {
+        return -1;
+    }
+
+    entry_set(pte, pfn_pte(pfn, flags | PTE_P));
+    return 0;
 }
 
 /**
@@ -150,105 +680,231 @@ void* vmm_unmap_page(void* vaddr)
  *
  * @brief Maps a physical address to a virtual address.
  *
+ * The entry was not present before, so there is nothing in the TLB to flush.
+ *
  * @return 0 on success.
  * @return -1 if the mapping already exists.
  */
 __attribute__((warn_unused_result)) s32
 vmm_map_page(void* paddr, void* vaddr, u32 flags)
 {
-    if (!paddr) {
-        paddr = buddy_alloc(0);
-        if (!paddr) {
+    if (paddr) {
+        return vmm_map_pfn((u32)paddr >> PAGE_SHIFT, vaddr, flags);
+    }
+
+    void* pte = vmm_alloc_pte((u32)vaddr);
+    if (!pte || entry_get(pte) & PTE_P) {
+        return -1;
+    }
+
+    u32 pfn = vmm_alloc_frame();
+    if (!pfn) {
+        return -1;
+    }
+
+    return vmm_map_pfn(pfn, vaddr, flags);
+}
+
+s32 vmm_map_range(void* paddr, void* vaddr, u32 size, u32 flags)
+{
+    u32 start = (u32)vaddr;
+    u32 end = start + ALIGN(size, PAGE_SIZE);
+
+    for (u32 addr = start; addr < end; addr += PAGE_SIZE) {
+        void* pte = vmm_alloc_pte(addr);
+        bool present = !pte || entry_get(pte) & PTE_P;
+        u32 pfn = 0;
+
+        if (!present) {
+            pfn = paddr ? ((u32)paddr + (addr - start)) >> PAGE_SHIFT
+                        : vmm_alloc_frame();
+        }
+
+        if (present || (!paddr && !pfn)) {
+            vmm_unmap_range(vaddr, addr - start, !paddr);
             return -1;
         }
+
+        entry_set(pte, pfn_pte(pfn, flags | PTE_P));
     }
 
-    u32 pdindex = (u32)vaddr >> 22;
-    u32 ptindex = (u32)vaddr >> 12 & 0x03FF;
+    return 0;
+}
 
-    u32* pd = (u32*)0xFFFFF000;
-    u32* pt = (u32*)(0xFFC00000 + (pdindex * PAGE_SIZE));
+u32 vmm_unmap_range(void* vaddr, u32 size, bool free_frames)
+{
+    u32 start = (u32)vaddr;
+    u32 end = start + ALIGN(size, PAGE_SIZE);
+    u32 count = 0;
+
+    for (u32 addr = start; addr < end; addr += PAGE_SIZE) {
+        pte_t pde = entry_get(pde_ptr(addr));
+        if (!(pde & PTE_P) || pde & PTE_PS) {
+            /* Skip to the next page table, stopping at the top of memory */
+            u32 next = (addr | (vmm_pt_span() - 1)) + 1;
+            if (next == 0) {
+                break;
+            }
 
-    if (!(pd[pdindex] & PTE_P)) {
-        u32 pt_paddr = 0;
+            addr = next - PAGE_SIZE;
+            continue;
+        }
 
-        if (memblock_is_active() == true) {
-            pt_paddr = (u32)memblock(PAGE_SIZE);
-        } else {
-            pt_paddr = (u32)buddy_alloc(0);
+        void* pte = pte_ptr(addr);
+        pte_t entry = entry_get(pte);
+        if (free_frames && pte_is_swap(entry)) {
+            swap_free(pte_swap_slot(entry));
+            entry_set(pte, 0);
+            continue;
         }
 
-        if (!pt_paddr) {
-            abort("Out of physical memory");
+        if (!(entry & PTE_P)) {
+            continue;
         }
 
-        pd[pdindex] = pt_paddr | PTE_U | PTE_W | PTE_P;
-        flush_tlb();
+        entry_set(pte, 0);
+        count += 1;
 
-        memset(pt, 0, PAGE_SIZE);
+        if (free_frames && buddy_manages_pfn(pte_pfn(entry))) {
+            put_page(pfn_to_page(pte_pfn(entry)));
+        }
     }
 
-    if (pt[ptindex] & PTE_P) {
-        return -1;
+    if (count > 0) {
+        vmm_flush_range(start, end);
     }
 
-    pt[ptindex] = ((u32)paddr) | (flags & 0xFFF) | PTE_P;
-
-    flush_tlb();
-    return 0;
+    return count;
 }
 
 void vmm_remap_page(void* vaddr, void* paddr, s32 flags)
 {
-    u32 pdindex = (u32)vaddr >> 22;
-    u32 ptindex = (u32)vaddr >> 12 & 0x03FF;
+    void* pte = vmm_alloc_pte((u32)vaddr);
+    if (!pte) {
+        abort("vmm_remap_page: out of memory");
+    }
 
-    u32* pt = (u32*)(0xFFC00000 + (pdindex * PAGE_SIZE));
-    pt[ptindex] = ((u32)paddr) | (flags & 0xFFF) | PTE_P;
+    entry_set(pte, pfn_pte((u32)paddr >> PAGE_SHIFT, (u32)flags | PTE_P));
+    vmm_flush_page((u32)vaddr);
+}
 
-    flush_tlb();
+void vmm_flush_page(u32 vaddr)
+{
+    if (cpu_has(X86_FEATURE_INVLPG)) {
+        invlpg(vaddr);
+    } else {
+        flush_tlb();
+    }
 }
 
+void vmm_flush_range(u32 start, u32 end)
+{
+    if (!cpu_has(X86_FEATURE_INVLPG)
+        || end - start > INVLPG_MAX_PAGES * PAGE_SIZE) {
+        flush_tlb();
+        return;
+    }
+
+    for (u32 addr = start & PAGE_MASK; addr < end; addr += PAGE_SIZE) {
+        invlpg(addr);
+    }
+}
+
+/*
+ * Builds the direct map of lowmem at KERNBASE and its identity map below.
+ * Where CPUID reports PAE, the tables are built in its format and the CPU is
+ * switched over, so frames above 4 GB can be mapped; NX comes along if the
+ * CPU has it. The direct map is made of large pages where possible, 2 MB with
+ * PAE and 4 MB with PSE, global ones with PGE, so it costs no page tables and
+ * its TLB entries survive every switch of address space. The identity map
+ * keeps its page tables, since user mappings below 16 MB still share them.
+ */
 void vmm_init_pages(void)
 {
-    memset(page_directory, 0, sizeof(u32) * 1024);
+    memset(page_directory, 0, sizeof(page_directory));
 
-    size_t memory_to_map = ZONE_NORMAL;
-    size_t total_ram = (pmm_bitmap_len() * PAGE_SIZE * 8);
-    if (ZONE_NORMAL > total_ram) {
-        memory_to_map = total_ram;
+    pae = cpu_has(X86_FEATURE_PAE);
+    if (pae) {
+        u64* pdpt = (u64*)page_directory;
+
+        for (u32 i = 0; i < 4; i += 1) {
+            void* pd = memblock(PAGE_SIZE);
+            if (!pd) {
+                abort("Out of memory allocating a page directory");
+            }
+
+            memset((void*)P2V_WO((u32)pd), 0, PAGE_SIZE);
+            pdpt[i] = (u32)pd | PTE_P;
+        }
+
+        if (cpu_has(X86_FEATURE_NX)) {
+            wrmsr(MSR_EFER, rdmsr(MSR_EFER) | EFER_NXE);
+            nx_bit = PTE_NX_BIT;
+        }
     }
 
-    for (u32 paddr = 0; paddr < memory_to_map; paddr += PAGE_SIZE * 1024) {
+    /* PAE can map 2 MB pages on its own, but "nopse" asks for 4 KB ones */
+    bool large = cpu_has(X86_FEATURE_PSE);
+    u32 global = large && cpu_has(X86_FEATURE_PGE) ? PTE_G : 0;
+    u32 span = vmm_pt_span();
+
+    /* Highmem stays out of the direct map, kmap() reaches it instead */
+    u32 memory_to_map = min(memblock_end_pfn(), (u32)ZONE_NORMAL >> PAGE_SHIFT)
+        << PAGE_SHIFT;
+
+    for (u32 paddr = 0; paddr < memory_to_map; paddr += span) {
         void* pt_paddr = memblock(PAGE_SIZE);
         if (!pt_paddr) {
             abort("Out of memory allocating a page table");
         }
 
-        u32* pt_vaddr = (u32*)P2V_WO((u32)pt_paddr);
-        for (int i = 0; i < 1024; i++) {
+        void* pt_vaddr = (void*)P2V_WO((u32)pt_paddr);
+        for (u32 i = 0; i < pt_entries(); i += 1) {
             u32 page_phys_addr = paddr + (i * PAGE_SIZE);
+            pte_t entry = 0;
+
             if (page_phys_addr < memory_to_map) {
-                pt_vaddr[i] = page_phys_addr | PTE_P | PTE_W | PTE_U;
-                continue;
+                entry = page_phys_addr | PTE_P | PTE_W | PTE_U;
             }
 
-            pt_vaddr[i] = 0;
+            entry_set(table_entry(pt_vaddr, i), entry);
         }
 
-        u32 pd_index = (KERNBASE + paddr) / 0x400000;
-        page_directory[pd_index] = (u32)pt_paddr | PTE_P | PTE_W | PTE_U;
+        entry_set(
+            pgdir_pde(page_directory, paddr),
+            (u32)pt_paddr | PTE_P | PTE_W | PTE_U
+        );
 
-        u32 identity_pd_index = paddr / 0x400000;
-        page_directory[identity_pd_index]
-            = (u32)pt_paddr | PTE_P | PTE_W | PTE_U;
+        /* A partial last chunk must not map what lies past the end of RAM */
+        void* pde = pgdir_pde(page_directory, KERNBASE + paddr);
+        if (large && memory_to_map - paddr >= span) {
+            entry_set(pde, paddr | global | PTE_PS | PTE_P | PTE_W | PTE_U);
+            continue;
+        }
+
+        entry_set(pde, (u32)pt_paddr | PTE_P | PTE_W | PTE_U);
+    }
+
+    /* The boot page directory already runs on 4 MB pages */
+    if (global) {
+        lcr4(rcr4() | CR4_PGE);
     }
 
+    vmm_set_recursive(page_directory);
+
     u32 page_directory_paddr = V2P_WO((u32)page_directory);
-    page_directory[1023] = page_directory_paddr | PTE_P | PTE_W;
+    if (pae) {
+        enable_pae(page_directory_paddr);
+    } else {
+        load_page_directory((u32*)page_directory_paddr);
+        enable_paging();
+    }
 
-    load_page_directory((u32*)page_directory_paddr);
-    enable_paging();
+    /* Kernel writes to user buffers must fault on COW pages as well. The
+     * i386 ignores R/W in supervisor mode, fork() copies eagerly there. */
+    if (cpu_has(X86_FEATURE_WP)) {
+        lcr0(rcr0() | CR0_WP);
+    }
 
     /* Creating a scratch map */
     void* paddr = memblock(PAGE_SIZE);
@@ -260,4 +916,9 @@ void vmm_init_pages(void)
     if (ret < 0) {
         abort("Scratch Page is already taken\n");
     }
+
+    printk(
+        "vmm: %s paging%s\n", pae ? "PAE" : "two-level",
+        nx_bit ? " with NX" : ""
+    );
 }
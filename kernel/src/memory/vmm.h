@@ -1,24 +1,196 @@
 #ifndef VMM_H
 #define VMM_H
 
+#include <stdbool.h>
 #include <uapi/types.h>
 
 #define PTE_P (1 << 0)
 #define PTE_W (1 << 1)
 #define PTE_U (1 << 2)
+#define PTE_A (1 << 5)       // Set by the CPU on every access
+#define PTE_D (1 << 6)       // Set by the CPU on the first write
+#define PTE_PS (1 << 7)      // In a PDE: maps a 4 MB (2 MB with PAE) page
+#define PTE_G (1 << 8)       // Global: kept in the TLB across CR3 reloads
+#define PTE_COW (1 << 9)     // Available to software: shared until first write
+#define PTE_SHARED (1 << 10) // Available to software: MAP_SHARED, never COW
+#define PTE_NX (1 << 11) // No execute, moved to bit 63 of PAE entries. Ignored
+                         // without PAE or on CPUs without NX.
 
-#define ZONE_NORMAL 896 * 1024 * 1024
+/* Page fault error code */
+#define PF_PRESENT (1 << 0) // Protection violation, not a missing page
+#define PF_WRITE (1 << 1)
+#define PF_USER (1 << 2)
 
+/*
+ * A page table entry as read from or written to the current address space.
+ * 32-bit entries are zero-extended, so the same code handles both formats.
+ */
+typedef u64 pte_t;
+
+#define PTE_ADDR_MASK 0x000FFFFFFFFFF000ULL
+#define PTE_NX_BIT (1ULL << 63)
+
+/*
+ * A non-present entry is either 0 or a page that was swapped out. Then
+ * PTE_SWAP is set and the swap slot sits where the frame number would be.
+ */
+#define PTE_SWAP (1 << 1)
+
+/* Identity mapped low memory every address space shares with the kernel */
+#define IDENTITY_MAP_SIZE (16 * 1024 * 1024)
+
+static inline u32 pte_pfn(pte_t pte)
+{
+    return (u32)((pte & PTE_ADDR_MASK) >> 12);
+}
+
+/* The low flag bits of `pte`, with PTE_NX standing in for bit 63 */
+static inline u32 pte_flags(pte_t pte)
+{
+    return ((u32)pte & 0xFFF & ~PTE_NX) | (pte & PTE_NX_BIT ? PTE_NX : 0);
+}
+
+static inline bool pte_is_swap(pte_t pte)
+{
+    return (pte & (PTE_SWAP | PTE_P)) == PTE_SWAP;
+}
+
+static inline u32 pte_swap_slot(pte_t pte) { return (u32)pte >> 12; }
+
+static inline pte_t swap_pte(u32 slot)
+{
+    return ((pte_t)slot << 12) | PTE_SWAP;
+}
+
+/**
+ * Builds an entry for frame `pfn`. PTE_NX becomes bit 63 when the CPU
+ * honours it and is dropped otherwise.
+ */
+pte_t pfn_pte(u32 pfn, u32 flags);
+
+/**
+ * Turns on PAE, and NX with it where the CPU has it, when CPUID reports PAE.
+ * Then builds the direct map of lowmem at KERNBASE.
+ */
 void vmm_init_pages(void);
 
+/* Whether the page tables are in the three-level PAE format */
+bool vmm_pae_enabled(void);
+
+/**
+ * One past the highest frame the page tables can reach: 4 GB with two-level
+ * paging, 64 GB with PAE.
+ */
+u32 vmm_max_pfn(void);
+
+/* Bytes of address space covered by one page table: 4 MB, or 2 MB with PAE */
+u32 vmm_pt_span(void);
+
 s32 vmm_map_page(void* paddr, void* vaddr, u32 flags);
 
+/**
+ * Maps frame `pfn`, which may lie above 4 GB with PAE, at `vaddr`.
+ *
+ * @return 0 on success, -1 if `vaddr` is already mapped.
+ */
+s32 vmm_map_pfn(u32 pfn, void* vaddr, u32 flags);
+
 void* vmm_unmap_page(void*);
 
 void vmm_remap_page(void* vaddr, void* paddr, s32 flags);
 
+/**
+ * Maps `size` bytes at `vaddr` to the physically contiguous range at `paddr`,
+ * or to fresh frames if `paddr` is NULL. Nothing is flushed, since none of
+ * the entries were present before.
+ *
+ * @return 0 on success, -1 if a page is already mapped or memory ran out.
+ *         Nothing stays mapped on failure.
+ */
+s32 vmm_map_range(void* paddr, void* vaddr, u32 size, u32 flags);
+
+/**
+ * Unmaps every page in [vaddr, vaddr + size) and flushes the TLB once for
+ * the whole range. With `free_frames`, each frame loses a reference.
+ *
+ * @return The number of pages that were mapped.
+ */
+u32 vmm_unmap_range(void* vaddr, u32 size, bool free_frames);
+
+/**
+ * Drops the TLB entry for `vaddr`: invlpg where the CPU has it, a CR3 reload
+ * on the i386.
+ */
+void vmm_flush_page(u32 vaddr);
+
+/**
+ * Drops the TLB entries for [start, end), page by page for small ranges and
+ * with a single CR3 reload for large ones or on the i386.
+ */
+void vmm_flush_range(u32 start, u32 end);
+
+/**
+ * Allocates a new address space that shares the kernel half and the identity
+ * map with every other one. The returned page is what CR3 points to: the
+ * page directory, or the page directory pointer table with PAE.
+ */
+void* setup_kvm(void);
+
+/**
+ * Duplicates the user half of `parent_pgdir`. With `cow` set, frames are
+ * shared read-only and copied by vmm_handle_cow() on the first write;
+ * otherwise every present page is copied right away.
+ */
+void* vmm_copy_pgdir(u32* parent_pgdir, bool cow);
+
 void vmm_free_pagedir(void* pgdir);
 
 void vmm_clear_pages(void);
 
+s32 vmm_handle_cow(u32 vaddr);
+
+/**
+ * Returns the page table entry for `vaddr` in the current address space, or
+ * 0 if there is no page table for it. Page tables shared with the kernel are
+ * never looked at.
+ */
+pte_t vmm_get_pte(u32 vaddr);
+
+/**
+ * Overwrites the entry for `vaddr`, whose page table must exist. The TLB is
+ * left to the caller.
+ */
+void vmm_set_pte(u32 vaddr, pte_t pte);
+
+/**
+ * Returns the entry that maps `vaddr`, kernel or not: the page table entry,
+ * or the page directory entry with PTE_PS set for a large page. 0 if there
+ * is none.
+ */
+pte_t vmm_lookup(u32 vaddr);
+
+/* The page directory of the current address space, as setup_kvm() returned */
+u32* vmm_current_pgdir(void);
+
+/**
+ * Like vmm_get_pte(), for the address space `pgdir`, which need not be the
+ * current one.
+ */
+pte_t vmm_pgdir_get_pte(u32* pgdir, u32 vaddr);
+
+/* Number of present pages in the user half of `pgdir` */
+u32 vmm_pgdir_rss(u32* pgdir);
+
+/* Page tables and page directories allocated, kernel ones included */
+u32 vmm_pt_pages(void);
+
+/**
+ * Overwrites the entry for `vaddr` in `pgdir`, whose page table must exist.
+ * The TLB entry is dropped if `pgdir` is the current address space.
+ */
+void vmm_pgdir_set_pte(u32* pgdir, u32 vaddr, pte_t pte);
+
+/* Allocates the page table for `vaddr` if there is none yet */
+void vmm_alloc_pt(u32 vaddr);
+
 #endif /* VMM_H */
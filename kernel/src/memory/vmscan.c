@@ -0,0 +1,247 @@
+#include "memory/vmscan.h"
+#include "lib/stdlib.h"
+#include "memory/buddy_allocator/buddy.h"
+#include "memory/consts.h"
+#include "memory/page.h"
+#include "memory/slab.h"
+#include "memory/swap.h"
+#include "memory/vmm.h"
+
+#include <types.h>
+
+typedef struct {
+    lru_page_t* head; // Most recently added
+    lru_page_t* tail; // Next to be looked at by reclaim
+    u32 count;
+} lru_list_t;
+
+static kmem_cache_t* lru_cache = NULL;
+static lru_page_t* lru_hash_table[LRU_BUCKETS] = { 0 };
+static lru_list_t active_list = { 0 };
+static lru_list_t inactive_list = { 0 };
+static bool reclaiming = false;
+
+/* Private */
+
+static inline u32 lru_hash(page_t const* page)
+{
+    return page_to_pfn(page) % LRU_BUCKETS;
+}
+
+static inline lru_list_t* lru_list(lru_page_t const* lp)
+{
+    return lp->active ? &active_list : &inactive_list;
+}
+
+static void list_push(lru_list_t* list, lru_page_t* lp)
+{
+    lp->prev = NULL;
+    lp->next = list->head;
+
+    if (list->head) {
+        list->head->prev = lp;
+    } else {
+        list->tail = lp;
+    }
+
+    list->head = lp;
+    list->count += 1;
+}
+
+static void list_unlink(lru_list_t* list, lru_page_t* lp)
+{
+    if (lp->prev) {
+        lp->prev->next = lp->next;
+    } else {
+        list->head = lp->next;
+    }
+
+    if (lp->next) {
+        lp->next->prev = lp->prev;
+    } else {
+        list->tail = lp->prev;
+    }
+
+    list->count -= 1;
+}
+
+/* Moves `lp` to the head of the active or the inactive list */
+static void lru_move(lru_page_t* lp, bool active)
+{
+    list_unlink(lru_list(lp), lp);
+    lp->active = active;
+    list_push(lru_list(lp), lp);
+}
+
+/*
+ * Whether the page was accessed since the last look, clearing the accessed
+ * bit for the next one. The TLB entry has to go as well, or the CPU would
+ * not set the bit again.
+ */
+static bool lru_referenced(lru_page_t const* lp)
+{
+    pte_t pte = vmm_pgdir_get_pte(lp->pgdir, lp->vaddr);
+
+    if (!(pte & PTE_A)) {
+        return false;
+    }
+
+    vmm_pgdir_set_pte(lp->pgdir, lp->vaddr, pte & ~(pte_t)PTE_A);
+    return true;
+}
+
+/* Ages the coldest active page onto the inactive list */
+static void refill_inactive(void)
+{
+    lru_page_t* lp = active_list.tail;
+
+    if (lp) {
+        lru_move(lp, lru_referenced(lp));
+    }
+}
+
+/*
+ * Writes the page to a fresh slot and replaces its mapping with a swap
+ * entry. Nothing can touch the page in between, the kernel does not preempt
+ * itself and the disk is driven by polling.
+ */
+static s32 swap_out(lru_page_t* lp)
+{
+    page_t* page = lp->page;
+    u32* pgdir = lp->pgdir;
+    u32 vaddr = lp->vaddr;
+
+    pte_t pte = vmm_pgdir_get_pte(pgdir, vaddr);
+    if (!(pte & PTE_P) || pte_pfn(pte) != page_to_pfn(page)) {
+        abort("swap_out: page is no longer mapped where it was");
+    }
+
+    u32 slot = swap_alloc();
+    if (!slot) {
+        return -1;
+    }
+
+    if (swap_write_page(slot, page) < 0) {
+        swap_free(slot);
+        return -1;
+    }
+
+    vmm_pgdir_set_pte(pgdir, vaddr, swap_pte(slot));
+    lru_del(page);
+    put_page(page);
+
+    return 0;
+}
+
+/* Public */
+
+void vmscan_init(void)
+{
+    lru_cache = kmem_cache_create("lru_page", sizeof(lru_page_t));
+    if (!lru_cache) {
+        abort("vmscan_init: could not create the lru_page cache");
+    }
+}
+
+void lru_add(page_t* page, u32* pgdir, u32 vaddr)
+{
+    if (!lru_cache || page_count(page) != 1
+        || page->flags & (PG_reserved | PG_pagecache | PG_lru)) {
+        return;
+    }
+
+    /* Without a descriptor the page simply stays resident */
+    lru_page_t* lp = kmem_cache_alloc(lru_cache);
+    if (!lp) {
+        return;
+    }
+
+    lp->page = page;
+    lp->pgdir = pgdir;
+    lp->vaddr = vaddr & PAGE_MASK;
+    lp->active = true;
+
+    u32 hash = lru_hash(page);
+    lp->hash_next = lru_hash_table[hash];
+    lru_hash_table[hash] = lp;
+
+    list_push(&active_list, lp);
+    page->flags |= PG_lru;
+}
+
+void lru_del(page_t* page)
+{
+    if (!(page->flags & PG_lru)) {
+        return;
+    }
+
+    lru_page_t** link = &lru_hash_table[lru_hash(page)];
+    while (*link && (*link)->page != page) {
+        link = &(*link)->hash_next;
+    }
+
+    if (!*link) {
+        abort("lru_del: page is not on the lists");
+    }
+
+    lru_page_t* lp = *link;
+    *link = lp->hash_next;
+
+    list_unlink(lru_list(lp), lp);
+    page->flags &= ~PG_lru;
+    kmem_cache_free(lru_cache, lp);
+}
+
+u32 try_to_free_pages(u32 zone, u32 nr)
+{
+    u32 freed = 0;
+
+    /* Writing to swap may allocate, zram does, which must not recurse */
+    if (!swap_enabled() || reclaiming) {
+        return 0;
+    }
+
+    /* Twice around, so pages only referenced once get swapped on the second */
+    u32 scan = 2 * (active_list.count + inactive_list.count);
+    reclaiming = true;
+
+    while (freed < nr && scan > 0) {
+        scan -= 1;
+
+        if (inactive_list.count <= active_list.count) {
+            refill_inactive();
+        }
+
+        lru_page_t* lp = inactive_list.tail;
+        if (!lp) {
+            continue;
+        }
+
+        /* Freeing a frame in the other zone would not help the caller */
+        if (page_is_highmem(lp->page) != (zone == BUDDY_ZONE_HIGHMEM)) {
+            lru_move(lp, false);
+            continue;
+        }
+
+        if (lru_referenced(lp)) {
+            lru_move(lp, true);
+            continue;
+        }
+
+        /* Swap is full or the disk failed, retrying will not help */
+        if (swap_out(lp) < 0) {
+            break;
+        }
+
+        freed += 1;
+    }
+
+    reclaiming = false;
+    return freed;
+}
+
+void lru_get_stats(u32* active, u32* inactive)
+{
+    *active = active_list.count;
+    *inactive = inactive_list.count;
+}
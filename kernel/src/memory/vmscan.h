@@ -0,0 +1,53 @@
+#ifndef VMSCAN_H
+#define VMSCAN_H
+
+#include "memory/page.h"
+
+#include <stdbool.h>
+#include <types.h>
+
+#define LRU_BUCKETS 256
+
+/* Pages reclaim tries to free when an allocation fails */
+#define RECLAIM_BATCH 8
+
+/*
+ * An anonymous page that can be swapped out. Only pages with a single
+ * mapping are tracked, so the one page table entry to replace with a swap
+ * entry is always known. Pages that become shared by fork() are dropped from
+ * the lists until one of the users is the last again.
+ */
+typedef struct lru_page {
+    page_t* page; // Marked PG_lru while on a list
+    u32* pgdir;   // The address space the page is mapped in
+    u32 vaddr;
+    bool active;
+
+    struct lru_page* prev;
+    struct lru_page* next;
+    struct lru_page* hash_next;
+} lru_page_t;
+
+void vmscan_init(void);
+
+/**
+ * Puts the anonymous page mapped at `vaddr` of `pgdir` on the active list.
+ * Page cache pages, shared pages and pages already on a list are ignored.
+ */
+void lru_add(page_t* page, u32* pgdir, u32 vaddr);
+
+/* Takes `page` off the lists, if it is on one */
+void lru_del(page_t* page);
+
+/**
+ * Writes up to `nr` cold anonymous pages of buddy zone `zone` to swap and
+ * frees them. Pages whose accessed bit is set get another round on the
+ * active list instead.
+ *
+ * @return The number of pages freed.
+ */
+u32 try_to_free_pages(u32 zone, u32 nr);
+
+void lru_get_stats(u32* active, u32* inactive);
+
+#endif /* VMSCAN_H */
@@ -2,6 +2,7 @@
 #define SOCKET_H
 
 #include "sys/file/file.h"
+#include "sys/process/wait.h"
 #include <types.h>
 
 #define SOCK_STREAM 1 /* Stream socket (TCP, Unix STREAM) */
@@ -26,6 +27,7 @@ typedef struct socket {
     struct vfs_inode* inode; /* Back pointer to inode */
 
     struct socket* conn;
+    wait_queue_head_t wait; /* accept() waiting for a connection */
 } socket_t;
 
 struct proto_ops {
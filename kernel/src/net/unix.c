@@ -3,7 +3,7 @@
 #include "fs/vfs.h"
 #include "memory/kmalloc.h"
 #include "net/socket.h"
-#include "sys/process/process.h"
+#include "sys/process/wait.h"
 #include <uapi/stat.h>
 
 #include <ferrite/string.h>
@@ -208,14 +208,16 @@ static int unix_connect(socket_t* s, void* addr, int len)
     s->conn = server;
     server->conn = s;
     s->state = SS_CONNECTING;
+    wake_up(&server->wait);
 
     return 0;
 }
 
 static int unix_accept(socket_t* s, socket_t* newsock)
 {
-    while (!s->conn) {
-        yield();
+    s32 err = wait_event_interruptible(s->wait, s->conn);
+    if (err < 0) {
+        return err;
     }
 
     socket_t* client = s->conn;
@@ -1,10 +1,16 @@
 #include "arch/x86/idt/syscalls.h"
 #include "cpu.h"
 #include "fs/mount.h"
+#include "io.h"
+#include "memory/vma.h"
 #include "sys/process/process.h"
+#include "sys/process/sched.h"
 
+#include <lib/math.h>
 #include <uapi/errno.h>
 #include <uapi/reboot.h>
+#include <uapi/resource.h>
+#include <uapi/sched.h>
 #include <uapi/types.h>
 
 /* General */
@@ -63,6 +69,164 @@ SYSCALL_ATTR int sys_umount(char const* name, int flags)
     return ret;
 }
 
+/* Priority */
+
+/* Anyone may lower the priority of their own processes, only root raise it */
+static s32 set_one_prio(proc_t* p, s32 nice)
+{
+    proc_t const* current = myproc();
+
+    if (current->euid != ROOT_UID && current->euid != p->uid
+        && current->euid != p->euid) {
+        return -EPERM;
+    }
+
+    if (nice < p->nice && current->euid != ROOT_UID) {
+        return -EACCES;
+    }
+
+    set_user_nice(p, nice);
+    return 0;
+}
+
+SYSCALL_ATTR s32 sys_nice(s32 increment)
+{
+    proc_t* current = myproc();
+
+    increment = max(-40, min(increment, 40));
+    s32 nice = max(NICE_MIN, min(current->nice + increment, NICE_MAX));
+
+    return set_one_prio(current, nice);
+}
+
+/*
+ * Returns 20 - nice of the highest priority process found, so that the
+ * result is never negative. The C library turns it back into a nice level.
+ */
+SYSCALL_ATTR s32 sys_getpriority(s32 which, s32 who)
+{
+    s32 best = -ESRCH;
+
+    if (which == PRIO_PROCESS) {
+        proc_t const* p = who ? find_process(who) : myproc();
+        return p ? 20 - p->nice : -ESRCH;
+    }
+
+    if (which != PRIO_USER) {
+        return -EINVAL;
+    }
+
+    uid_t uid = who ? (uid_t)who : myproc()->uid;
+    bool irq = irq_save();
+
+    for (proc_t const* p = proc_first(); p; p = p->proc_next) {
+        if (p->uid == uid && p->state != ZOMBIE) {
+            best = max(best, 20 - p->nice);
+        }
+    }
+
+    irq_restore(irq);
+    return best;
+}
+
+SYSCALL_ATTR s32 sys_setpriority(s32 which, s32 who, s32 niceval)
+{
+    s32 err = -ESRCH;
+
+    niceval = max(NICE_MIN, min(niceval, NICE_MAX));
+
+    if (which == PRIO_PROCESS) {
+        proc_t* p = who ? find_process(who) : myproc();
+        return p ? set_one_prio(p, niceval) : -ESRCH;
+    }
+
+    if (which != PRIO_USER) {
+        return -EINVAL;
+    }
+
+    uid_t uid = who ? (uid_t)who : myproc()->uid;
+    bool irq = irq_save();
+
+    for (proc_t* p = proc_first(); p; p = p->proc_next) {
+        if (p->uid == uid && p->state != ZOMBIE) {
+            err = set_one_prio(p, niceval);
+        }
+    }
+
+    irq_restore(irq);
+    return err;
+}
+
+/* Scheduling */
+
+/*
+ * A real-time process can keep everything else off the CPU, so only root
+ * may hand out the real-time policies. Anyone may go back to SCHED_OTHER.
+ */
+SYSCALL_ATTR s32
+sys_sched_setscheduler(s32 pid, s32 policy, struct sched_param const* param)
+{
+    if (!vma_access_ok(
+            &myproc()->mm, (u32)param, sizeof(struct sched_param), false
+        )) {
+        return -EFAULT;
+    }
+
+    s32 prio = param->sched_priority;
+    if (policy == SCHED_OTHER) {
+        if (prio != 0) {
+            return -EINVAL;
+        }
+    } else if (policy == SCHED_FIFO || policy == SCHED_RR) {
+        if (prio < SCHED_RT_PRIO_MIN || prio > SCHED_RT_PRIO_MAX) {
+            return -EINVAL;
+        }
+    } else {
+        return -EINVAL;
+    }
+
+    proc_t* p = pid ? find_process(pid) : myproc();
+    if (!p) {
+        return -ESRCH;
+    }
+
+    proc_t const* current = myproc();
+    if (current->euid != ROOT_UID) {
+        if (current->euid != p->uid && current->euid != p->euid) {
+            return -EPERM;
+        }
+        if (policy != SCHED_OTHER) {
+            return -EPERM;
+        }
+    }
+
+    sched_setscheduler(p, (u8)policy, (u8)prio);
+    return 0;
+}
+
+SYSCALL_ATTR s32 sys_sched_getscheduler(s32 pid)
+{
+    proc_t const* p = pid ? find_process(pid) : myproc();
+    return p ? p->policy : -ESRCH;
+}
+
+SYSCALL_ATTR s32 sys_sched_getparam(s32 pid, struct sched_param* param)
+{
+    if (!vma_access_ok(
+            &myproc()->mm, (u32)param, sizeof(struct sched_param), true
+        )) {
+        return -EFAULT;
+    }
+
+    proc_t const* p = pid ? find_process(pid) : myproc();
+    if (!p) {
+        return -ESRCH;
+    }
+
+    param->sched_priority = p->rt_priority;
+    return 0;
+}
+
 /* UID */
 
 SYSCALL_ATTR uid_t sys_getuid(void) { return myproc()->uid; }
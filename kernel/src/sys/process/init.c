@@ -10,6 +10,7 @@
 #include "memory/vmm.h"
 #include <uapi/fcntl.h>
 #include "sys/process/process.h"
+#include "sys/process/sched.h"
 
 #include <ferrite/string.h>
 #include <types.h>
@@ -17,8 +18,6 @@
 proc_t* initial_proc;
 
 extern vfs_inode_t* root_inode;
-extern proc_t ptables[NUM_PROC];
-extern u32 pid_counter;
 extern u32 page_directory[1024];
 extern void jump_to_usermode(void* entry, void* user_stack);
 
@@ -92,7 +91,7 @@ inline proc_t* initproc(void) { return initial_proc; }
 
 void init_process(void)
 {
-    proc_t const* current = myproc();
+    proc_t* current = myproc();
     if (current->pid != 1) {
         abort("Init process should be PID 1!");
     }
@@ -116,24 +115,14 @@ void init_process(void)
     }
 
     while (1) {
-        for (int i = 0; i < NUM_PROC; i++) {
-            proc_t* p = &ptables[i];
-            if (p->state == ZOMBIE && p->parent == current) {
-                p->state = UNUSED;
-                free_page(p->kstack);
-                vmm_free_pagedir(p->pgdir);
-
-                p->pgdir = NULL;
-                p->kstack = NULL;
-
-                printk(
-                    "Init: reaped zombie PID %d with error code: %d\n", p->pid,
-                    p->status
-                );
-            }
-        }
-
-        yield();
+        proc_t* p = NULL;
+        wait_event(current->wait_child, (p = zombie_child(current)));
+
+        printk(
+            "Init: reaped zombie PID %d with error code: %d\n", p->pid,
+            p->status
+        );
+        release_proc(p);
     }
 }
 
@@ -145,6 +134,11 @@ void create_initial_process(void)
               "process");
     }
 
+    init->pgdir = setup_kvm();
+    if (!init->pgdir) {
+        abort("create_initial_process: could not set up the page directory");
+    }
+
     u32* sp = (u32*)(init->kstack + PAGE_SIZE);
     *--sp = (u32)init_process; // EIP - function to execute
     *--sp = 0;                 // EBP
@@ -154,7 +148,7 @@ void create_initial_process(void)
     init->context = (context_t*)sp;
 
     strlcpy(init->name, "init", sizeof(init->name));
-    init->state = READY;
+    runqueue_add(init);
 
     initial_proc = init;
 
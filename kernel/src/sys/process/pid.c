@@ -0,0 +1,112 @@
+#include "sys/process/pid.h"
+#include "arch/x86/io.h"
+#include "sys/process/process.h"
+
+#include <types.h>
+
+static pidmap_t pidmap = { 0 };
+static proc_t* pid_hash[PID_HASH_BUCKETS] = { 0 };
+
+/* Private */
+
+static inline u32 pid_hashfn(pid_t pid) { return (u32)pid % PID_HASH_BUCKETS; }
+
+/* Public */
+
+pid_t pidmap_alloc(pidmap_t* map)
+{
+    bool irq = irq_save();
+    pid_t pid = map->last;
+
+    for (u32 n = 0; n < PID_MAX; n += 1) {
+        pid += 1;
+        if (pid >= PID_MAX) {
+            pid = 1;
+        }
+
+        u32* word = &map->bitmap[pid / 32];
+        u32 bit = 1u << (pid % 32);
+
+        /* Skip whole words that are taken */
+        if (pid % 32 == 0 && *word == ~0u) {
+            pid += 31;
+            n += 31;
+            continue;
+        }
+
+        if (!(*word & bit)) {
+            *word |= bit;
+            map->last = pid;
+            map->nr_used += 1;
+
+            irq_restore(irq);
+            return pid;
+        }
+    }
+
+    irq_restore(irq);
+    return -1;
+}
+
+void pidmap_free(pidmap_t* map, pid_t pid)
+{
+    if (pid <= 0 || pid >= PID_MAX) {
+        return;
+    }
+
+    bool irq = irq_save();
+    u32* word = &map->bitmap[pid / 32];
+    u32 bit = 1u << (pid % 32);
+
+    if (*word & bit) {
+        *word &= ~bit;
+        map->nr_used -= 1;
+    }
+
+    irq_restore(irq);
+}
+
+pid_t pid_alloc(void) { return pidmap_alloc(&pidmap); }
+
+void pid_free(pid_t pid) { pidmap_free(&pidmap, pid); }
+
+void pid_hash_add(proc_t* p)
+{
+    bool irq = irq_save();
+    proc_t** bucket = &pid_hash[pid_hashfn(p->pid)];
+
+    p->pid_next = *bucket;
+    *bucket = p;
+
+    irq_restore(irq);
+}
+
+void pid_hash_del(proc_t* p)
+{
+    bool irq = irq_save();
+    proc_t** link = &pid_hash[pid_hashfn(p->pid)];
+
+    while (*link && *link != p) {
+        link = &(*link)->pid_next;
+    }
+
+    if (*link) {
+        *link = p->pid_next;
+        p->pid_next = NULL;
+    }
+
+    irq_restore(irq);
+}
+
+proc_t* find_process(pid_t pid)
+{
+    bool irq = irq_save();
+    proc_t* p = pid_hash[pid_hashfn(pid)];
+
+    while (p && p->pid != pid) {
+        p = p->pid_next;
+    }
+
+    irq_restore(irq);
+    return p;
+}
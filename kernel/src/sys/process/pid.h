@@ -0,0 +1,40 @@
+#ifndef PID_H
+#define PID_H
+
+#include "sys/process/process.h"
+
+#include <types.h>
+
+#define PID_MAX 32768 // PIDs go from 1 to PID_MAX - 1
+#define PID_HASH_BUCKETS 256
+
+/*
+ * One bit per PID. Searching starts after the last PID handed out, so a PID
+ * that was just freed is not reused until the numbers wrap around.
+ */
+typedef struct {
+    u32 bitmap[PID_MAX / 32];
+    pid_t last;
+    u32 nr_used;
+} pidmap_t;
+
+/**
+ * Takes the next free PID from `map`.
+ *
+ * @return The PID, or -1 if all of them are in use.
+ */
+pid_t pidmap_alloc(pidmap_t* map);
+
+void pidmap_free(pidmap_t* map, pid_t pid);
+
+/* The same, on the map of the running system */
+pid_t pid_alloc(void);
+
+void pid_free(pid_t pid);
+
+/* Makes `p` visible to find_process() under its PID */
+void pid_hash_add(proc_t* p);
+
+void pid_hash_del(proc_t* p);
+
+#endif /* PID_H */
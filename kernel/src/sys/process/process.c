@@ -1,13 +1,20 @@
 #include "sys/process/process.h"
+#include "arch/x86/cpu.h"
 #include "arch/x86/gdt/gdt.h"
 #include "arch/x86/io.h"
 #include "arch/x86/memlayout.h"
 #include "fs/vfs.h"
 #include "lib/stdlib.h"
+#include "memory/buddy_allocator/buddy.h"
 #include "memory/consts.h"
+#include "memory/mmap.h"
 #include "memory/page.h"
+#include "memory/slab.h"
+#include "memory/vma.h"
 #include "memory/vmm.h"
 #include "sys/file/file.h"
+#include "sys/process/pid.h"
+#include "sys/process/sched.h"
 #include "sys/signal/signal.h"
 #include "sys/timer/timer.h"
 
@@ -18,12 +25,13 @@
 extern vfs_inode_t* root_inode;
 extern u32 page_directory[1024];
 
-proc_t ptables[NUM_PROC] = { 0 };
 proc_t* current_proc = NULL;
 context_t* scheduler_context;
-s32 pid_counter = 1;
 
-s32 ticks_remaining;
+static kmem_cache_t* proc_cache = NULL;
+static proc_t* proc_head = NULL; // All processes, oldest first
+static proc_t* proc_tail = NULL;
+
 bool volatile need_resched = false;
 
 /* Private */
@@ -46,62 +54,183 @@ static inline void inherit_credentials(proc_t* child, proc_t* parent)
     child->gid = child->egid = child->sgid = ROOT_UID;
 }
 
+/* Interrupts must be off */
+static void add_child(proc_t* parent, proc_t* p)
+{
+    p->parent = parent;
+    p->sibling_prev = NULL;
+    p->sibling_next = parent->children;
+    if (parent->children) {
+        parent->children->sibling_prev = p;
+    }
+    parent->children = p;
+}
+
+/* Interrupts must be off */
+static void del_child(proc_t* p)
+{
+    if (!p->parent) {
+        return;
+    }
+
+    if (p->sibling_prev) {
+        p->sibling_prev->sibling_next = p->sibling_next;
+    } else {
+        p->parent->children = p->sibling_next;
+    }
+
+    if (p->sibling_next) {
+        p->sibling_next->sibling_prev = p->sibling_prev;
+    }
+
+    p->sibling_next = NULL;
+    p->sibling_prev = NULL;
+    p->parent = NULL;
+}
+
+static void link_proc(proc_t* p, proc_t* parent)
+{
+    bool irq = irq_save();
+
+    p->proc_next = NULL;
+    p->proc_prev = proc_tail;
+    if (proc_tail) {
+        proc_tail->proc_next = p;
+    } else {
+        proc_head = p;
+    }
+    proc_tail = p;
+
+    if (parent) {
+        add_child(parent, p);
+    }
+    pid_hash_add(p);
+
+    irq_restore(irq);
+}
+
+static void unlink_proc(proc_t* p)
+{
+    bool irq = irq_save();
+
+    pid_hash_del(p);
+    del_child(p);
+
+    if (p->proc_prev) {
+        p->proc_prev->proc_next = p->proc_next;
+    } else {
+        proc_head = p->proc_next;
+    }
+
+    if (p->proc_next) {
+        p->proc_next->proc_prev = p->proc_prev;
+    } else {
+        proc_tail = p->proc_prev;
+    }
+
+    irq_restore(irq);
+}
+
+/*
+ * Hands the children of an exiting process to init, in time proportional to
+ * their number. Returns true if one of them is a zombie already.
+ */
+static bool reparent_children(proc_t* p, proc_t* init)
+{
+    bool zombies = false;
+    bool irq = irq_save();
+
+    while (p->children) {
+        proc_t* child = p->children;
+
+        del_child(child);
+        add_child(init, child);
+        zombies |= child->state == ZOMBIE;
+    }
+
+    irq_restore(irq);
+    return zombies;
+}
+
 proc_t* __alloc_proc(void)
 {
-    for (s32 i = 0; i < NUM_PROC; i += 1) {
-        if (ptables[i].state == UNUSED) {
-            proc_t* p = &ptables[i];
-
-            inherit_credentials(p, current_proc);
-            p->state = EMBRYO;
-            p->pid = pid_counter;
-            pid_counter += 1;
-
-            p->kstack = get_free_page();
-            if (!p->kstack) {
-                p->state = UNUSED;
-                return NULL;
-            }
+    proc_t* p = kmem_cache_alloc(proc_cache);
+    if (!p) {
+        return NULL;
+    }
+    memset(p, 0, sizeof(proc_t));
 
-            p->pgdir = setup_kvm();
-            if (!p->pgdir) {
-                p->state = UNUSED;
-                free_page(p->kstack);
-                return NULL;
-            }
+    p->pid = pid_alloc();
+    if (p->pid < 0) {
+        kmem_cache_free(proc_cache, p);
+        return NULL;
+    }
 
-            p->parent = current_proc;
-            p->root = current_proc ? current_proc->root : root_inode;
-            p->root->i_count += 1;
+    p->kstack = get_free_page();
+    if (!p->kstack) {
+        pid_free(p->pid);
+        kmem_cache_free(proc_cache, p);
+        return NULL;
+    }
 
-            p->pwd = current_proc ? current_proc->pwd : root_inode;
-            p->pwd->i_count += 1;
+    inherit_credentials(p, current_proc);
+    p->state = EMBRYO;
+    sched_fork(p, current_proc);
 
-            for (int fd = 0; fd < MAX_OPEN_FILES; fd += 1) {
-                p->open_files[fd] = NULL;
+    p->root = current_proc ? current_proc->root : root_inode;
+    p->root->i_count += 1;
 
-                if (myproc() && myproc()->open_files[fd]) {
-                    p->open_files[fd] = current_proc->open_files[fd];
-                    p->open_files[fd]->f_count += 1;
-                }
-            }
+    p->pwd = current_proc ? current_proc->pwd : root_inode;
+    p->pwd->i_count += 1;
 
-            return p;
+    for (int fd = 0; fd < MAX_OPEN_FILES; fd += 1) {
+        if (myproc() && myproc()->open_files[fd]) {
+            p->open_files[fd] = current_proc->open_files[fd];
+            p->open_files[fd]->f_count += 1;
         }
     }
 
-    return NULL;
+    link_proc(p, current_proc);
+    return p;
 }
 
 /* Public */
 
+void proc_init(void)
+{
+    proc_cache = kmem_cache_create("proc", sizeof(proc_t));
+    if (!proc_cache) {
+        abort("proc_init: could not create the proc cache");
+    }
+}
+
+void release_proc(proc_t* p)
+{
+    runqueue_del(p);
+    unlink_proc(p);
+    pid_free(p->pid);
+
+    /* do_exit() gives it back, this only catches a path that did not */
+    if (p->vfork_parent) {
+        p->pgdir = NULL;
+        vfork_release(p);
+    }
+
+    free_page(p->kstack);
+    vmm_free_pagedir(p->pgdir);
+
+    kmem_cache_free(proc_cache, p);
+}
+
 inline proc_t* myproc(void) { return current_proc; }
 
-inline proc_t* find_process(pid_t pid)
+proc_t* proc_first(void) { return proc_head; }
+
+proc_t* zombie_child(proc_t const* p)
 {
-    for (s32 i = 0; i < NUM_PROC; i += 1) {
-        if (ptables[i].pid == pid) {
-            return &ptables[i];
+    for (proc_t* child = p->children; child; child = child->sibling_next) {
+        if (child->state == ZOMBIE) {
+            return child;
         }
     }
 
@@ -119,29 +248,13 @@ inline void check_resched(void)
     yield();
 }
 
-void wakeup(void* channel)
-{
-    for (proc_t* p = &ptables[0]; p < &ptables[NUM_PROC]; p += 1) {
-        if (p->channel == channel && p->state == SLEEPING) {
-            p->state = READY;
-        }
-    }
-}
-
 void do_exit(s32 status)
 {
     proc_t* p = myproc();
     proc_t* init = initproc();
 
-    for (s32 i = 0; i < NUM_PROC; i++) {
-        if (ptables[i].parent != p) {
-            continue;
-        }
-
-        ptables[i].parent = init;
-        if (ptables[i].state == ZOMBIE) {
-            wakeup(init);
-        }
+    if (reparent_children(p, init)) {
+        wake_up(&init->wait_child);
     }
 
     cli();
@@ -164,9 +277,19 @@ void do_exit(s32 status)
         }
     }
 
+    /* The address space belongs to the parent we borrowed it from */
+    if (p->vfork_parent) {
+        p->pgdir = NULL;
+        vfork_release(p);
+    } else {
+        exit_mmap(&p->mm);
+    }
+
     p->status = status;
-    wakeup(p->parent);
     p->state = ZOMBIE;
+    if (p->parent) {
+        wake_up(&p->parent->wait_child);
+    }
 
     swtch(&p->context, scheduler_context);
     __builtin_unreachable();
@@ -174,67 +297,27 @@ void do_exit(s32 status)
 
 pid_t do_wait(s32* status)
 {
-    while (true) {
-        bool have_kids = false;
-
-        for (s32 i = 0; i < NUM_PROC; i += 1) {
-            proc_t* p = &ptables[i];
-
-            if (p->parent != myproc()) {
-                continue;
-            }
-
-            have_kids = true;
-            if (p->state == ZOMBIE) {
-                pid_t pid = p->pid;
-                if (status) {
-                    *status = p->status;
-                }
-
-                free_page(p->kstack);
-                p->kstack = NULL;
-
-                vmm_free_pagedir(p->pgdir);
-                p->pgdir = NULL;
-
-                p->state = UNUSED;
-                p->pid = 0;
-                p->parent = NULL;
-
-                return pid;
-            }
-        }
-
-        if (!have_kids) {
-            return -1;
-        }
-
-        waitchan(myproc());
+    proc_t* me = myproc();
+    proc_t* p = NULL;
+
+    s32 err = wait_event_interruptible(
+        me->wait_child, !me->children || (p = zombie_child(me))
+    );
+    if (err < 0) {
+        return err;
     }
-}
 
-void* setup_kvm(void)
-{
-    u32* pgdir = (u32*)get_free_page();
-    if (!pgdir) {
-        return NULL;
-    }
-
-    for (int i = 0; i < 4; i++) {
-        if (page_directory[i] & PTE_P) {
-            pgdir[i] = page_directory[i];
-        }
+    if (!p) {
+        return -1;
     }
 
-    for (int i = (KERNBASE >> 22); i < 1024; i++) {
-        if (page_directory[i] & PTE_P) {
-            pgdir[i] = page_directory[i];
-        }
+    pid_t pid = p->pid;
+    if (status) {
+        *status = p->status;
     }
 
-    pgdir[1023] = V2P_WO((u32)pgdir) | PTE_P | PTE_W | PTE_U;
-
-    return pgdir;
+    release_proc(p);
+    return pid;
 }
 
 pid_t do_exec(char const* name, void (*f)(void))
@@ -244,6 +327,12 @@ pid_t do_exec(char const* name, void (*f)(void))
         return -1;
     }
 
+    p->pgdir = setup_kvm();
+    if (!p->pgdir) {
+        release_proc(p);
+        return -1;
+    }
+
     u32* ctx = (u32*)(p->kstack + PAGE_SIZE);
     *(--ctx) = (u32)f; // EIP
     *(--ctx) = 0;      // EBP
@@ -253,85 +342,114 @@ pid_t do_exec(char const* name, void (*f)(void))
     p->context = (context_t*)ctx;
 
     strlcpy(p->name, name, sizeof(p->name));
-    p->state = READY;
+    runqueue_add(p);
 
     return p->pid;
 }
 
 extern u32 trapret(void);
 
-#define PTE_ADDR(pte) ((pte) & ~0xFFF)
-
-void* vmm_copy_pgdir(const u32* parent_pgdir)
+/*
+ * Lets the child return from the fork-like syscall with eax = 0, on its own
+ * kernel stack.
+ */
+static void copy_thread(proc_t* p, trapframe_t const* parent_tf)
 {
-    u32* child_pgdir = (u32*)setup_kvm();
-    if (!child_pgdir)
-        return NULL;
-
-    u32 pde_limit = KERNBASE >> 22;
-
-    for (u32 pde = 4; pde < pde_limit; pde++) {
-        if (!(parent_pgdir[pde] & PTE_P))
-            continue;
-
-        u32* new_pt = (u32*)get_free_page();
-        if (!new_pt)
-            return NULL;
+    trapframe_t* child_tf
+        = (trapframe_t*)(p->kstack + PAGE_SIZE - sizeof(trapframe_t));
+    *child_tf = *parent_tf;
+    child_tf->eax = 0;
 
-        u32* parent_pt = (u32*)P2V_WO(PTE_ADDR(parent_pgdir[pde]));
+    u32* ctx = (u32*)child_tf;
+    *(--ctx) = (u32)trapret; // EIP
+    *(--ctx) = 0;            // EBP
+    *(--ctx) = 0;            // EBX
+    *(--ctx) = 0;            // ESI
+    *(--ctx) = 0;            // EDI
+    p->context = (context_t*)ctx;
+}
 
-        for (u32 pte = 0; pte < 1024; pte++) {
-            if (!(parent_pt[pte] & PTE_P)) {
-                new_pt[pte] = 0;
-                continue;
-            }
+pid_t do_fork(trapframe_t* parent_tf, char const* name)
+{
+    proc_t* p = __alloc_proc();
+    if (!p) {
+        return -1;
+    }
 
-            char* new_page = get_free_page();
-            if (!new_page)
-                return NULL; // TODO: cleanup
+    p->pgdir = vmm_copy_pgdir(myproc()->pgdir, cpu_has(X86_FEATURE_WP));
+    if (!p->pgdir) {
+        goto fail;
+    }
 
-            char* parent_page = (char*)P2V_WO(PTE_ADDR(parent_pt[pte]));
-            memcpy(new_page, parent_page, PAGE_SIZE);
+    p->mm = myproc()->mm;
+    p->mm.min_flt = 0;
+    p->mm.maj_flt = 0;
+    if (vma_copy_all(&p->mm, &myproc()->mm) < 0) {
+        vmm_free_pagedir(p->pgdir);
+        p->pgdir = NULL;
+        goto fail;
+    }
 
-            new_pt[pte] = V2P_WO((u32)new_page) | (parent_pt[pte] & 0xFFF);
-        }
+    copy_thread(p, parent_tf);
+    strlcpy(p->name, name, sizeof(p->name));
 
-        child_pgdir[pde] = V2P_WO((u32)new_pt) | (parent_pgdir[pde] & 0xFFF);
-    }
+    runqueue_add(p);
+    return p->pid;
 
-    return child_pgdir;
+fail:
+    release_proc(p);
+    return -1;
 }
 
-pid_t do_fork(trapframe_t* parent_tf, char const* name)
+pid_t do_vfork(trapframe_t* parent_tf, char const* name)
 {
+    proc_t* parent = myproc();
     proc_t* p = __alloc_proc();
     if (!p) {
         return -1;
     }
 
-    free_page(p->pgdir);
-    p->pgdir = vmm_copy_pgdir(myproc()->pgdir);
-    if (!p->pgdir) {
-        return -1;
+    p->pgdir = parent->pgdir;
+    p->vfork_parent = parent;
+
+    /*
+     * The areas are borrowed too. The parent sleeps until we are done, so
+     * only our copy of the list is used and vfork_release() hands it back.
+     */
+    p->mm = parent->mm;
+    p->mm.min_flt = 0;
+    p->mm.maj_flt = 0;
+    copy_thread(p, parent_tf);
+    strlcpy(p->name, name, sizeof(p->name));
+
+    pid_t pid = p->pid;
+    runqueue_add(p);
+
+    wait_event(parent->wait_child, p->vfork_parent != parent);
+
+    return pid;
+}
+
+void vfork_release(proc_t* p)
+{
+    if (!p->vfork_parent) {
+        return;
     }
 
-    trapframe_t* child_tf
-        = (trapframe_t*)(p->kstack + PAGE_SIZE - sizeof(trapframe_t));
-    *child_tf = *parent_tf;
-    child_tf->eax = 0;
+    proc_t* parent = p->vfork_parent;
+    p->vfork_parent = NULL;
 
-    u32* ctx = (u32*)child_tf;
-    *(--ctx) = (u32)trapret; // EIP
-    *(--ctx) = 0;            // EBP
-    *(--ctx) = 0;            // EBX
-    *(--ctx) = 0;            // ESI
-    *(--ctx) = 0;            // EDI
-    p->context = (context_t*)ctx;
+    /* Keeps whatever brk(), mmap() or a growing stack changed meanwhile */
+    u32 min_flt = parent->mm.min_flt;
+    u32 maj_flt = parent->mm.maj_flt;
+    parent->mm = p->mm;
+    parent->mm.min_flt = min_flt;
+    parent->mm.maj_flt = maj_flt;
 
-    strlcpy(p->name, name, sizeof(p->name));
+    p->mm.mmap = NULL;
+    p->mm.map_count = 0;
 
-    p->state = READY;
-    return p->pid;
+    wake_up(&parent->wait_child);
 }
 
 inline void yield(void)
@@ -354,39 +472,38 @@ void schedule(void)
     }
     scheduler_context = (context_t*)(scheduler_stack + PAGE_SIZE);
 
-    // FIFO - Round Robin
     while (true) {
-        for (s32 i = 0; i < NUM_PROC; i += 1) {
-            if (ptables[i].state != READY) {
-                continue;
-            }
-            proc_t* p = &ptables[i];
-            current_proc = p;
-
-            handle_signal();
-            if (p->state != READY && p->state != RUNNING) {
-                current_proc = NULL;
-                continue;
+        proc_t* p = runqueue_pop();
+        if (!p) {
+            /* Nothing to run: clear pages for later while waiting */
+            zero_pool_refill();
+
+            /* sti only takes effect after hlt, no wakeup slips in between */
+            cli();
+            if (!runqueue_length()) {
+                __asm__ volatile("sti; hlt");
             }
+            sti();
+            continue;
+        }
 
-            p->state = RUNNING;
-            ticks_remaining = TIME_QUANTUM;
-
-            u32 kernel_stack_top = (u32)p->kstack + PAGE_SIZE;
-            tss_set_stack(kernel_stack_top);
+        current_proc = p;
+        p->state = RUNNING;
+        p->slice_ticks = 0;
 
-            lcr3(V2P_WO((u32)p->pgdir));
-            swtch(&scheduler_context, p->context);
-            lcr3(V2P_WO((u32)page_directory));
+        u32 kernel_stack_top = (u32)p->kstack + PAGE_SIZE;
+        tss_set_stack(kernel_stack_top);
 
-            if (current_proc && current_proc->state == RUNNING) {
-                current_proc->state = READY;
-            }
+        lcr3(V2P_WO((u32)p->pgdir));
+        swtch(&scheduler_context, p->context);
+        lcr3(V2P_WO((u32)page_directory));
 
-            current_proc = NULL;
+        /* Preempted or yielded, back on the queue */
+        proc_t* prev = current_proc;
+        if (prev && (prev->state == RUNNING || prev->state == READY)) {
+            runqueue_put_prev(prev);
         }
 
-        sti();
-        __asm__ volatile("hlt");
+        current_proc = NULL;
     }
 }
@@ -5,13 +5,13 @@
 #include "fs/vfs.h"
 #include "idt/idt.h"
 #include "sys/file/file.h"
+#include "sys/process/wait.h"
 #include <limits.h>
+#include <stdbool.h>
 
 #include <types.h>
 
 #define MAX_OPEN_FILES 64
-#define NUM_PROC 32
-#define TIME_QUANTUM (100 * HZ / 1000)
 #define ROOT_UID 0
 
 typedef s32 pid_t;
@@ -29,6 +29,12 @@ typedef struct {
 
     unsigned int stack_start;
     unsigned int stack_end;
+
+    struct vm_area* mmap; // Sorted by address, see memory/vma.h
+    u32 map_count;
+
+    u32 min_flt; // Faults resolved without I/O
+    u32 maj_flt; // Faults that had to read from disk
 } memory_t;
 
 typedef struct process {
@@ -48,10 +54,21 @@ typedef struct process {
     context_t* context;
 
     void* pgdir;
+    struct process* vfork_parent; // Suspended in vfork() until we exec/exit
     char* kstack;
     memory_t mm;
 
-    void* channel;
+    u8 policy;      // SCHED_OTHER, SCHED_FIFO or SCHED_RR
+    u8 rt_priority; // 1 to 99 under the real-time policies, 0 otherwise
+    bool yielded;   // Requeue behind the others of its priority
+    s8 nice;
+    u32 weight;      // From `nice`, see sys/process/sched.h
+    u64 vruntime;    // Ticks run, scaled by NICE_0_WEIGHT / weight
+    u32 slice_ticks; // Ticks run since it was last picked
+    bool on_rq;      // Queued on the run queue
+    struct process* rq_next;
+    struct process* rq_prev;
+
     unsigned int pending_signals;
     int status;
 
@@ -61,6 +78,17 @@ typedef struct process {
     file_t* open_files[MAX_OPEN_FILES];
 
     struct process* parent;
+    struct process* children;     // Newest first
+    struct process* sibling_next; // Other children of the same parent
+    struct process* sibling_prev;
+
+    /* Woken when a child exits or a vfork() child lets go of our memory */
+    wait_queue_head_t wait_child;
+
+    struct process* pid_next;  // Same bucket of the PID hash
+    struct process* proc_next; // Every process, oldest first
+    struct process* proc_prev;
+
     char name[16];
 } proc_t;
 
@@ -82,6 +110,21 @@ void yield(void);
  */
 pid_t do_fork(trapframe_t*, char const*);
 
+/**
+ * Creates a child that runs in the parent's address space. The parent is
+ * suspended until the child calls execve() or exits, so nothing is copied.
+ *
+ * @param name  Process name for the child process
+ * @return      Child PID in parent process, 0 in child process, -1 on error
+ */
+pid_t do_vfork(trapframe_t*, char const*);
+
+/**
+ * Hands the borrowed areas back to the parent of a vfork() child and wakes
+ * it. Called once the child stops using the borrowed address space.
+ */
+void vfork_release(proc_t* p);
+
 /**
  * Creates a new process that starts executing the specified function.
  * The new process begins execution at function f, not at the call site.
@@ -94,20 +137,35 @@ pid_t do_exec(char const* name, void (*f)(void));
 
 void do_exit(s32 status);
 
-void wakeup(void* channel);
-
 pid_t do_wait(s32* status);
 
 void process_list(void);
 
+/* Looks `pid` up in the PID hash, see sys/process/pid.c */
 proc_t* find_process(pid_t pid);
 
-void check_resched(void);
+/**
+ * The oldest process, follow `proc_next` for the others. Interrupts must be
+ * off while walking the list, a process may be released otherwise.
+ */
+proc_t* proc_first(void);
 
-void* setup_kvm(void);
+/* A child of `p` that has exited and waits to be reaped, or NULL */
+proc_t* zombie_child(proc_t const* p);
+
+void check_resched(void);
 
 proc_t* __alloc_proc(void);
 
+/**
+ * Frees what is left of a reaped zombie, its kernel stack and page tables,
+ * its PID and the descriptor itself.
+ */
+void release_proc(proc_t* p);
+
+/* Creates the cache process descriptors are allocated from */
+void proc_init(void);
+
 proc_t* myproc(void);
 
 proc_t* initproc(void);
@@ -0,0 +1,421 @@
+#include "sys/process/sched.h"
+#include "arch/x86/bitops.h"
+#include "arch/x86/io.h"
+#include "lib/math.h"
+#include "sys/process/process.h"
+
+#include <types.h>
+
+extern proc_t* current_proc;
+
+static runqueue_t runqueue = { 0 };
+
+/*
+ * Weight of each nice level, from NICE_MIN to NICE_MAX. One level apart is
+ * about 10% more or less CPU, the weights differ by a factor of 1.25.
+ */
+static u32 const nice_to_weight[NICE_MAX - NICE_MIN + 1] = {
+    88761, 71755, 56483, 46273, 36291, 29154, 23254, 18705, 14949, 11916,
+    9548,  7620,  6100,  4904,  3906,  3121,  2501,  1991,  1586,  1277,
+    1024,  820,   655,   526,   423,   335,   272,   215,   172,   137,
+    110,   87,    70,    56,    45,    36,    29,    23,    18,    15,
+};
+
+/* Private */
+
+static inline u64 vruntime_per_tick(proc_t const* p)
+{
+    return VRUNTIME_TICK * NICE_0_WEIGHT / p->weight;
+}
+
+/* Ticks `p` may run before the others get their turn */
+static u32 sched_slice(proc_t const* p)
+{
+    u32 slice = SCHED_LATENCY * p->weight / (runqueue.load + p->weight);
+    return max(slice, SCHED_MIN_GRANULARITY);
+}
+
+/* Interrupts must be off */
+static void update_min_vruntime(void)
+{
+    proc_t const* curr = current_proc;
+    proc_t const* first = runqueue.fair.head;
+    u64 vruntime;
+
+    if (curr && curr->state == RUNNING && !rt_task(curr)) {
+        vruntime = curr->vruntime;
+        if (first && first->vruntime < vruntime) {
+            vruntime = first->vruntime;
+        }
+    } else if (first) {
+        vruntime = first->vruntime;
+    } else {
+        return;
+    }
+
+    if (vruntime > runqueue.min_vruntime) {
+        runqueue.min_vruntime = vruntime;
+    }
+}
+
+/*
+ * Processes with the same virtual runtime take turns. Woken processes sort
+ * in front and requeued ones near the end, so both are found from the
+ * closer end of the list.
+ */
+static void list_insert(sched_list_t* list, proc_t* p)
+{
+    proc_t* prev = list->tail;
+
+    if (list->head && p->vruntime < list->head->vruntime) {
+        prev = NULL;
+    } else {
+        while (prev && prev->vruntime > p->vruntime) {
+            prev = prev->rq_prev;
+        }
+    }
+
+    p->rq_prev = prev;
+    p->rq_next = prev ? prev->rq_next : list->head;
+
+    if (p->rq_next) {
+        p->rq_next->rq_prev = p;
+    } else {
+        list->tail = p;
+    }
+
+    if (prev) {
+        prev->rq_next = p;
+    } else {
+        list->head = p;
+    }
+}
+
+static void list_push_front(sched_list_t* list, proc_t* p)
+{
+    p->rq_prev = NULL;
+    p->rq_next = list->head;
+
+    if (list->head) {
+        list->head->rq_prev = p;
+    } else {
+        list->tail = p;
+    }
+    list->head = p;
+}
+
+static void list_push_back(sched_list_t* list, proc_t* p)
+{
+    p->rq_next = NULL;
+    p->rq_prev = list->tail;
+
+    if (list->tail) {
+        list->tail->rq_next = p;
+    } else {
+        list->head = p;
+    }
+    list->tail = p;
+}
+
+static void list_remove(sched_list_t* list, proc_t* p)
+{
+    if (p->rq_prev) {
+        p->rq_prev->rq_next = p->rq_next;
+    } else {
+        list->head = p->rq_next;
+    }
+
+    if (p->rq_next) {
+        p->rq_next->rq_prev = p->rq_prev;
+    } else {
+        list->tail = p->rq_prev;
+    }
+
+    p->rq_next = NULL;
+    p->rq_prev = NULL;
+}
+
+static inline u32 rt_index(proc_t const* p)
+{
+    return MAX_RT_PRIO - 1 - p->rt_priority;
+}
+
+/* Interrupts must be off. `front` puts a real-time process first in line. */
+static void __runqueue_add(proc_t* p, bool front)
+{
+    if (rt_task(p)) {
+        u32 i = rt_index(p);
+
+        if (front) {
+            list_push_front(&runqueue.rt[i], p);
+        } else {
+            list_push_back(&runqueue.rt[i], p);
+        }
+        runqueue.rt_bitmap[i / 32] |= 1U << (i % 32);
+    } else {
+        list_insert(&runqueue.fair, p);
+        runqueue.load += p->weight;
+    }
+
+    runqueue.nr_running += 1;
+    p->on_rq = true;
+}
+
+/* Interrupts must be off */
+static void __runqueue_del(proc_t* p)
+{
+    if (rt_task(p)) {
+        u32 i = rt_index(p);
+
+        list_remove(&runqueue.rt[i], p);
+        if (!runqueue.rt[i].head) {
+            runqueue.rt_bitmap[i / 32] &= ~(1U << (i % 32));
+        }
+    } else {
+        list_remove(&runqueue.fair, p);
+        runqueue.load -= p->weight;
+    }
+
+    runqueue.nr_running -= 1;
+    p->on_rq = false;
+}
+
+/* Interrupts must be off */
+static proc_t* runqueue_first(void)
+{
+    for (u32 w = 0; w < RT_BITMAP_WORDS; w += 1) {
+        if (runqueue.rt_bitmap[w]) {
+            return runqueue.rt[w * 32 + __ffs(runqueue.rt_bitmap[w])].head;
+        }
+    }
+
+    return runqueue.fair.head;
+}
+
+/* Whether `p` should take the CPU from `curr` */
+static bool preempts(proc_t const* p, proc_t const* curr)
+{
+    if (rt_task(p)) {
+        return !rt_task(curr) || p->rt_priority > curr->rt_priority;
+    }
+
+    if (rt_task(curr)) {
+        return false;
+    }
+
+    return p->vruntime + SCHED_WAKEUP_GRANULARITY < curr->vruntime;
+}
+
+/* Interrupts must be off */
+static void check_preempt_wakeup(proc_t const* p)
+{
+    proc_t const* curr = current_proc;
+
+    if (!curr || curr == p || curr->state != RUNNING) {
+        return;
+    }
+
+    if (preempts(p, curr)) {
+        need_resched = true;
+    }
+}
+
+/* Public */
+
+void runqueue_add(proc_t* p)
+{
+    bool irq = irq_save();
+
+    p->state = READY;
+    if (!p->on_rq) {
+        __runqueue_add(p, false);
+    }
+
+    irq_restore(irq);
+}
+
+void runqueue_put_prev(proc_t* p)
+{
+    bool irq = irq_save();
+    bool front = false;
+
+    if (p->policy == SCHED_FIFO) {
+        front = !p->yielded;
+    } else if (p->policy == SCHED_RR) {
+        front = !p->yielded && p->slice_ticks < SCHED_RR_TIMESLICE;
+    }
+
+    p->yielded = false;
+    p->state = READY;
+    if (!p->on_rq) {
+        __runqueue_add(p, front);
+    }
+
+    irq_restore(irq);
+}
+
+void runqueue_del(proc_t* p)
+{
+    bool irq = irq_save();
+
+    if (p->on_rq) {
+        __runqueue_del(p);
+    }
+
+    irq_restore(irq);
+}
+
+proc_t* runqueue_pop(void)
+{
+    bool irq = irq_save();
+    proc_t* p = NULL;
+
+    while ((p = runqueue_first())) {
+        __runqueue_del(p);
+
+        /* Whatever changed its state since does not belong here */
+        if (p->state == READY) {
+            break;
+        }
+        p = NULL;
+    }
+
+    irq_restore(irq);
+    return p;
+}
+
+u32 runqueue_length(void) { return runqueue.nr_running; }
+
+void wake_up_process(proc_t* p)
+{
+    bool irq = irq_save();
+
+    if (p->state == SLEEPING) {
+        u64 floor = runqueue.min_vruntime > SCHED_SLEEPER_CREDIT
+            ? runqueue.min_vruntime - SCHED_SLEEPER_CREDIT
+            : 0;
+        if (!rt_task(p) && p->vruntime < floor) {
+            p->vruntime = floor;
+        }
+
+        runqueue_add(p);
+        check_preempt_wakeup(p);
+    }
+
+    irq_restore(irq);
+}
+
+void sched_fork(proc_t* p, proc_t const* parent)
+{
+    bool irq = irq_save();
+
+    p->policy = parent ? parent->policy : SCHED_OTHER;
+    p->rt_priority = parent ? parent->rt_priority : 0;
+    p->yielded = false;
+    p->nice = parent ? parent->nice : 0;
+    p->weight = nice_to_weight[p->nice - NICE_MIN];
+    p->vruntime = runqueue.min_vruntime;
+    if (parent && parent->vruntime > p->vruntime) {
+        p->vruntime = parent->vruntime;
+    }
+
+    irq_restore(irq);
+}
+
+void sched_tick(void)
+{
+    proc_t* p = current_proc;
+    if (!p || p->state != RUNNING || p->policy == SCHED_FIFO) {
+        return;
+    }
+
+    p->slice_ticks += 1;
+
+    if (p->policy == SCHED_RR) {
+        /* Only others of the same priority get a turn */
+        proc_t const* next = runqueue.rt[rt_index(p)].head;
+        if (next && p->slice_ticks >= SCHED_RR_TIMESLICE) {
+            need_resched = true;
+        }
+        return;
+    }
+
+    p->vruntime += vruntime_per_tick(p);
+    update_min_vruntime();
+
+    if (runqueue.nr_running && p->slice_ticks >= sched_slice(p)) {
+        need_resched = true;
+    }
+}
+
+void set_user_nice(proc_t* p, s32 nice)
+{
+    nice = max(NICE_MIN, min(nice, NICE_MAX));
+
+    bool irq = irq_save();
+    bool queued = p->on_rq;
+
+    if (queued) {
+        __runqueue_del(p);
+    }
+
+    p->nice = (s8)nice;
+    p->weight = nice_to_weight[nice - NICE_MIN];
+
+    if (queued) {
+        __runqueue_add(p, false);
+    }
+
+    irq_restore(irq);
+}
+
+void sched_setscheduler(proc_t* p, u8 policy, u8 rt_priority)
+{
+    bool irq = irq_save();
+    bool queued = p->on_rq;
+    bool was_rt = rt_task(p);
+
+    if (queued) {
+        __runqueue_del(p);
+    }
+
+    p->policy = policy;
+    p->rt_priority = rt_priority;
+
+    /* Its virtual runtime stood still while it was real-time */
+    if (was_rt && !rt_task(p) && p->vruntime < runqueue.min_vruntime) {
+        p->vruntime = runqueue.min_vruntime;
+    }
+
+    if (queued) {
+        __runqueue_add(p, false);
+        check_preempt_wakeup(p);
+    } else if (p == current_proc && p->state == RUNNING) {
+        proc_t const* first = runqueue_first();
+        if (first && preempts(first, p)) {
+            need_resched = true;
+        }
+    }
+
+    irq_restore(irq);
+}
+
+void sched_yield(void)
+{
+    proc_t* p = current_proc;
+    if (!p) {
+        return;
+    }
+
+    /* Behind everyone queued now, the equal ones it goes after */
+    bool irq = irq_save();
+    proc_t const* last = runqueue.fair.tail;
+    if (rt_task(p)) {
+        p->yielded = true;
+    } else if (last && last->vruntime > p->vruntime) {
+        p->vruntime = last->vruntime;
+    }
+    irq_restore(irq);
+
+    yield();
+}
@@ -0,0 +1,138 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include "arch/x86/pit.h"
+#include "sys/process/process.h"
+
+#include <stdbool.h>
+#include <types.h>
+#include <uapi/sched.h>
+
+/*
+ * Proportional-share scheduling. Every process has a weight, taken from its
+ * nice level, and a virtual runtime: the ticks it ran, scaled by
+ * NICE_0_WEIGHT / weight. The run queue is sorted by virtual runtime and
+ * the process furthest behind runs next, so over time each one gets CPU in
+ * proportion to its weight.
+ *
+ * Real-time processes (SCHED_FIFO, SCHED_RR) sit in a list per priority
+ * and always run before the fair ones, the highest priority first. A
+ * SCHED_FIFO process keeps the CPU until it blocks, yields or a higher
+ * priority wakes up; SCHED_RR ones of the same priority take turns every
+ * SCHED_RR_TIMESLICE ticks.
+ */
+
+#define MAX_RT_PRIO (SCHED_RT_PRIO_MAX + 1)
+#define RT_BITMAP_WORDS ((MAX_RT_PRIO + 31) / 32)
+
+#define SCHED_RR_TIMESLICE (100 * HZ / 1000)
+
+#define NICE_MIN (-20)
+#define NICE_MAX 19
+#define NICE_0_WEIGHT 1024
+
+/* Virtual runtime of one tick at nice 0 */
+#define VRUNTIME_TICK 1024ULL
+
+/* Every runnable process gets a turn within this many ticks ... */
+#define SCHED_LATENCY (100 * HZ / 1000)
+/* ... unless that would make the slices shorter than this */
+#define SCHED_MIN_GRANULARITY 1
+
+/* A woken process preempts the running one if it is this far behind */
+#define SCHED_WAKEUP_GRANULARITY VRUNTIME_TICK
+
+/*
+ * How far behind the queue a sleeper may come back, so that processes that
+ * sleep a lot get the CPU quickly without saving up for a burst.
+ */
+#define SCHED_SLEEPER_CREDIT (SCHED_LATENCY * VRUNTIME_TICK / 2)
+
+typedef struct {
+    proc_t* head;
+    proc_t* tail;
+} sched_list_t;
+
+typedef struct {
+    /* Indexed by MAX_RT_PRIO - 1 - priority, so the highest comes first */
+    sched_list_t rt[MAX_RT_PRIO];
+    u32 rt_bitmap[RT_BITMAP_WORDS]; // Bit set for every non-empty rt list
+
+    sched_list_t fair; // Sorted by vruntime, smallest first
+    u64 min_vruntime;  // Never goes back, new and woken processes start here
+    u32 nr_running;
+    u32 load; // Weights of the queued fair processes together
+} runqueue_t;
+
+/* Set to switch away from the running process on the way out of the kernel */
+extern bool volatile need_resched;
+
+static inline bool rt_task(proc_t const* p)
+{
+    return p->policy == SCHED_FIFO || p->policy == SCHED_RR;
+}
+
+/**
+ * Marks `p` READY and queues it, unless it is queued already: fair
+ * processes by virtual runtime, real-time ones at the end of their
+ * priority. Safe from interrupt handlers.
+ */
+void runqueue_add(proc_t* p);
+
+/**
+ * Queues the process that just left the CPU. A real-time one that was
+ * preempted goes back to the front of its priority, one that yielded or
+ * used up its SCHED_RR slice to the end.
+ */
+void runqueue_put_prev(proc_t* p);
+
+/* Takes `p` off the run queue if it is on it */
+void runqueue_del(proc_t* p);
+
+/**
+ * Takes the next process off the run queue: the first one of the highest
+ * real-time priority, otherwise the one with the smallest virtual runtime.
+ *
+ * @return The process, or NULL if nothing is ready to run.
+ */
+proc_t* runqueue_pop(void);
+
+/* Number of processes waiting on the run queue */
+u32 runqueue_length(void);
+
+/**
+ * Makes a SLEEPING process runnable again, anything else is left alone. The
+ * running process is preempted if `p` is real-time with a higher priority,
+ * or both are fair and `p` is far enough behind.
+ */
+void wake_up_process(proc_t* p);
+
+/**
+ * Gives a new process the policy and nice level of `parent` and a place in
+ * the queue.
+ */
+void sched_fork(proc_t* p, proc_t const* parent);
+
+/**
+ * Charges one tick to the running process and asks for a reschedule once
+ * its slice is used up. SCHED_FIFO processes have no slice. Called from the
+ * timer interrupt.
+ */
+void sched_tick(void);
+
+/* Sets the nice level of `p`, clamped to NICE_MIN..NICE_MAX */
+void set_user_nice(proc_t* p, s32 nice);
+
+/**
+ * Sets the policy of `p` and its real-time priority, which must be 0 for
+ * SCHED_OTHER. The caller checks both.
+ */
+void sched_setscheduler(proc_t* p, u8 policy, u8 rt_priority);
+
+/**
+ * Lets every other runnable process go first, for sched_yield(). Real-time
+ * processes only go behind the others of their priority.
+ */
+void sched_yield(void);
+
+#endif /* SCHED_H */
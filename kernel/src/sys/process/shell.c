@@ -3,22 +3,22 @@
 
 #include <types.h>
 
-extern proc_t ptables[NUM_PROC];
-
 void process_list(void)
 {
-    printk("PID  STATE     NAME              PPID  PARENT ADDRESS\n");
-    printk("---  --------  ----------------  ----  --------------\n");
-    for (s32 i = 0; i < NUM_PROC; i += 1) {
-        if (ptables[i].state != UNUSED) {
-            char const* state_str[] = { "UNUSED", "EMBRYO",  "SLEEPING",
-                                        "READY",  "RUNNING", "ZOMBIE" };
-            pid_t ppid = ptables[i].parent ? ptables[i].parent->pid : 0;
-            printk(
-                "%3d  %8s  %16s  %4d  0x%08x\n", ptables[i].pid,
-                state_str[ptables[i].state], ptables[i].name, ppid,
-                (u32)ptables[i].parent
-            );
-        }
+    printk(
+        "PID  STATE     NAME              PPID  PARENT ADDRESS  MINFLT  MAJFLT\n"
+    );
+    printk(
+        "---  --------  ----------------  ----  --------------  ------  ------\n"
+    );
+    for (proc_t const* p = proc_first(); p; p = p->proc_next) {
+        char const* state_str[] = { "UNUSED", "EMBRYO",  "SLEEPING",
+                                    "READY",  "RUNNING", "ZOMBIE" };
+        pid_t ppid = p->parent ? p->parent->pid : 0;
+        printk(
+            "%3d  %8s  %16s  %4d  0x%08x      %6u  %6u\n", p->pid,
+            state_str[p->state], p->name, ppid, (u32)p->parent, p->mm.min_flt,
+            p->mm.maj_flt
+        );
     }
 }
@@ -0,0 +1,100 @@
+#include "sys/process/wait.h"
+#include "arch/x86/io.h"
+#include "sys/process/process.h"
+#include "sys/process/sched.h"
+
+#include <types.h>
+
+extern context_t* scheduler_context;
+
+/* Public */
+
+void init_waitqueue_head(wait_queue_head_t* q)
+{
+    q->head = NULL;
+    q->tail = NULL;
+}
+
+void add_wait_queue(wait_queue_head_t* q, wait_queue_t* wait)
+{
+    bool irq = irq_save();
+
+    wait->next = NULL;
+    wait->prev = q->tail;
+    if (q->tail) {
+        q->tail->next = wait;
+    } else {
+        q->head = wait;
+    }
+    q->tail = wait;
+
+    irq_restore(irq);
+}
+
+void remove_wait_queue(wait_queue_head_t* q, wait_queue_t* wait)
+{
+    bool irq = irq_save();
+
+    if (wait->prev) {
+        wait->prev->next = wait->next;
+    } else {
+        q->head = wait->next;
+    }
+
+    if (wait->next) {
+        wait->next->prev = wait->prev;
+    } else {
+        q->tail = wait->prev;
+    }
+
+    wait->next = NULL;
+    wait->prev = NULL;
+
+    irq_restore(irq);
+}
+
+void wake_up(wait_queue_head_t* q)
+{
+    bool irq = irq_save();
+
+    for (wait_queue_t* w = q->head; w; w = w->next) {
+        wake_up_process(w->proc);
+    }
+
+    irq_restore(irq);
+}
+
+void wake_up_one(wait_queue_head_t* q)
+{
+    bool irq = irq_save();
+
+    /* Skip those that are awake already, the wakeup would be lost on them */
+    for (wait_queue_t* w = q->head; w; w = w->next) {
+        if (w->proc->state == SLEEPING) {
+            wake_up_process(w->proc);
+            break;
+        }
+    }
+
+    irq_restore(irq);
+}
+
+void sleep_on(wait_queue_head_t* q)
+{
+    proc_t* p = myproc();
+    wait_queue_t wait = { .proc = p, .next = NULL, .prev = NULL };
+
+    add_wait_queue(q, &wait);
+    p->state = SLEEPING;
+
+    swtch(&p->context, scheduler_context);
+
+    cli();
+    remove_wait_queue(q, &wait);
+}
+
+bool signal_pending(void)
+{
+    proc_t const* p = myproc();
+    return p && p->pending_signals;
+}
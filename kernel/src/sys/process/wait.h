@@ -0,0 +1,88 @@
+#ifndef WAIT_H
+#define WAIT_H
+
+#include "arch/x86/io.h"
+
+#include <stdbool.h>
+#include <types.h>
+#include <uapi/errno.h>
+
+struct process;
+
+/*
+ * A process waiting for something. It lives on the stack of the sleeper and
+ * is only on a queue while the process sleeps.
+ */
+typedef struct wait_queue {
+    struct process* proc;
+    struct wait_queue* next;
+    struct wait_queue* prev;
+} wait_queue_t;
+
+/* Everyone waiting for the same event, oldest first. All zero is empty. */
+typedef struct {
+    wait_queue_t* head;
+    wait_queue_t* tail;
+} wait_queue_head_t;
+
+#define WAIT_QUEUE_HEAD_INIT { NULL, NULL }
+
+void init_waitqueue_head(wait_queue_head_t* q);
+
+void add_wait_queue(wait_queue_head_t* q, wait_queue_t* wait);
+
+void remove_wait_queue(wait_queue_head_t* q, wait_queue_t* wait);
+
+/**
+ * Wakes every process sleeping on `q`. Costs the number of waiters and is
+ * safe from interrupt handlers.
+ */
+void wake_up(wait_queue_head_t* q);
+
+/* Wakes the process that has been waiting on `q` the longest */
+void wake_up_one(wait_queue_head_t* q);
+
+/**
+ * Puts the current process on `q` and switches away until it is woken.
+ * Interrupts must be off, they are off again when it returns.
+ */
+void sleep_on(wait_queue_head_t* q);
+
+/* A signal is waiting to be handled by the current process */
+bool signal_pending(void);
+
+/**
+ * Sleeps on `wq` until `condition` is true. The condition is checked with
+ * interrupts off, so a wake_up() from an interrupt handler cannot be lost
+ * between checking it and going to sleep.
+ */
+#define wait_event(wq, condition)   \
+    do {                            \
+        bool __irq = irq_save();    \
+        while (!(condition)) {      \
+            sleep_on(&(wq));        \
+        }                           \
+        irq_restore(__irq);         \
+    } while (0)
+
+/**
+ * Like wait_event(), but gives up when a signal arrives.
+ *
+ * @return 0 once `condition` is true, -EINTR if a signal came first.
+ */
+#define wait_event_interruptible(wq, condition) \
+    ({                                          \
+        s32 __ret = 0;                          \
+        bool __irq = irq_save();                \
+        while (!(condition)) {                  \
+            if (signal_pending()) {             \
+                __ret = -EINTR;                 \
+                break;                          \
+            }                                   \
+            sleep_on(&(wq));                    \
+        }                                       \
+        irq_restore(__irq);                     \
+        __ret;                                  \
+    })
+
+#endif /* WAIT_H */
@@ -1,11 +1,18 @@
 #include "sys/signal/signal.h"
 #include "drivers/printk.h"
 #include "sys/process/process.h"
+#include "sys/process/sched.h"
+#include "sys/process/wait.h"
 #include <types.h>
 
-extern proc_t ptables[NUM_PROC];
+/* Exit status of a process killed by a signal, as shells report it */
+#define SIGNAL_EXIT_STATUS(sig) (128 + (sig))
+
 extern proc_t* current_proc;
 
+/* Stopped processes, SIGCONT wakes them through do_kill() */
+static wait_queue_head_t stopped = WAIT_QUEUE_HEAD_INIT;
+
 sigaction_t sigaction[NSIG] = {
     [SIGHUP] = { .sa_handler = SIG_DFL, .sa_flags = 0 },
     [SIGINT] = { .sa_handler = SIG_DFL, .sa_flags = 0 },
@@ -46,30 +53,29 @@ sigaction_t sigaction[NSIG] = {
 static inline void __default_sigterm_handler(s32 sig)
 {
     printk("Process %d terminated by signal %d\n", current_proc->pid, sig);
-    current_proc->state = ZOMBIE;
-    yield();
+    do_exit(SIGNAL_EXIT_STATUS(sig));
 }
 
 static inline void __default_sigkill_handler(s32 sig)
 {
     printk("Process %d killed by signal %d\n", current_proc->pid, sig);
-    current_proc->state = ZOMBIE;
-    yield();
+    do_exit(SIGNAL_EXIT_STATUS(sig));
 }
 
 static inline void __default_sigcore_handler(s32 sig)
 {
     printk("Process %d core dumped by signal %d\n", current_proc->pid, sig);
     // TODO: Dump core
-    current_proc->state = ZOMBIE;
-    yield();
+    do_exit(SIGNAL_EXIT_STATUS(sig));
 }
 
 static inline void __default_sigstop_handler(s32 sig)
 {
     printk("Process %d stopped by signal %d\n", current_proc->pid, sig);
-    current_proc->state = SLEEPING;
-    yield();
+
+    bool irq = irq_save();
+    sleep_on(&stopped);
+    irq_restore(irq);
 }
 
 /* Public */
@@ -86,10 +92,7 @@ int do_kill(pid_t pid, int sig)
     }
 
     p->pending_signals |= (1 << sig);
-
-    if (p->state == SLEEPING) {
-        p->state = READY;
-    }
+    wake_up_process(p);
 
     printk(
         "Process %d sent signal %d to process %d\n", current_proc->pid, sig, pid
@@ -100,7 +103,7 @@ int do_kill(pid_t pid, int sig)
 
 void handle_signal(void)
 {
-    if (!current_proc->pending_signals) {
+    if (!current_proc || !current_proc->pending_signals) {
         return;
     }
 
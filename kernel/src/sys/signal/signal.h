@@ -64,6 +64,12 @@ typedef struct {
 
 s32 do_kill(pid_t pid, s32 sig);
 
+/**
+ * Delivers the pending signals of the running process. Called in its own
+ * context on the way back to user mode, so a fatal signal exits through
+ * do_exit() and a process that slept in the kernel has left its wait queues
+ * and timers by then.
+ */
 void handle_signal(void);
 
 #endif /* SIGNAL_H */
@@ -2,33 +2,46 @@
 #include "arch/x86/io.h"
 #include "arch/x86/pit.h"
 #include "drivers/printk.h"
-#include "sys/process/process.h"
+#include "sys/process/wait.h"
 
 #define NUM_TIMERS 16
 
-extern context_t* scheduler_context;
 extern unsigned long long volatile ticks;
-extern proc_t* current_proc;
 static timer_t timers[NUM_TIMERS];
 
-void wake_up_process(void* data)
-{
-    proc_t* p = (proc_t*)data;
-    p->state = READY;
-}
+static void sleep_timeout(void* data) { wake_up(data); }
 
-s32 add_timer(timer_t* timer)
+s32 add_timer(timer_t const* timer)
 {
+    bool irq = irq_save();
+
     for (s32 i = 0; i < NUM_TIMERS; i++) {
         if (!timers[i].function) {
             timers[i] = *timer;
+            irq_restore(irq);
             return 0;
         }
     }
 
+    irq_restore(irq);
     return -1;
 }
 
+void del_timer(timer_t const* timer)
+{
+    bool irq = irq_save();
+
+    for (s32 i = 0; i < NUM_TIMERS; i += 1) {
+        if (timers[i].function == timer->function
+            && timers[i].data == timer->data) {
+            timers[i].function = NULL;
+            break;
+        }
+    }
+
+    irq_restore(irq);
+}
+
 void check_timers(void)
 {
     for (s32 i = 0; i < NUM_TIMERS; i += 1) {
@@ -43,41 +56,28 @@ s32 ksleep(s32 seconds) { return knanosleep(seconds * 1000); }
 
 /*
  * Sleep for specified seconds by blocking current process.
- * Current implementation: Direct timer callback wakes process
+ * Current implementation: the timer wakes a wait queue only we sleep on
  *
  * POSIX approach would use: alarm(seconds) + pause() + SIGALRM handler
  * TODO: Implement SIGALRM-based sleep for full POSIX compliance
  */
 int knanosleep(unsigned int ms)
 {
+    wait_queue_head_t wq = WAIT_QUEUE_HEAD_INIT;
     timer_t timer;
 
     timer.expires = ticks + ((unsigned long long)ms * HZ / 1000);
-    timer.function = wake_up_process;
-    timer.data = (void*)current_proc;
+    timer.function = sleep_timeout;
+    timer.data = &wq;
 
-    s32 r = add_timer(&timer);
-    if (r < 0) {
+    if (add_timer(&timer) < 0) {
         printk("sleep: Timer array is full");
         return -1;
     }
 
-    current_proc->state = SLEEPING;
-    swtch(&current_proc->context, scheduler_context);
-
-    return 0;
-}
-
-void waitchan(void* channel)
-{
-    proc_t* p = myproc();
-    cli();
-
-    p->channel = channel;
-    p->state = SLEEPING;
-
-    swtch(&p->context, scheduler_context);
+    s32 r = wait_event_interruptible(wq, ticks >= timer.expires);
 
-    p->channel = NULL;
-    sti();
+    /* Woken early by a signal, the timer must not touch our stack later */
+    del_timer(&timer);
+    return r;
 }
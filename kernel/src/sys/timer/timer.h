@@ -12,12 +12,27 @@ typedef struct timer {
     void (*function)(void*);
 } timer_t;
 
+/**
+ * Calls `timer->function` from the timer interrupt once `ticks` reaches
+ * `timer->expires`. The timer is copied, it may live on the stack.
+ *
+ * @return 0, or -1 if all timer slots are in use.
+ */
+s32 add_timer(timer_t const* timer);
+
+/* Cancels the pending timer with the same function and data, if any */
+void del_timer(timer_t const* timer);
+
 int ksleep(int);
 
+/**
+ * Sleeps for `ms` milliseconds.
+ *
+ * @return 0, -EINTR when a signal cut the sleep short, or -1 if no timer
+ *         was free.
+ */
 int knanosleep(u32);
 
-void waitchan(void*);
-
 void check_timers(void);
 
 #endif /* TIMER_H */
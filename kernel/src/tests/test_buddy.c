@@ -0,0 +1,92 @@
+#include "arch/x86/cpu.h"
+#include "memory/buddy_allocator/buddy.h"
+
+#include <drivers/printk.h>
+#include <lib/stdlib.h>
+#include <types.h>
+
+#define ASSERT(cond, msg) \
+    do {                  \
+        if (!(cond)) {    \
+            abort(msg);   \
+        }                 \
+    } while (0)
+
+#define BUDDY_TEST_CYCLES 4096
+#define BUDDY_TEST_SLOTS 64
+#define BUDDY_TEST_MAX_ORDER 3
+
+static u32 seed = 0x1234567;
+
+static u32 next_random(void)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 16;
+}
+
+static unsigned long long now(void)
+{
+    return cpu_has(X86_FEATURE_TSC) ? rdtsc() : 0;
+}
+
+/*
+ * Runs BUDDY_TEST_CYCLES random alloc/free operations over a small set of
+ * slots and checks that every page comes back afterwards. When the CPU has a
+ * TSC, the average cost of buddy_alloc() and buddy_dealloc() is reported.
+ */
+void test_buddy_allocator(void)
+{
+    void* blocks[BUDDY_TEST_SLOTS] = { 0 };
+    u32 orders[BUDDY_TEST_SLOTS] = { 0 };
+    unsigned long long alloc_cycles = 0, free_cycles = 0;
+    u32 nr_alloc = 0, nr_free = 0;
+
+    size_t free_before = buddy_get_free_pages();
+
+    for (u32 i = 0; i < BUDDY_TEST_CYCLES; i += 1) {
+        u32 slot = next_random() % BUDDY_TEST_SLOTS;
+
+        if (blocks[slot]) {
+            unsigned long long start = now();
+            buddy_dealloc((paddr_t)blocks[slot], orders[slot]);
+            free_cycles += now() - start;
+            nr_free += 1;
+
+            blocks[slot] = NULL;
+            continue;
+        }
+
+        u32 order = next_random() % (BUDDY_TEST_MAX_ORDER + 1);
+
+        unsigned long long start = now();
+        void* block = buddy_alloc(order);
+        alloc_cycles += now() - start;
+        nr_alloc += 1;
+
+        ASSERT(block, "buddy test: out of memory");
+        ASSERT(
+            buddy_manages((paddr_t)block), "buddy test: block outside the pool"
+        );
+
+        blocks[slot] = block;
+        orders[slot] = order;
+    }
+
+    for (u32 slot = 0; slot < BUDDY_TEST_SLOTS; slot += 1) {
+        if (blocks[slot]) {
+            buddy_dealloc((paddr_t)blocks[slot], orders[slot]);
+        }
+    }
+
+    ASSERT(
+        buddy_get_free_pages() == free_before, "buddy test: pages were leaked"
+    );
+
+    if (cpu_has(X86_FEATURE_TSC)) {
+        printk(
+            "buddy: %u allocs, %u frees, %u cycles/alloc, %u cycles/free\n",
+            nr_alloc, nr_free, (u32)(alloc_cycles / nr_alloc),
+            (u32)(free_cycles / nr_free)
+        );
+    }
+}
@@ -0,0 +1,104 @@
+#include "arch/x86/cpu.h"
+#include "arch/x86/memlayout.h"
+#include "lib/math.h"
+#include "memory/buddy_allocator/buddy.h"
+#include "memory/consts.h"
+#include "memory/page.h"
+#include "memory/vmm.h"
+#include "sys/process/process.h"
+
+#include <drivers/printk.h>
+#include <ferrite/string.h>
+#include <lib/stdlib.h>
+#include <types.h>
+
+#define ASSERT(cond, msg) \
+    do {                  \
+        if (!(cond)) {    \
+            abort(msg);   \
+        }                 \
+    } while (0)
+
+#define FORK_TEST_HEAP (1024 * 1024)
+#define FORK_TEST_PAGES (FORK_TEST_HEAP / PAGE_SIZE)
+#define FORK_TEST_VADDR 0x20000000
+#define FORK_TEST_ROUNDS 8
+
+extern u32 page_directory[1024];
+
+static unsigned long long now(void)
+{
+    return cpu_has(X86_FEATURE_TSC) ? rdtsc() : 0;
+}
+
+/*
+ * What fork() + execve() costs the kernel: duplicate the address space, then
+ * throw the copy away again.
+ */
+static u32 fork_exec_cycles(u32* parent, bool cow)
+{
+    unsigned long long total = 0;
+
+    for (u32 i = 0; i < FORK_TEST_ROUNDS; i += 1) {
+        unsigned long long start = now();
+
+        u32* child = vmm_copy_pgdir(parent, cow);
+        ASSERT(child, "fork test: could not copy the address space");
+        vmm_free_pagedir(child);
+
+        total += now() - start;
+    }
+
+    return (u32)(total / FORK_TEST_ROUNDS);
+}
+
+/*
+ * Builds an address space with a 1 MB heap and compares eager copying with
+ * copy-on-write sharing. Afterwards every frame must be back to a single
+ * user and no page may have leaked.
+ */
+void test_fork_cow(void)
+{
+    size_t free_before = buddy_get_free_pages();
+
+    u32* parent = setup_kvm();
+    ASSERT(parent, "fork test: out of memory");
+
+    /* The heap is set up from inside, the way a process would fault it in */
+    lcr3(V2P_WO((u32)parent));
+    ASSERT(
+        vmm_map_range(
+            NULL, (void*)FORK_TEST_VADDR, FORK_TEST_HEAP, PTE_W | PTE_U
+        ) == 0,
+        "fork test: out of memory"
+    );
+
+    for (u32 i = 0; i < FORK_TEST_PAGES; i += 1) {
+        memset((void*)(FORK_TEST_VADDR + (i * PAGE_SIZE)), (int)i, PAGE_SIZE);
+    }
+
+    u32 eager = fork_exec_cycles(parent, false);
+    u32 cow = fork_exec_cycles(parent, true);
+
+    for (u32 i = 0; i < FORK_TEST_PAGES; i += 1) {
+        pte_t pte = vmm_get_pte(FORK_TEST_VADDR + (i * PAGE_SIZE));
+
+        ASSERT(pte & PTE_COW, "fork test: page was not marked COW");
+        ASSERT(
+            page_count(pfn_to_page(pte_pfn(pte))) == 1,
+            "fork test: frame still shared after the child is gone"
+        );
+    }
+
+    lcr3(V2P_WO((u32)page_directory));
+    vmm_free_pagedir(parent);
+    ASSERT(
+        buddy_get_free_pages() == free_before, "fork test: pages were leaked"
+    );
+
+    if (cpu_has(X86_FEATURE_TSC)) {
+        printk(
+            "fork+exec, 1 MB heap: %u cycles eager, %u cycles COW\n", eager, cow
+        );
+    }
+}
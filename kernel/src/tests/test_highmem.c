@@ -0,0 +1,78 @@
+#include "memory/buddy_allocator/buddy.h"
+#include "memory/consts.h"
+#include "memory/highmem.h"
+#include "memory/page.h"
+
+#include <ferrite/string.h>
+#include <lib/stdlib.h>
+#include <types.h>
+
+#define ASSERT(cond, msg) \
+    do {                  \
+        if (!(cond)) {    \
+            abort(msg);   \
+        }                 \
+    } while (0)
+
+#define HIGHMEM_TEST_PAGES 8
+
+/*
+ * Fills a few frames from alloc_highpage() through kmap() and copies one of
+ * them. With highmem present, the frames must come from it and live in the
+ * kmap window; without, they silently fall back to lowmem.
+ */
+void test_highmem(void)
+{
+    size_t free_before = buddy_get_free_pages();
+    bool highmem = buddy_get_zone_free_pages(BUDDY_ZONE_HIGHMEM) > 0;
+    page_t* pages[HIGHMEM_TEST_PAGES];
+
+    for (u32 i = 0; i < HIGHMEM_TEST_PAGES; i += 1) {
+        pages[i] = alloc_highpage(true);
+        ASSERT(pages[i], "highmem test: out of memory");
+        ASSERT(
+            page_is_highmem(pages[i]) == highmem,
+            "highmem test: frame from the wrong zone"
+        );
+
+        u8* data = kmap(pages[i]);
+        u32 slot = ((u32)data - KMAP_BASE) / PAGE_SIZE;
+        ASSERT(
+            !highmem || ((u32)data >= KMAP_BASE && slot < KMAP_SLOTS),
+            "highmem test: frame mapped outside the kmap window"
+        );
+        ASSERT(
+            data[0] == 0 && data[PAGE_SIZE - 1] == 0,
+            "highmem test: frame not zeroed"
+        );
+
+        memset(data, (int)i + 1, PAGE_SIZE);
+        ASSERT(kmap(pages[i]) == data, "highmem test: slot not shared");
+        kunmap(pages[i]);
+        kunmap(pages[i]);
+    }
+
+    for (u32 i = 0; i < HIGHMEM_TEST_PAGES; i += 1) {
+        u8 const* data = kmap(pages[i]);
+        ASSERT(
+            data[0] == i + 1 && data[PAGE_SIZE - 1] == i + 1,
+            "highmem test: content lost between mappings"
+        );
+        kunmap(pages[i]);
+    }
+
+    copy_highpage(pages[0], pages[HIGHMEM_TEST_PAGES - 1]);
+    u8 const* copy = kmap(pages[0]);
+    ASSERT(
+        copy[PAGE_SIZE / 2] == HIGHMEM_TEST_PAGES, "highmem test: bad copy"
+    );
+    kunmap(pages[0]);
+
+    for (u32 i = 0; i < HIGHMEM_TEST_PAGES; i += 1) {
+        put_page(pages[i]);
+    }
+
+    ASSERT(
+        buddy_get_free_pages() == free_before, "highmem test: pages were leaked"
+    );
+}
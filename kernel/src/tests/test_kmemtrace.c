@@ -0,0 +1,53 @@
+#include "memory/kmalloc.h"
+#include "memory/kmemtrace.h"
+#include "memory/vmalloc.h"
+
+#include <lib/stdlib.h>
+#include <types.h>
+
+#define ASSERT(cond, msg) \
+    do {                  \
+        if (!(cond)) {    \
+            abort(msg);   \
+        }                 \
+    } while (0)
+
+/*
+ * Checks that kmalloc() and vmalloc() blocks are counted while they live and
+ * dropped again when freed. Does nothing without __KMEMTRACE.
+ */
+void test_kmemtrace(void)
+{
+#ifdef __KMEMTRACE
+    kmemtrace_stats_t before;
+    kmemtrace_stats_t s;
+
+    kmemtrace_get_stats(&before);
+
+    void* small = kmalloc(40);
+    void* large = kmalloc(5000);
+    void* virt = vmalloc(9000);
+    ASSERT(small && large && virt, "kmemtrace test: out of memory");
+
+    /* With every record in use, new blocks are only counted as untracked */
+    kmemtrace_get_stats(&s);
+    if (s.untracked == before.untracked) {
+        ASSERT(
+            s.live == before.live + 3
+                && s.live_bytes == before.live_bytes + 40 + 5000 + 9000,
+            "kmemtrace test: allocations not recorded"
+        );
+    }
+    ASSERT(s.sites >= 1, "kmemtrace test: no call sites");
+
+    kfree(small);
+    kfree(large);
+    vfree(virt);
+
+    kmemtrace_get_stats(&s);
+    ASSERT(
+        s.live == before.live && s.live_bytes == before.live_bytes,
+        "kmemtrace test: frees not recorded"
+    );
+#endif
+}
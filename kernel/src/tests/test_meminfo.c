@@ -0,0 +1,71 @@
+#include "memory/buddy_allocator/buddy.h"
+#include "memory/consts.h"
+#include "memory/meminfo.h"
+#include "memory/page.h"
+#include "memory/vmalloc.h"
+
+#include <lib/stdlib.h>
+#include <types.h>
+
+#define ASSERT(cond, msg) \
+    do {                  \
+        if (!(cond)) {    \
+            abort(msg);   \
+        }                 \
+    } while (0)
+
+static struct meminfo before;
+static struct meminfo after;
+
+/*
+ * Checks that the free block counts add up, that the fragmentation index
+ * only grows with the order, and that an allocation shows up in the
+ * counters it should.
+ */
+void test_meminfo(void)
+{
+    meminfo_get(&before);
+
+    u32 free = 0;
+    for (u32 order = 0; order < MEMINFO_NR_ORDERS; order += 1) {
+        free += before.free_blocks[order] << order;
+        ASSERT(
+            before.frag_index[order] <= 1000
+                && (order == 0
+                    || before.frag_index[order]
+                        >= before.frag_index[order - 1]),
+            "meminfo test: bad fragmentation index"
+        );
+    }
+    ASSERT(free == before.free, "meminfo test: free blocks do not add up");
+    ASSERT(before.frag_index[0] == 0, "meminfo test: order 0 unusable");
+    ASSERT(
+        before.free <= before.total && before.slab_pages > 0
+            && before.page_tables > 0,
+        "meminfo test: implausible counters"
+    );
+
+    page_t* page = buddy_alloc_zone(BUDDY_ZONE_NORMAL, 0);
+    ASSERT(page, "meminfo test: out of memory");
+
+    meminfo_get(&after);
+    buddy_free_pages(page_to_pfn(page), 0);
+    ASSERT(after.free == before.free - 1, "meminfo test: page not counted");
+
+    meminfo_get(&before);
+    void* block = vmalloc(3 * PAGE_SIZE);
+    ASSERT(block, "meminfo test: out of memory");
+
+    meminfo_get(&after);
+    vfree(block);
+    ASSERT(
+        after.vmalloc_used >= before.vmalloc_used + (4 * PAGE_SIZE),
+        "meminfo test: vmalloc not counted"
+    );
+
+    meminfo_get(&after);
+    ASSERT(
+        after.vmalloc_used == before.vmalloc_used,
+        "meminfo test: vmalloc space not given back"
+    );
+}
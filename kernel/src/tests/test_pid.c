@@ -0,0 +1,77 @@
+#include "sys/process/pid.h"
+#include "sys/process/process.h"
+
+#include <ferrite/string.h>
+#include <lib/stdlib.h>
+#include <types.h>
+
+#define ASSERT(cond, msg) \
+    do {                  \
+        if (!(cond)) {    \
+            abort(msg);   \
+        }                 \
+    } while (0)
+
+/* Kept apart from the system map, init still has to get PID 1 */
+static pidmap_t map;
+
+/* Stand-ins, only their PIDs and hash links are used */
+static proc_t procs[3];
+
+static void test_pidmap(void)
+{
+    memset(&map, 0, sizeof(pidmap_t));
+
+    ASSERT(pidmap_alloc(&map) == 1, "pid test: first PID is not 1");
+    for (pid_t pid = 2; pid < 100; pid += 1) {
+        ASSERT(pidmap_alloc(&map) == pid, "pid test: PIDs not in order");
+    }
+
+    /* A freed PID only comes back once the numbers wrap around */
+    pidmap_free(&map, 50);
+    ASSERT(pidmap_alloc(&map) == 100, "pid test: PID reused too early");
+
+    map.last = PID_MAX - 2;
+    ASSERT(pidmap_alloc(&map) == PID_MAX - 1, "pid test: last PID skipped");
+    ASSERT(pidmap_alloc(&map) == 50, "pid test: PID not recycled");
+    ASSERT(pidmap_alloc(&map) == 101, "pid test: taken PID handed out");
+
+    pidmap_free(&map, 50);
+    pidmap_free(&map, 50);
+    ASSERT(map.nr_used == 101, "pid test: PID freed twice");
+}
+
+static void test_pid_hash(void)
+{
+    /* Far above PID_MAX, nothing real can have them */
+    pid_t base = PID_MAX * 2;
+
+    memset(procs, 0, sizeof(procs));
+    procs[0].pid = base;
+    procs[1].pid = base + PID_HASH_BUCKETS;
+    procs[2].pid = base + 1;
+
+    for (u32 i = 0; i < 3; i += 1) {
+        pid_hash_add(&procs[i]);
+    }
+
+    for (u32 i = 0; i < 3; i += 1) {
+        ASSERT(
+            find_process(procs[i].pid) == &procs[i], "pid test: lookup failed"
+        );
+    }
+
+    pid_hash_del(&procs[1]);
+    ASSERT(!find_process(procs[1].pid), "pid test: removed PID found");
+    ASSERT(find_process(base) == &procs[0], "pid test: bucket broken");
+
+    pid_hash_del(&procs[0]);
+    pid_hash_del(&procs[2]);
+    ASSERT(!find_process(base + 1), "pid test: hash not empty");
+}
+
+void test_pid(void)
+{
+    test_pidmap();
+    test_pid_hash();
+}
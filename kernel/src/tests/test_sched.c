@@ -0,0 +1,422 @@
+#include "arch/x86/cpu.h"
+#include "drivers/printk.h"
+#include "sys/process/process.h"
+#include "sys/process/sched.h"
+#include "sys/process/wait.h"
+
+#include <ferrite/string.h>
+#include <lib/math.h>
+#include <lib/stdlib.h>
+#include <types.h>
+
+#define ASSERT(cond, msg) \
+    do {                  \
+        if (!(cond)) {    \
+            abort(msg);   \
+        }                 \
+    } while (0)
+
+#define SCHED_TEST_PROCS 128
+#define SCHED_TEST_ROUNDS 256
+#define SCHED_TEST_TICKS 2000
+#define SCHED_TEST_SLEEP 100 // Ticks the interactive process sleeps
+
+extern proc_t* current_proc;
+
+/* Stand-ins, never run; only their scheduling state is used */
+static proc_t procs[SCHED_TEST_PROCS];
+static wait_queue_t waits[SCHED_TEST_PROCS];
+static wait_queue_head_t heads[SCHED_TEST_PROCS];
+static u32 ran[SCHED_TEST_PROCS]; // Ticks each one was running
+
+static void reset_procs(u32 n)
+{
+    memset(procs, 0, n * sizeof(proc_t));
+    memset(ran, 0, n * sizeof(u32));
+
+    for (u32 i = 0; i < n; i += 1) {
+        procs[i].pid = (pid_t)(i + 1);
+        procs[i].state = SLEEPING;
+        sched_fork(&procs[i], NULL);
+    }
+}
+
+static void drain(void)
+{
+    while (runqueue_pop()) {
+    }
+}
+
+/* What schedule() does, without switching to the stand-in */
+static void sim_switch(void)
+{
+    proc_t* prev = current_proc;
+    if (prev && prev->state == RUNNING) {
+        runqueue_put_prev(prev);
+    }
+
+    proc_t* next = runqueue_pop();
+    if (next) {
+        next->state = RUNNING;
+        next->slice_ticks = 0;
+    }
+
+    current_proc = next;
+    need_resched = false;
+}
+
+/* One timer interrupt, and the reschedule on the way out of it */
+static void sim_tick(void)
+{
+    if (current_proc) {
+        ran[current_proc - procs] += 1;
+    }
+
+    sched_tick();
+    if (need_resched) {
+        sim_switch();
+    }
+}
+
+static void sim_stop(void)
+{
+    current_proc = NULL;
+    need_resched = false;
+    drain();
+}
+
+static void test_runqueue(void)
+{
+    reset_procs(4);
+    for (u32 i = 0; i < 4; i += 1) {
+        procs[i].vruntime = VRUNTIME_TICK;
+    }
+    procs[1].vruntime = 0;
+
+    runqueue_add(&procs[0]);
+    runqueue_add(&procs[1]);
+    runqueue_add(&procs[2]);
+    runqueue_add(&procs[2]);
+    runqueue_add(&procs[3]);
+    ASSERT(runqueue_length() == 4, "sched test: queued twice");
+
+    runqueue_del(&procs[3]);
+    ASSERT(
+        runqueue_pop() == &procs[1] && runqueue_pop() == &procs[0],
+        "sched test: not in vruntime order"
+    );
+
+    /* Queued, but asleep again by the time it would be picked */
+    runqueue_add(&procs[0]);
+    procs[2].state = SLEEPING;
+    ASSERT(runqueue_pop() == &procs[0], "sched test: stale entry picked");
+    ASSERT(
+        runqueue_pop() == NULL && runqueue_length() == 0,
+        "sched test: run queue not empty"
+    );
+}
+
+static void test_waitqueue(void)
+{
+    wait_queue_head_t q = WAIT_QUEUE_HEAD_INIT;
+
+    reset_procs(3);
+    for (u32 i = 0; i < 3; i += 1) {
+        waits[i].proc = &procs[i];
+        add_wait_queue(&q, &waits[i]);
+    }
+
+    wake_up_one(&q);
+    ASSERT(
+        procs[0].state == READY && procs[1].state == SLEEPING,
+        "sched test: wake_up_one() woke the wrong process"
+    );
+
+    /* Still queued but awake, the next one gets the wakeup */
+    wake_up_one(&q);
+    ASSERT(procs[1].state == READY, "sched test: wakeup lost");
+
+    remove_wait_queue(&q, &waits[2]);
+    wake_up(&q);
+    ASSERT(procs[2].state == SLEEPING, "sched test: removed waiter woken");
+
+    remove_wait_queue(&q, &waits[0]);
+    remove_wait_queue(&q, &waits[1]);
+    ASSERT(!q.head && !q.tail, "sched test: wait queue not empty");
+    drain();
+}
+
+/* Three processes spin, one of them at nice 5, and share the CPU by weight */
+static void test_fair_share(void)
+{
+    reset_procs(3);
+    set_user_nice(&procs[2], 5);
+
+    u32 total = procs[0].weight + procs[1].weight + procs[2].weight;
+    for (u32 i = 0; i < 3; i += 1) {
+        runqueue_add(&procs[i]);
+    }
+
+    sim_switch();
+    for (u32 t = 0; t < SCHED_TEST_TICKS; t += 1) {
+        sim_tick();
+    }
+    sim_stop();
+
+    for (u32 i = 0; i < 3; i += 1) {
+        s32 share = (s32)(SCHED_TEST_TICKS * procs[i].weight / total);
+        s32 diff = (s32)ran[i] - share;
+
+        ASSERT(
+            diff <= 2 * SCHED_LATENCY && diff >= -2 * SCHED_LATENCY,
+            "sched test: CPU not shared by weight"
+        );
+    }
+}
+
+/* Real-time processes go by priority, then in the order they came */
+static void test_rt_order(void)
+{
+    reset_procs(5);
+    sched_setscheduler(&procs[1], SCHED_FIFO, 10);
+    sched_setscheduler(&procs[2], SCHED_FIFO, 50);
+    sched_setscheduler(&procs[3], SCHED_RR, 10);
+    sched_setscheduler(&procs[4], SCHED_FIFO, 10);
+
+    for (u32 i = 0; i < 5; i += 1) {
+        runqueue_add(&procs[i]);
+    }
+
+    ASSERT(runqueue_pop() == &procs[2], "sched test: rt priority ignored");
+    ASSERT(
+        runqueue_pop() == &procs[1] && runqueue_pop() == &procs[3],
+        "sched test: rt processes out of order"
+    );
+
+    /* Preempted goes back in front, yielded behind its equals */
+    runqueue_put_prev(&procs[1]);
+    ASSERT(runqueue_pop() == &procs[1], "sched test: preempted rt requeue");
+    procs[1].yielded = true;
+    runqueue_put_prev(&procs[1]);
+    ASSERT(
+        runqueue_pop() == &procs[4] && runqueue_pop() == &procs[1],
+        "sched test: yielded rt requeue"
+    );
+    ASSERT(runqueue_pop() == &procs[0], "sched test: fair before rt");
+
+    /* Back to SCHED_OTHER it queues by virtual runtime again */
+    sched_setscheduler(&procs[2], SCHED_OTHER, 0);
+    runqueue_add(&procs[2]);
+    ASSERT(
+        runqueue_pop() == &procs[2] && runqueue_length() == 0,
+        "sched test: run queue not empty"
+    );
+}
+
+/*
+ * Two SCHED_RR processes take turns and a SCHED_FIFO one of the same
+ * priority would not let go at all, the fair process gets nothing.
+ */
+static void test_rt_share(void)
+{
+    reset_procs(3);
+    sched_setscheduler(&procs[0], SCHED_RR, 20);
+    sched_setscheduler(&procs[1], SCHED_RR, 20);
+    for (u32 i = 0; i < 3; i += 1) {
+        runqueue_add(&procs[i]);
+    }
+
+    sim_switch();
+    for (u32 t = 0; t < SCHED_TEST_TICKS; t += 1) {
+        sim_tick();
+    }
+    sim_stop();
+
+    s32 diff = (s32)ran[0] - (s32)ran[1];
+    ASSERT(
+        diff <= SCHED_RR_TIMESLICE && diff >= -SCHED_RR_TIMESLICE,
+        "sched test: SCHED_RR processes did not take turns"
+    );
+    ASSERT(ran[2] == 0, "sched test: fair process ran next to rt ones");
+
+    reset_procs(2);
+    sched_setscheduler(&procs[0], SCHED_FIFO, 20);
+    sched_setscheduler(&procs[1], SCHED_FIFO, 20);
+    runqueue_add(&procs[0]);
+    runqueue_add(&procs[1]);
+
+    sim_switch();
+    for (u32 t = 0; t < SCHED_TEST_TICKS; t += 1) {
+        sim_tick();
+    }
+    sim_stop();
+
+    ASSERT(ran[1] == 0, "sched test: SCHED_FIFO process lost the CPU");
+}
+
+/*
+ * `n` processes spin while another one sleeps, wakes up and runs for a
+ * tick, like a shell waiting for keys. Returns the longest delay from its
+ * wakeup until it ran, in ticks.
+ *
+ * With `policy` SCHED_FIFO the sleeper is real-time, like a sampling
+ * process, and the spinners are as heavy as it gets: nice NICE_MIN and one
+ * SCHED_RR process of a lower priority.
+ */
+static u32 sim_latency(u32 n, u8 policy, u32* average)
+{
+    proc_t* interactive = &procs[n];
+    u32 wake_at = SCHED_TEST_SLEEP;
+    u32 worst = 0;
+    u32 total = 0;
+    u32 wakeups = 0;
+
+    reset_procs(n + 1);
+    if (policy != SCHED_OTHER) {
+        sched_setscheduler(interactive, policy, SCHED_RT_PRIO_MAX);
+        sched_setscheduler(&procs[0], SCHED_RR, SCHED_RT_PRIO_MIN);
+        for (u32 i = 1; i < n; i += 1) {
+            set_user_nice(&procs[i], NICE_MIN);
+        }
+    }
+
+    for (u32 i = 0; i < n; i += 1) {
+        runqueue_add(&procs[i]);
+    }
+    sim_switch();
+
+    for (u32 t = 0; t < SCHED_TEST_TICKS; t += 1) {
+        /* Its timer fires, the wakeup may preempt a spinner */
+        if (t == wake_at) {
+            wake_up_process(interactive);
+            if (need_resched) {
+                sim_switch();
+            }
+        }
+
+        if (current_proc != interactive) {
+            sim_tick();
+            continue;
+        }
+
+        if (wake_at <= t) {
+            worst = max(worst, t - wake_at);
+            total += t - wake_at;
+            wakeups += 1;
+        }
+
+        /* Done after one tick of work, back to sleep */
+        sim_tick();
+        runqueue_del(interactive);
+        interactive->state = SLEEPING;
+        if (current_proc == interactive) {
+            sim_switch();
+        }
+        wake_at = t + 1 + SCHED_TEST_SLEEP;
+    }
+
+    /* Woken but never got to run */
+    if (interactive->state == READY) {
+        worst = max(worst, SCHED_TEST_TICKS - wake_at);
+    }
+    sim_stop();
+
+    *average = wakeups ? total / wakeups : 0;
+    return worst;
+}
+
+/*
+ * Cycles to pick the next process and put the previous one back, and to
+ * wake a sleeper, with `n` processes around. Both should stay flat as `n`
+ * grows.
+ */
+static void bench(u32 n)
+{
+    reset_procs(n);
+    for (u32 i = 0; i < n; i += 1) {
+        runqueue_add(&procs[i]);
+    }
+
+    u64 start = rdtsc();
+    for (u32 i = 0; i < SCHED_TEST_ROUNDS; i += 1) {
+        runqueue_add(runqueue_pop());
+    }
+    u32 pick = (u32)((rdtsc() - start) / SCHED_TEST_ROUNDS);
+    drain();
+
+    /* Every process waits for its own event */
+    reset_procs(n);
+    for (u32 i = 0; i < n; i += 1) {
+        init_waitqueue_head(&heads[i]);
+        waits[i].proc = &procs[i];
+        add_wait_queue(&heads[i], &waits[i]);
+    }
+
+    start = rdtsc();
+    for (u32 i = 0; i < SCHED_TEST_ROUNDS; i += 1) {
+        proc_t* p = &procs[i % n];
+
+        wake_up(&heads[i % n]);
+        runqueue_del(p);
+        p->state = SLEEPING;
+    }
+    u32 wake = (u32)((rdtsc() - start) / SCHED_TEST_ROUNDS);
+
+    for (u32 i = 0; i < n; i += 1) {
+        remove_wait_queue(&heads[i], &waits[i]);
+    }
+
+    printk(
+        "sched: %3u processes, %4u cycles per switch, %4u per wakeup\n", n,
+        pick, wake
+    );
+}
+
+/*
+ * Checks the run queue order, wait queues, fair and real-time sharing and
+ * wakeup latency on stand-in processes, then times the run queue and
+ * wakeups for a growing number of processes. Runs before the first process
+ * exists, so the queue starts out empty.
+ */
+void test_sched(void)
+{
+    ASSERT(runqueue_length() == 0, "sched test: run queue in use");
+
+    test_runqueue();
+    test_waitqueue();
+    test_fair_share();
+    test_rt_order();
+    test_rt_share();
+
+    /* A woken sleeper preempts the spinners instead of waiting its turn */
+    for (u32 n = 1; n < SCHED_TEST_PROCS; n *= 4) {
+        u32 average;
+        u32 worst = sim_latency(n, SCHED_OTHER, &average);
+
+        printk(
+            "sched: %3u spinning, wakeup to run %u ticks, at most %u\n", n,
+            average, worst
+        );
+        ASSERT(worst <= SCHED_MIN_GRANULARITY, "sched test: wakeup latency");
+    }
+
+    /* A real-time one takes the CPU on the interrupt that woke it */
+    for (u32 n = 1; n < SCHED_TEST_PROCS; n *= 4) {
+        u32 average;
+        u32 worst = sim_latency(n, SCHED_FIFO, &average);
+
+        printk(
+            "sched: %3u spinning, rt wakeup to run %u ticks, at most %u\n", n,
+            average, worst
+        );
+        ASSERT(worst == 0, "sched test: rt wakeup latency");
+    }
+
+    if (!cpu_has(X86_FEATURE_TSC)) {
+        return;
+    }
+
+    for (u32 n = 1; n <= SCHED_TEST_PROCS; n *= 4) {
+        bench(n);
+    }
+}
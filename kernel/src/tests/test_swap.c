@@ -0,0 +1,140 @@
+#include "arch/x86/io.h"
+#include "arch/x86/memlayout.h"
+#include "memory/buddy_allocator/buddy.h"
+#include "memory/consts.h"
+#include "memory/page.h"
+#include "memory/swap.h"
+#include "memory/vma.h"
+#include "memory/vmm.h"
+#include "memory/vmscan.h"
+#include "sys/process/process.h"
+
+#include <ferrite/string.h>
+#include <lib/stdlib.h>
+#include <types.h>
+
+#define ASSERT(cond, msg) \
+    do {                  \
+        if (!(cond)) {    \
+            abort(msg);   \
+        }                 \
+    } while (0)
+
+#define SWAP_TEST_PAGES 16
+#define SWAP_TEST_VADDR 0x20000000
+#define SWAP_TEST_PASSES 4
+
+extern u32 page_directory[1024];
+
+static inline u32 test_addr(u32 i) { return SWAP_TEST_VADDR + (i * PAGE_SIZE); }
+
+/* Runs reclaim until every test page is out, each pass ages them some more */
+static void swap_out_all(u32 zone)
+{
+    for (u32 pass = 0; pass < SWAP_TEST_PASSES; pass += 1) {
+        try_to_free_pages(zone, SWAP_TEST_PAGES);
+    }
+
+    for (u32 i = 0; i < SWAP_TEST_PAGES; i += 1) {
+        ASSERT(
+            pte_is_swap(vmm_get_pte(test_addr(i))),
+            "swap test: page was not swapped out"
+        );
+    }
+}
+
+/* Faults every page back in and checks it survived the round trip */
+static void swap_in_all(memory_t* mm)
+{
+    for (u32 i = 0; i < SWAP_TEST_PAGES; i += 1) {
+        ASSERT(
+            handle_mm_fault(mm, test_addr(i), PF_USER, KERNBASE) == 0,
+            "swap test: swap-in failed"
+        );
+
+        u8 const* data = (u8 const*)test_addr(i);
+        ASSERT(
+            data[0] == i + 1 && data[PAGE_SIZE - 1] == i + 1,
+            "swap test: content lost in swap"
+        );
+    }
+}
+
+/*
+ * Faults in an anonymous area, pushes it out to swap and brings it back, once
+ * on its own and once with a copy-on-write child sharing the swap slots.
+ * Skipped when no swap device was given on the command line.
+ */
+void test_swap(void)
+{
+    if (!swap_enabled()) {
+        return;
+    }
+
+    swap_stats_t before, after;
+    swap_get_stats(&before);
+
+    memory_t mm;
+    memset(&mm, 0, sizeof(memory_t));
+
+    u32* pgdir = setup_kvm();
+    ASSERT(pgdir, "swap test: out of memory");
+    lcr3(V2P_WO((u32)pgdir));
+
+    ASSERT(
+        vma_create(
+            &mm, SWAP_TEST_VADDR, test_addr(SWAP_TEST_PAGES),
+            VM_READ | VM_WRITE, VMA_ANON, NULL, 0
+        ),
+        "swap test: could not create the area"
+    );
+
+    for (u32 i = 0; i < SWAP_TEST_PAGES; i += 1) {
+        ASSERT(
+            handle_mm_fault(&mm, test_addr(i), PF_USER | PF_WRITE, KERNBASE)
+                == 0,
+            "swap test: fault failed"
+        );
+        memset((void*)test_addr(i), (int)i + 1, PAGE_SIZE);
+    }
+
+    pte_t pte = vmm_get_pte(SWAP_TEST_VADDR);
+    u32 zone = page_is_highmem(pfn_to_page(pte_pfn(pte))) ? BUDDY_ZONE_HIGHMEM
+                                                          : BUDDY_ZONE_NORMAL;
+
+    swap_out_all(zone);
+    swap_get_stats(&after);
+    ASSERT(
+        after.used == before.used + SWAP_TEST_PAGES
+            && after.pswpout == before.pswpout + SWAP_TEST_PAGES,
+        "swap test: wrong number of pages swapped out"
+    );
+
+    swap_in_all(&mm);
+    swap_get_stats(&after);
+    ASSERT(
+        after.used == before.used
+            && after.pswpin == before.pswpin + SWAP_TEST_PAGES,
+        "swap test: slots not released after swap-in"
+    );
+
+    /* A child shares the slots, they stay in use until both are done */
+    swap_out_all(zone);
+    u32* child = vmm_copy_pgdir(pgdir, true);
+    ASSERT(child, "swap test: could not copy the address space");
+    vmm_free_pagedir(child);
+
+    swap_get_stats(&after);
+    ASSERT(
+        after.used == before.used + SWAP_TEST_PAGES,
+        "swap test: slots freed while still in use"
+    );
+
+    swap_in_all(&mm);
+    lcr3(V2P_WO((u32)page_directory));
+    vmm_free_pagedir(pgdir);
+    vma_release_all(&mm);
+
+    swap_get_stats(&after);
+    ASSERT(after.used == before.used, "swap test: slots were leaked");
+}
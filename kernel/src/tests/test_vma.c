@@ -0,0 +1,158 @@
+#include "arch/x86/memlayout.h"
+#include "memory/consts.h"
+#include "memory/mmap.h"
+#include "memory/vma.h"
+#include "memory/vmm.h"
+#include "sys/process/process.h"
+
+#include <ferrite/string.h>
+#include <lib/stdlib.h>
+#include <types.h>
+#include <uapi/errno.h>
+#include <uapi/mman.h>
+
+#define ASSERT(cond, msg) \
+    do {                  \
+        if (!(cond)) {    \
+            abort(msg);   \
+        }                 \
+    } while (0)
+
+#define VMA_TEST_BASE 0x08048000
+
+/*
+ * Builds the layout of a small program out of order and checks that the
+ * areas stay sorted, refuse to overlap, and validate faults the way the page
+ * fault handler relies on. No page is mapped, so every fault checked here has
+ * to be rejected before memory is touched.
+ */
+void test_vma(void)
+{
+    memory_t mm;
+    memset(&mm, 0, sizeof(memory_t));
+
+    u32 text = VMA_TEST_BASE;
+    u32 data = text + 4 * PAGE_SIZE;
+    u32 heap = data + 2 * PAGE_SIZE;
+    u32 stack = KERNBASE - 4 * PAGE_SIZE;
+    mm.heap_end = heap + 16 * PAGE_SIZE;
+
+    ASSERT(
+        vma_create(
+            &mm, stack, KERNBASE, VM_READ | VM_WRITE | VM_GROWSDOWN, VMA_STACK,
+            NULL, 0
+        ),
+        "vma test: could not create the stack"
+    );
+    ASSERT(
+        vma_create(&mm, data, heap, VM_READ | VM_WRITE, VMA_ANON, NULL, 0),
+        "vma test: could not create the data area"
+    );
+    ASSERT(
+        vma_create(&mm, text, data, VM_READ | VM_EXEC, VMA_ANON, NULL, 0),
+        "vma test: could not create the text area"
+    );
+    ASSERT(
+        vma_create(&mm, heap, heap, VM_READ | VM_WRITE, VMA_HEAP, NULL, 0),
+        "vma test: could not create the heap"
+    );
+    ASSERT(mm.map_count == 4, "vma test: wrong number of areas");
+
+    ASSERT(
+        !vma_create(
+            &mm, data - PAGE_SIZE, data + PAGE_SIZE, VM_READ, VMA_ANON, NULL, 0
+        ),
+        "vma test: overlapping area was accepted"
+    );
+
+    u32 last = 0;
+    for (vm_area_t* vma = mm.mmap; vma; vma = vma->vm_next) {
+        ASSERT(vma->vm_start >= last, "vma test: areas are not sorted");
+        last = vma->vm_end;
+    }
+
+    ASSERT(vma_find(&mm, text + 100) == mm.mmap, "vma test: lookup failed");
+    ASSERT(
+        vma_find(&mm, heap + PAGE_SIZE)->vm_type == VMA_STACK,
+        "vma test: lookup past the heap failed"
+    );
+
+    /* User pointers: across adjacent areas is fine, into a hole is not */
+    ASSERT(
+        vma_access_ok(&mm, data - 8, 16, false)
+            && !vma_access_ok(&mm, data - 8, 16, true)
+            && !vma_access_ok(&mm, heap - 8, 16, false)
+            && !vma_access_ok(&mm, 0, 4, false)
+            && !vma_access_ok(&mm, KERNBASE - 4, 8, false),
+        "vma test: user pointer check"
+    );
+
+    /* Writing text, touching an empty heap or wild stack growth must fail */
+    u32 sp = KERNBASE - PAGE_SIZE;
+    ASSERT(
+        handle_mm_fault(&mm, text, PF_USER | PF_WRITE, sp) < 0,
+        "vma test: write to text was allowed"
+    );
+    ASSERT(
+        handle_mm_fault(&mm, heap, PF_USER, sp) < 0,
+        "vma test: access beyond brk was allowed"
+    );
+
+    u32 far = KERNBASE - STACK_MAX_SIZE - PAGE_SIZE;
+    ASSERT(
+        handle_mm_fault(&mm, far, PF_USER, far) < 0,
+        "vma test: stack grew past its limit"
+    );
+    ASSERT(
+        handle_mm_fault(&mm, stack - 32 * PAGE_SIZE, PF_USER, sp) < 0,
+        "vma test: stack grew for an access far below the stack pointer"
+    );
+
+    vm_area_t* brk = vma_find_type(&mm, VMA_HEAP);
+    ASSERT(vma_resize(brk, heap + 8 * PAGE_SIZE) == 0, "vma test: brk failed");
+    ASSERT(
+        vma_resize(brk, stack + PAGE_SIZE) < 0,
+        "vma test: heap grew into the stack"
+    );
+
+    /* Punch a hole into a mapping, then change the protection next to it */
+    s32 map = do_mmap(
+        &mm, 0, 4 * PAGE_SIZE, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0
+    );
+    ASSERT(map == MMAP_BASE, "vma test: mmap picked the wrong address");
+    ASSERT(
+        do_mmap(
+            &mm, PAGE_SIZE, PAGE_SIZE, PROT_READ,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0
+        ) == -EPERM,
+        "vma test: MAP_FIXED over the kernel's low memory"
+    );
+    ASSERT(
+        do_munmap(&mm, map + PAGE_SIZE, PAGE_SIZE) == 0,
+        "vma test: munmap failed"
+    );
+    ASSERT(
+        do_mprotect(&mm, map + 2 * PAGE_SIZE, PAGE_SIZE, PROT_READ) == 0,
+        "vma test: mprotect failed"
+    );
+    ASSERT(mm.map_count == 7, "vma test: areas were not split");
+    ASSERT(
+        vma_find(&mm, map + 2 * PAGE_SIZE)->vm_flags == VM_READ,
+        "vma test: mprotect did not apply"
+    );
+    ASSERT(
+        do_mprotect(&mm, map, 2 * PAGE_SIZE, PROT_READ) == -ENOMEM,
+        "vma test: mprotect accepted a hole"
+    );
+
+    memory_t copy;
+    memset(&copy, 0, sizeof(memory_t));
+    ASSERT(vma_copy_all(&copy, &mm) == 0, "vma test: copy failed");
+    ASSERT(copy.map_count == mm.map_count, "vma test: copy is incomplete");
+    ASSERT(copy.mmap != mm.mmap, "vma test: copy shares the areas");
+
+    vma_release_all(&copy);
+    vma_release_all(&mm);
+    ASSERT(!mm.mmap && mm.map_count == 0, "vma test: areas were not released");
+}
@@ -0,0 +1,69 @@
+#include "memory/buddy_allocator/buddy.h"
+#include "memory/consts.h"
+#include "memory/memory.h"
+#include "memory/pmm.h"
+#include "memory/vmalloc.h"
+
+#include <ferrite/string.h>
+#include <lib/stdlib.h>
+#include <types.h>
+
+#define ASSERT(cond, msg) \
+    do {                  \
+        if (!(cond)) {    \
+            abort(msg);   \
+        }                 \
+    } while (0)
+
+#define VMALLOC_TEST_SIZE (3 * PAGE_SIZE)
+
+/*
+ * Frees three neighbouring blocks out of order. The area only ends up as a
+ * single extent again if every free merged with its neighbours, which a
+ * block as large as all three together proves. No frame may be leaked.
+ */
+void test_vmalloc(void)
+{
+    size_t free_before = buddy_get_free_pages();
+    u8* blocks[3];
+
+    for (u32 i = 0; i < 3; i += 1) {
+        blocks[i] = vmalloc(VMALLOC_TEST_SIZE);
+        ASSERT(blocks[i], "vmalloc test: out of memory");
+
+        memset(blocks[i], (int)i, VMALLOC_TEST_SIZE);
+    }
+
+    ASSERT(
+        blocks[0] < blocks[1] && blocks[1] < blocks[2],
+        "vmalloc test: blocks are not handed out in address order"
+    );
+    ASSERT(
+        blocks[2][VMALLOC_TEST_SIZE - 1] == 2 && blocks[0][0] == 0,
+        "vmalloc test: blocks overlap"
+    );
+
+    block_header_t* last = (block_header_t*)blocks[2] - 1;
+    u32 guard = (u32)last + last->size;
+    ASSERT(!pmm_get_physaddr((void*)guard), "vmalloc test: guard page mapped");
+
+    vfree(blocks[1]);
+    vfree(blocks[0]);
+    vfree(blocks[2]);
+
+    ASSERT(
+        !pmm_get_physaddr(blocks[1]), "vmalloc test: freed block still mapped"
+    );
+    ASSERT(
+        buddy_get_free_pages() == free_before, "vmalloc test: pages were leaked"
+    );
+
+    u8* all = vmalloc(3 * (VMALLOC_TEST_SIZE + 2 * PAGE_SIZE));
+    ASSERT(all, "vmalloc test: out of memory");
+    ASSERT(all == blocks[0], "vmalloc test: freed ranges were not merged");
+
+    vfree(all);
+    ASSERT(
+        buddy_get_free_pages() == free_before, "vmalloc test: pages were leaked"
+    );
+}
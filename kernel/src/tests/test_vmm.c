@@ -0,0 +1,162 @@
+#include "arch/x86/cpu.h"
+#include "arch/x86/memlayout.h"
+#include "memory/buddy_allocator/buddy.h"
+#include "memory/consts.h"
+#include "memory/memory.h"
+#include "memory/pmm.h"
+#include "memory/vmm.h"
+
+#include <drivers/printk.h>
+#include <lib/stdlib.h>
+#include <types.h>
+
+#define ASSERT(cond, msg) \
+    do {                  \
+        if (!(cond)) {    \
+            abort(msg);   \
+        }                 \
+    } while (0)
+
+#define VMM_TEST_SIZE (4 * 1024 * 1024)
+#define VMM_TEST_PAGES (VMM_TEST_SIZE / PAGE_SIZE)
+#define VMM_TEST_VADDR ((u32)HEAP_START) // vmalloc is not set up yet
+#define VMM_TEST_PADDR 0x00400000
+
+/* Kernel pages touched after every CR3 reload, 64 KB apart from 1 MB on */
+#define TLB_TEST_PAGES 64
+#define TLB_TEST_ROUNDS 256
+#define TLB_TEST_VADDR (KERNBASE + 0x100000)
+
+extern void flush_tlb(void);
+
+static unsigned long long now(void)
+{
+    return cpu_has(X86_FEATURE_TSC) ? rdtsc() : 0;
+}
+
+/* Reads every page once, so the TLB has entries to throw away afterwards */
+static void touch_pages(void)
+{
+    for (u32 i = 0; i < VMM_TEST_PAGES; i += 1) {
+        (void)*(u8 volatile*)(VMM_TEST_VADDR + (i * PAGE_SIZE));
+    }
+}
+
+static void check_mapped(void)
+{
+    for (u32 i = 0; i < VMM_TEST_PAGES; i += 1) {
+        u32 vaddr = VMM_TEST_VADDR + (i * PAGE_SIZE);
+        ASSERT(
+            (u32)pmm_get_physaddr((void*)vaddr)
+                == VMM_TEST_PADDR + (i * PAGE_SIZE),
+            "vmm test: page mapped to the wrong frame"
+        );
+    }
+}
+
+/*
+ * Maps and unmaps the second 4 MB of physical memory one page at a time, then
+ * as a single range. With the TSC, the cycles of both are reported.
+ */
+void test_vmm_range(void)
+{
+    u8* vaddr = (u8*)VMM_TEST_VADDR;
+    u8* paddr = (u8*)VMM_TEST_PADDR;
+
+    /* The page tables stay behind, take them out of the picture first */
+    ASSERT(vmm_map_range(paddr, vaddr, VMM_TEST_SIZE, 0) == 0, "vmm test: map");
+    vmm_unmap_range(vaddr, VMM_TEST_SIZE, false);
+    size_t free_before = buddy_get_free_pages();
+
+    unsigned long long start = now();
+    for (u32 i = 0; i < VMM_TEST_PAGES; i += 1) {
+        u32 offset = i * PAGE_SIZE;
+        ASSERT(
+            vmm_map_page(paddr + offset, vaddr + offset, 0) == 0,
+            "vmm test: page already mapped"
+        );
+    }
+    u32 map_single = (u32)(now() - start);
+
+    check_mapped();
+    touch_pages();
+
+    start = now();
+    for (u32 i = 0; i < VMM_TEST_PAGES; i += 1) {
+        vmm_unmap_page(vaddr + (i * PAGE_SIZE));
+    }
+    u32 unmap_single = (u32)(now() - start);
+
+    start = now();
+    ASSERT(
+        vmm_map_range(paddr, vaddr, VMM_TEST_SIZE, 0) == 0,
+        "vmm test: could not map the range"
+    );
+    u32 map_range = (u32)(now() - start);
+
+    check_mapped();
+    ASSERT(
+        vmm_map_range(paddr, vaddr + PAGE_SIZE, PAGE_SIZE, 0) < 0,
+        "vmm test: mapped over an existing page"
+    );
+    touch_pages();
+
+    start = now();
+    u32 count = vmm_unmap_range(vaddr, VMM_TEST_SIZE, false);
+    u32 unmap_range = (u32)(now() - start);
+
+    ASSERT(count == VMM_TEST_PAGES, "vmm test: wrong number of pages unmapped");
+    for (u32 i = 0; i < VMM_TEST_PAGES; i += 1) {
+        ASSERT(
+            !pmm_get_physaddr(vaddr + (i * PAGE_SIZE)),
+            "vmm test: page still mapped"
+        );
+    }
+
+    ASSERT(
+        buddy_get_free_pages() == free_before, "vmm test: pages were leaked"
+    );
+
+    if (cpu_has(X86_FEATURE_TSC)) {
+        printk(
+            "vmm, 4 MB: map %u/%u cycles, unmap %u/%u cycles (page/range)\n",
+            map_single, map_range, unmap_single, unmap_range
+        );
+    }
+}
+
+/*
+ * Reloads CR3 the way schedule() does and reads TLB_TEST_PAGES pages of the
+ * direct map right after. Global large pages keep their TLB entries across
+ * the reload, 4 KB pages have to be walked again every time.
+ */
+void test_vmm_tlb(void)
+{
+    if (!cpu_has(X86_FEATURE_TSC)) {
+        return;
+    }
+
+    unsigned long long total = 0;
+    for (u32 round = 0; round < TLB_TEST_ROUNDS; round += 1) {
+        unsigned long long start = now();
+
+        flush_tlb();
+        for (u32 i = 0; i < TLB_TEST_PAGES; i += 1) {
+            (void)*(u8 volatile*)(TLB_TEST_VADDR + (i * 16 * PAGE_SIZE));
+        }
+
+        total += now() - start;
+    }
+
+    char const* layout = "4 KB pages";
+    if (cpu_has(X86_FEATURE_PSE) && vmm_pae_enabled()) {
+        layout = cpu_has(X86_FEATURE_PGE) ? "global 2 MB pages" : "2 MB pages";
+    } else if (cpu_has(X86_FEATURE_PSE)) {
+        layout = cpu_has(X86_FEATURE_PGE) ? "global 4 MB pages" : "4 MB pages";
+    }
+
+    printk(
+        "vmm, CR3 reload + %u kernel pages: %u cycles (%s)\n", TLB_TEST_PAGES,
+        (u32)(total / TLB_TEST_ROUNDS), layout
+    );
+}
@@ -0,0 +1,122 @@
+#include "drivers/block/device.h"
+#include "drivers/block/zram.h"
+#include "ferrite/major.h"
+#include "lib/lz4.h"
+#include "memory/consts.h"
+
+#include <ferrite/string.h>
+#include <lib/stdlib.h>
+#include <types.h>
+
+#define ASSERT(cond, msg) \
+    do {                  \
+        if (!(cond)) {    \
+            abort(msg);   \
+        }                 \
+    } while (0)
+
+static u8 page[2 * PAGE_SIZE];
+static u8 check[2 * PAGE_SIZE];
+
+/* Text-like data: a few repeating words with some noise in between */
+static void fill_compressible(u8* buf, u32 len, u32 seed)
+{
+    static char const words[] = "ferrite swap page zram ";
+
+    for (u32 i = 0; i < len; i += 1) {
+        seed = (seed * 1103515245) + 12345;
+        buf[i] = (seed >> 16) % 16 == 0 ? (u8)(seed >> 8)
+                                         : (u8)words[i % (sizeof(words) - 1)];
+    }
+}
+
+static void fill_random(u8* buf, u32 len, u32 seed)
+{
+    for (u32 i = 0; i < len; i += 1) {
+        seed = (seed * 1103515245) + 12345;
+        buf[i] = (u8)(seed >> 16);
+    }
+}
+
+static void test_lz4(void)
+{
+    static u8 packed[PAGE_SIZE];
+
+    fill_compressible(page, PAGE_SIZE, 1);
+    s32 size = lz4_compress(page, PAGE_SIZE, packed, sizeof(packed));
+    ASSERT(size > 0 && size < PAGE_SIZE / 2, "zram test: poor compression");
+    ASSERT(
+        lz4_decompress(packed, size, check, PAGE_SIZE) == PAGE_SIZE
+            && memcmp(page, check, PAGE_SIZE) == 0,
+        "zram test: lz4 round trip failed"
+    );
+    ASSERT(
+        lz4_decompress(packed, size - 1, check, PAGE_SIZE) != PAGE_SIZE,
+        "zram test: truncated block accepted"
+    );
+
+    fill_random(page, PAGE_SIZE, 2);
+    ASSERT(
+        lz4_compress(page, PAGE_SIZE, packed, ZRAM_MAX_COMPRESSED) < 0,
+        "zram test: random data compressed"
+    );
+}
+
+/*
+ * Round-trips the LZ4 compressor, then, if "zram=" created a device, writes
+ * whole and partial pages to it and reads them back across page borders.
+ * Everything written is zeroed again at the end, which frees its memory.
+ */
+void test_zram(void)
+{
+    test_lz4();
+
+    block_device_t* d = get_device(MKDEV(RAMDISK_MAJOR, 0));
+    if (!d || d->d_nr_sectors < 3 * ZRAM_SECTORS_PER_PAGE) {
+        return;
+    }
+
+    zram_t const* z = d->d_data;
+    u32 spp = ZRAM_SECTORS_PER_PAGE;
+    u32 stored = z->z_stats.pages_stored;
+
+    fill_compressible(page, PAGE_SIZE, 3);
+    fill_random(page + PAGE_SIZE, PAGE_SIZE, 4);
+    ASSERT(
+        d->d_op->write(d, spp, 2 * spp, page, sizeof(page)) == 0,
+        "zram test: write failed"
+    );
+    ASSERT(
+        z->z_stats.pages_stored == stored + 2 && z->z_stats.huge_pages >= 1,
+        "zram test: pages not stored as expected"
+    );
+
+    /* Two sectors straddling the page border */
+    memset(page + PAGE_SIZE - ZRAM_SECTOR_SIZE, 0xAB, 2 * ZRAM_SECTOR_SIZE);
+    ASSERT(
+        d->d_op->write(
+            d, (2 * spp) - 1, 2, page + PAGE_SIZE - ZRAM_SECTOR_SIZE,
+            2 * ZRAM_SECTOR_SIZE
+        ) == 0,
+        "zram test: partial write failed"
+    );
+
+    ASSERT(
+        d->d_op->read(d, spp, 2 * spp, check, sizeof(check)) == 0
+            && memcmp(page, check, sizeof(page)) == 0,
+        "zram test: data corrupted"
+    );
+    ASSERT(
+        d->d_op->read(d, d->d_nr_sectors - 1, 2, check, sizeof(check)) < 0,
+        "zram test: read past the end accepted"
+    );
+
+    memset(page, 0, sizeof(page));
+    ASSERT(
+        d->d_op->write(d, spp, 2 * spp, page, sizeof(page)) == 0
+            && z->z_stats.pages_stored == stored,
+        "zram test: zero pages still take memory"
+    );
+
+    zram_dump();
+}
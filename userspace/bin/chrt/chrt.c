@@ -0,0 +1,85 @@
+#include <libc/stdio.h>
+#include <libc/stdlib.h>
+#include <libc/string.h>
+#include <libc/syscalls.h>
+
+static void usage(void)
+{
+    printf("Usage: chrt -p pid\n");
+    printf("       chrt -f|-r|-o priority command [args...]\n");
+}
+
+static char const* policy_name(int policy)
+{
+    switch (policy) {
+    case SCHED_OTHER:
+        return "SCHED_OTHER";
+    case SCHED_FIFO:
+        return "SCHED_FIFO";
+    case SCHED_RR:
+        return "SCHED_RR";
+    default:
+        return "unknown";
+    }
+}
+
+static int show(pid_t pid)
+{
+    struct sched_param param;
+
+    int policy = sched_getscheduler(pid);
+    if (policy < 0 || sched_getparam(pid, &param) < 0) {
+        printf("chrt: no process %d\n", pid);
+        return 1;
+    }
+
+    printf(
+        "pid %d: %s, priority %d\n", pid, policy_name(policy),
+        param.sched_priority
+    );
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    int policy;
+
+    if (argc == 3 && strcmp(argv[1], "-p") == 0) {
+        return show(atoi(argv[2]));
+    }
+
+    if (argc < 4) {
+        usage();
+        return 1;
+    }
+
+    if (strcmp(argv[1], "-f") == 0) {
+        policy = SCHED_FIFO;
+    } else if (strcmp(argv[1], "-r") == 0) {
+        policy = SCHED_RR;
+    } else if (strcmp(argv[1], "-o") == 0) {
+        policy = SCHED_OTHER;
+    } else {
+        usage();
+        return 1;
+    }
+
+    struct sched_param param = { .sched_priority = atoi(argv[2]) };
+    int ret = sched_setscheduler(0, policy, &param);
+    if (ret < 0) {
+        printf("chrt: cannot set %s: %d\n", policy_name(policy), ret);
+        return 1;
+    }
+
+    char path[256];
+    if (strchr(argv[3], '/')) {
+        strlcpy(path, argv[3], sizeof(path));
+    } else {
+        strlcpy(path, "/bin/", sizeof(path));
+        strlcat(path, argv[3], sizeof(path));
+    }
+
+    ret = execve(path, &argv[3], 0);
+    printf("chrt: cannot run %s: %d\n", argv[3], ret);
+    return 1;
+}
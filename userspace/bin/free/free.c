@@ -0,0 +1,78 @@
+#include <libc/stdio.h>
+#include <libc/string.h>
+#include <libc/syscalls.h>
+#include <uapi/meminfo.h>
+
+static struct meminfo info;
+
+static unsigned long kb(unsigned long pages)
+{
+    return pages * (info.page_size / 1024);
+}
+
+static void print_buddy(void)
+{
+    printf("order  free blocks  unusable\n");
+    for (int order = 0; order < MEMINFO_NR_ORDERS; order += 1) {
+        if (!info.free_blocks[order] && info.frag_index[order] == 1000) {
+            continue;
+        }
+
+        printf(
+            "%5d  %11lu  %4lu.%lu%%\n", order, info.free_blocks[order],
+            info.frag_index[order] / 10, info.frag_index[order] % 10
+        );
+    }
+}
+
+static void print_procs(void)
+{
+    printf("  PID              NAME   RSS KB  MINFLT  MAJFLT\n");
+    for (unsigned long i = 0; i < info.nr_procs; i += 1) {
+        struct meminfo_proc const* p = &info.procs[i];
+
+        printf(
+            "%5d  %16s  %7lu  %6lu  %6lu\n", p->pid, p->name, kb(p->rss),
+            p->min_flt, p->maj_flt
+        );
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    int verbose = argc == 2 && strcmp(argv[1], "-v") == 0;
+
+    if (argc > 2 || (argc == 2 && !verbose)) {
+        printf("Usage: free [-v]\n");
+        return 1;
+    }
+
+    int ret = meminfo(&info);
+    if (ret < 0) {
+        printf("free: error %d\n", ret);
+        return 1;
+    }
+
+    printf("MemTotal:     %8lu KB\n", kb(info.total));
+    printf("MemFree:      %8lu KB\n", kb(info.free));
+    printf("HighTotal:    %8lu KB\n", kb(info.highmem_total));
+    printf("HighFree:     %8lu KB\n", kb(info.highmem_free));
+    printf("Cached:       %8lu KB\n", kb(info.page_cache));
+    printf(
+        "Slab:         %8lu KB (%lu/%lu objects)\n", kb(info.slab_pages),
+        info.slab_objects, info.slab_capacity
+    );
+    printf("PageTables:   %8lu KB\n", kb(info.page_tables));
+    printf("VmallocTotal: %8lu KB\n", info.vmalloc_total / 1024);
+    printf("VmallocUsed:  %8lu KB\n", info.vmalloc_used / 1024);
+    printf("VmallocChunk: %8lu KB\n", info.vmalloc_largest_free / 1024);
+    printf("SwapTotal:    %8lu KB\n", kb(info.swap_total));
+    printf("SwapFree:     %8lu KB\n", kb(info.swap_free));
+
+    if (verbose) {
+        print_buddy();
+        print_procs();
+    }
+
+    return 0;
+}
@@ -0,0 +1,20 @@
+#include <libc/stdio.h>
+#include <libc/stdlib.h>
+#include <libc/syscalls.h>
+
+int main(int argc, char* argv[])
+{
+    if (argc > 2) {
+        printf("Usage: kmem [min_age_ticks]\n");
+        return 1;
+    }
+
+    int min_age = argc == 2 ? atoi(argv[1]) : 0;
+    int ret = kmemtrace(min_age);
+    if (ret < 0) {
+        printf("kmem: error %d\n", ret);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,56 @@
+#include <libc/stdio.h>
+#include <libc/stdlib.h>
+#include <libc/string.h>
+#include <libc/syscalls.h>
+
+#define DEFAULT_ADJUSTMENT 10
+
+static void usage(void)
+{
+    printf("Usage: nice [-n adjustment] [command [args...]]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    int adjustment = DEFAULT_ADJUSTMENT;
+    int first = 1;
+
+    if (argc > 1 && strcmp(argv[1], "-n") == 0) {
+        if (argc < 3) {
+            usage();
+            return 1;
+        }
+
+        adjustment = atoi(argv[2]);
+        first = 3;
+    }
+
+    /* Without a command, print our own nice level */
+    if (first >= argc) {
+        if (first > 1) {
+            usage();
+            return 1;
+        }
+
+        printf("%d\n", getpriority(PRIO_PROCESS, 0));
+        return 0;
+    }
+
+    int ret = nice(adjustment);
+    if (ret < 0) {
+        printf("nice: cannot set the nice level: %d\n", ret);
+        return 1;
+    }
+
+    char path[256];
+    if (strchr(argv[first], '/')) {
+        strlcpy(path, argv[first], sizeof(path));
+    } else {
+        strlcpy(path, "/bin/", sizeof(path));
+        strlcat(path, argv[first], sizeof(path));
+    }
+
+    ret = execve(path, &argv[first], 0);
+    printf("nice: cannot run %s: %d\n", argv[first], ret);
+    return 1;
+}
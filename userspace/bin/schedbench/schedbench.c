@@ -0,0 +1,74 @@
+#include <libc/stdio.h>
+#include <libc/stdlib.h>
+#include <libc/syscalls.h>
+
+#define DEFAULT_ROUNDS 1000
+
+static inline unsigned long long rdtsc(void)
+{
+    unsigned int lo, hi;
+
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((unsigned long long)hi << 32) | lo;
+}
+
+/*
+ * `procs` processes, this one included, call sched_yield() `rounds` times
+ * each. Every call is one trip through the scheduler, so the cycles per
+ * yield are the cost of a context switch with that many processes ready.
+ */
+static int bench(int procs, int rounds)
+{
+    unsigned long long start = rdtsc();
+
+    for (int i = 1; i < procs; i += 1) {
+        int pid = fork();
+        if (pid < 0) {
+            printf("schedbench: fork failed\n");
+            return -1;
+        }
+
+        if (pid == 0) {
+            for (int r = 0; r < rounds; r += 1) {
+                sched_yield();
+            }
+            exit(0);
+        }
+    }
+
+    for (int r = 0; r < rounds; r += 1) {
+        sched_yield();
+    }
+
+    for (int i = 1; i < procs; i += 1) {
+        int status;
+        waitpid(&status);
+    }
+
+    unsigned long long cycles = rdtsc() - start;
+    unsigned long long yields = (unsigned long long)procs * rounds;
+
+    printf(
+        "%4d processes: %llu cycles per switch\n", procs, cycles / yields
+    );
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    int max_procs = argc > 1 ? atoi(argv[1]) : 16;
+    int rounds = argc > 2 ? atoi(argv[2]) : DEFAULT_ROUNDS;
+
+    if (argc > 3 || max_procs < 1 || rounds < 1) {
+        printf("Usage: schedbench [max_procs] [rounds]\n");
+        return 1;
+    }
+
+    for (int procs = 1; procs <= max_procs; procs *= 2) {
+        if (bench(procs, rounds) < 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
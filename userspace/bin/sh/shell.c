@@ -378,7 +378,8 @@ int main(void)
             continue;
         }
 
-        pid_t pid = fork();
+        /* The child only execs, so it can borrow our address space */
+        pid_t pid = vfork();
         if (pid == 0) {
             int ret = execve(fullpath, argv, 0);
 
@@ -390,7 +391,7 @@ int main(void)
                 printf("Error executing %s: %d\n", argv[0], ret);
             }
 
-            exit(1);
+            _exit(1);
         } else if (pid > 0) {
             int status;
             waitpid(&status);
@@ -0,0 +1,132 @@
+#include <libc/stdio.h>
+#include <libc/stdlib.h>
+#include <libc/syscalls.h>
+#include <uapi/fcntl.h>
+
+#define DEFAULT_FORKS 200
+#define DEFAULT_COPY_KB 256
+#define COPY_ROUNDS 8
+
+#define SRC_PATH "/vmbench.src"
+#define DST_PATH "/vmbench.dst"
+
+static inline unsigned long long rdtsc(void)
+{
+    unsigned int lo, hi;
+
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((unsigned long long)hi << 32) | lo;
+}
+
+static char buf[4096];
+
+/*
+ * Every fork() builds a new address space and every wait switches back to
+ * this one, so the loop pays for a CR3 reload and whatever kernel TLB
+ * entries it throws away each time.
+ */
+static int fork_loop(int forks)
+{
+    unsigned long long start = rdtsc();
+
+    for (int i = 0; i < forks; i += 1) {
+        int pid = fork();
+        if (pid < 0) {
+            printf("vmbench: fork failed\n");
+            return -1;
+        }
+
+        if (pid == 0) {
+            exit(0);
+        }
+
+        int status;
+        waitpid(&status);
+    }
+
+    unsigned long long cycles = rdtsc() - start;
+    printf("fork+exit+wait: %llu cycles\n", cycles / forks);
+    return 0;
+}
+
+static int copy_file(char const* src, char const* dst)
+{
+    int in = open(src, O_RDONLY, 0);
+    if (in < 0) {
+        return -1;
+    }
+
+    int out = open(dst, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (out < 0) {
+        close(in);
+        return -1;
+    }
+
+    int n;
+    while ((n = read(in, buf, sizeof(buf))) > 0) {
+        if (write(out, buf, n) != n) {
+            n = -1;
+            break;
+        }
+    }
+
+    close(in);
+    close(out);
+    return n;
+}
+
+/* The copy runs read() and write() through the kernel direct map */
+static int copy_loop(int kb)
+{
+    int fd = open(SRC_PATH, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (fd < 0) {
+        printf("vmbench: cannot create %s\n", SRC_PATH);
+        return -1;
+    }
+
+    for (int i = 0; i < (int)sizeof(buf); i += 1) {
+        buf[i] = (char)i;
+    }
+
+    for (int i = 0; i < kb / 4; i += 1) {
+        write(fd, buf, sizeof(buf));
+    }
+    close(fd);
+
+    unsigned long long start = rdtsc();
+
+    int ret = 0;
+    for (int r = 0; r < COPY_ROUNDS && ret == 0; r += 1) {
+        ret = copy_file(SRC_PATH, DST_PATH);
+    }
+
+    unsigned long long cycles = rdtsc() - start;
+
+    unlink(SRC_PATH);
+    unlink(DST_PATH);
+
+    if (ret < 0) {
+        printf("vmbench: copy failed\n");
+        return -1;
+    }
+
+    printf("%d KB file copy: %llu cycles\n", kb, cycles / COPY_ROUNDS);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    int forks = argc > 1 ? atoi(argv[1]) : DEFAULT_FORKS;
+    int kb = argc > 2 ? atoi(argv[2]) : DEFAULT_COPY_KB;
+
+    if (argc > 3 || forks < 1 || kb < 4) {
+        printf("Usage: vmbench [forks] [copy_kb]\n");
+        return 1;
+    }
+
+    if (fork_loop(forks) < 0 || copy_loop(kb) < 0) {
+        return 1;
+    }
+
+    return 0;
+}
@@ -2,6 +2,10 @@
 #define _LIBC_SYSCALLS_H
 
 #include <uapi/dirent.h>
+#include <uapi/meminfo.h>
+#include <uapi/mman.h>
+#include <uapi/resource.h>
+#include <uapi/sched.h>
 #include <uapi/stat.h>
 #include <uapi/types.h>
 
@@ -12,9 +16,26 @@ void exit(int status) __attribute__((noreturn));
 void _exit(int status) __attribute__((noreturn));
 
 pid_t fork(void);
+pid_t vfork(void);
 int execve(char const* path, char* const argv[], char* const envp[]);
 pid_t waitpid(int* status);
 pid_t getpid(void);
+int sched_yield(void);
+
+int nice(int increment);
+int setpriority(int which, int who, int prio);
+int __getpriority(int which, int who);
+
+/* The kernel returns 20 - nice, so that no nice level looks like an error */
+static inline int getpriority(int which, int who)
+{
+    int ret = __getpriority(which, who);
+    return ret < 0 ? ret : 20 - ret;
+}
+
+int sched_setscheduler(pid_t pid, int policy, struct sched_param const* param);
+int sched_getscheduler(pid_t pid);
+int sched_getparam(pid_t pid, struct sched_param* param);
 
 ssize_t read(int fd, void* buf, size_t count);
 ssize_t write(int fd, void const* buf, size_t count);
@@ -40,10 +61,18 @@ int reboot(int, int, unsigned int, void*);
 int init_module(void*, unsigned long, char const*);
 int delete_module(char const*, unsigned int);
 
+int kmemtrace(unsigned int min_age);
+int meminfo(struct meminfo*);
+
 int mount(char const*, char const*, char const*, unsigned long, void const*);
 
 int brk(unsigned long);
 
+void* mmap(void*, size_t, int, int, int, off_t);
+int munmap(void*, size_t);
+int mprotect(void*, size_t, int);
+int msync(void*, size_t, int);
+
 static inline void* sbrk(int increment)
 {
     void* old = (void*)brk(0);
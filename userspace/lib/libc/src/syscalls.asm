@@ -16,14 +16,28 @@
 	%define SYS_GETPID   20
 	%define SYS_MOUNT    22
 	%define SYS_FSTAT    28
+	%define SYS_NICE     34
 	%define SYS_MKDIR    39
 	%define SYS_RMDIR    40
 	%define SYS_BRK      45
 	%define SYS_REBOOT   88
 	%define SYS_READDIR  89
+	%define SYS_MMAP     90
+	%define SYS_MUNMAP   91
+	%define SYS_GETPRIORITY 96
+	%define SYS_SETPRIORITY 97
+	%define SYS_MPROTECT 125
+	%define SYS_MSYNC    144
+	%define SYS_SCHED_GETPARAM 155
+	%define SYS_SCHED_SETSCHEDULER 156
+	%define SYS_SCHED_GETSCHEDULER 157
+	%define SYS_SCHED_YIELD 158
 	%define SYS_INIT_MODULE  128
 	%define SYS_DELETE_MODULE  129
 	%define SYS_GETCWD   183
+	%define SYS_VFORK    190
+	%define SYS_KMEMTRACE 223
+	%define SYS_MEMINFO  224
 
 	section .text
 
@@ -117,6 +131,19 @@ fork:
 	int 0x80
 	ret
 
+	;      pid_t vfork(void)
+	;      The child runs on the parent's stack until it calls execve() or
+	;      _exit(). Keep the return address in a register, so the child
+	;      cannot clobber the slot the parent returns through.
+	global vfork
+
+vfork:
+	pop  ecx
+	mov  eax, SYS_VFORK
+	int  0x80
+	push ecx
+	ret
+
 	;      int execve(const char* path, char* const argv[], char* const envp[])
 	global execve
 
@@ -138,7 +165,9 @@ execve:
 waitpid:
 	push ebx
 	mov  eax, SYS_WAIT
-	mov  ebx, [esp+8]
+	mov  ebx, -1            ; any child
+	mov  ecx, [esp+8]
+	xor  edx, edx
 	int  0x80
 	pop  ebx
 	ret
@@ -286,3 +315,149 @@ brk:
 
 	int 0x80
 	ret
+
+	;      void* mmap(void* addr, size_t len, int prot, int flags, int fd, off_t offset)
+	;      The kernel reads the arguments straight off our stack
+global mmap
+
+mmap:
+	push ebx
+	mov  eax, SYS_MMAP
+	lea  ebx, [esp+8]
+	int  0x80
+	pop  ebx
+
+	cmp eax, -4095
+	jb  .done
+	mov eax, -1; MAP_FAILED
+
+.done:
+	ret
+
+global munmap
+
+munmap:
+	push ebx
+	mov  eax, SYS_MUNMAP
+	mov  ebx, [esp+8]
+	mov  ecx, [esp+12]
+	int  0x80
+	pop  ebx
+	ret
+
+global mprotect
+
+mprotect:
+	push ebx
+	mov  eax, SYS_MPROTECT
+	mov  ebx, [esp+8]
+	mov  ecx, [esp+12]
+	mov  edx, [esp+16]
+	int  0x80
+	pop  ebx
+	ret
+
+global msync
+
+msync:
+	push ebx
+	mov  eax, SYS_MSYNC
+	mov  ebx, [esp+8]
+	mov  ecx, [esp+12]
+	mov  edx, [esp+16]
+	int  0x80
+	pop  ebx
+	ret
+
+global kmemtrace
+
+kmemtrace:
+	push ebx
+	mov  eax, SYS_KMEMTRACE
+	mov  ebx, [esp+8]
+	int  0x80
+	pop  ebx
+	ret
+
+global meminfo
+
+meminfo:
+	push ebx
+	mov  eax, SYS_MEMINFO
+	mov  ebx, [esp+8]
+	int  0x80
+	pop  ebx
+	ret
+
+global sched_yield
+
+sched_yield:
+	mov eax, SYS_SCHED_YIELD
+	int 0x80
+	ret
+
+global nice
+
+nice:
+	push ebx
+	mov  eax, SYS_NICE
+	mov  ebx, [esp+8]
+	int  0x80
+	pop  ebx
+	ret
+
+global __getpriority
+
+__getpriority:
+	push ebx
+	mov  eax, SYS_GETPRIORITY
+	mov  ebx, [esp+8]
+	mov  ecx, [esp+12]
+	int  0x80
+	pop  ebx
+	ret
+
+global setpriority
+
+setpriority:
+	push ebx
+	mov  eax, SYS_SETPRIORITY
+	mov  ebx, [esp+8]
+	mov  ecx, [esp+12]
+	mov  edx, [esp+16]
+	int  0x80
+	pop  ebx
+	ret
+
+global sched_setscheduler
+
+sched_setscheduler:
+	push ebx
+	mov  eax, SYS_SCHED_SETSCHEDULER
+	mov  ebx, [esp+8]
+	mov  ecx, [esp+12]
+	mov  edx, [esp+16]
+	int  0x80
+	pop  ebx
+	ret
+
+global sched_getscheduler
+
+sched_getscheduler:
+	push ebx
+	mov  eax, SYS_SCHED_GETSCHEDULER
+	mov  ebx, [esp+8]
+	int  0x80
+	pop  ebx
+	ret
+
+global sched_getparam
+
+sched_getparam:
+	push ebx
+	mov  eax, SYS_SCHED_GETPARAM
+	mov  ebx, [esp+8]
+	mov  ecx, [esp+12]
+	int  0x80
+	pop  ebx
+	ret